@@ -0,0 +1,306 @@
+/** @file
+ * Implementacja liczników alokacji pamięci na wielomiany.
+ *
+ * @author Mateusz Sulimowicz <ms429603@students.mimuw.edu.pl>
+ * @date 2021
+ */
+
+/** Makro potrzebne do korzystania z GNU C Library. */
+#define _GNU_SOURCE
+
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+#include "alloc.h"
+
+/** Początkowy rozmiar tablicy haszującej strażnika. */
+#define GUARD_INIT_SIZE 64
+
+/** Mnożnik mieszający bity adresu bloku. */
+#define GUARD_HASH_MIX 0x9E3779B97F4A7C15u
+
+/** Co tyle wywołań AllocGuardPoll() sprawdzane są warunki przerwania operacji. */
+#define GUARD_POLL_TICKS 256
+
+_Thread_local AllocStats alloc_stats;
+
+size_t alloc_limit;
+
+_Thread_local AllocGuard *alloc_guard;
+
+uint64_t alloc_timeout_ns;
+
+uint64_t alloc_max_terms;
+
+/** Numer anulowania, zwiększany przez AllocGuardCancel(). */
+static atomic_uint guard_epoch;
+
+/** Liczba operacji wykonywanych pod strażnikami. */
+static atomic_int guard_active;
+
+/**
+ * Czy anulowanie nadeszło pod koniec operacji bieżącego wątku, gdy nie
+ * mogła go już sprawdzić? Przerywa wtedy kolejną operację tego wątku.
+ */
+static _Thread_local bool guard_pending;
+
+/** Liczba bajtów przydzielonych przez wszystkie wątki, liczona tylko przy ustawionym limicie. */
+static atomic_size_t alloc_used;
+
+/** Znacznik miejsca w tablicy haszującej, z którego usunięto blok. */
+static char guard_removed;
+
+/**
+ * Zwraca miejsce bloku w tablicy haszującej strażnika.
+ * @param[in] g : strażnik
+ * @param[in] p : wskaźnik na blok
+ * @return indeks pierwszego miejsca do sprawdzenia
+ */
+static inline size_t GuardSlot(const AllocGuard *g, const void *p) {
+    uint64_t h = ((uint64_t) (uintptr_t) p >> 4) * GUARD_HASH_MIX;
+    return (size_t) (h >> 32) & (g->size - 1);
+}
+
+/**
+ * Wstawia blok do tablicy haszującej, nie sprawdzając jej zapełnienia.
+ * @param[in,out] g : strażnik
+ * @param[in] p : wskaźnik na blok
+ */
+static void GuardPut(AllocGuard *g, void *p) {
+    size_t i = GuardSlot(g, p);
+    while (g->blocks[i] != NULL && g->blocks[i] != &guard_removed) {
+        i = (i + 1) & (g->size - 1);
+    }
+    if (g->blocks[i] == NULL) {
+        ++g->used;
+    }
+    g->blocks[i] = p;
+    ++g->count;
+}
+
+/**
+ * Zapamiętuje blok przydzielony pod strażnikiem. Gdy tablica zapełni się
+ * w trzech czwartych, przepisuje ją, pomijając usunięte bloki.
+ * @param[in,out] g : strażnik
+ * @param[in] p : wskaźnik na blok
+ */
+static void GuardInsert(AllocGuard *g, void *p) {
+    if (4 * (g->used + 1) > 3 * g->size) {
+        void **old = g->blocks;
+        size_t old_size = g->size;
+        size_t size = GUARD_INIT_SIZE;
+        while (4 * (g->count + 1) > size) {
+            size *= 2;
+        }
+        g->blocks = calloc(size, sizeof(void *));
+        if (g->blocks == NULL) {
+            exit(1);
+        }
+        g->size = size;
+        g->used = 0;
+        g->count = 0;
+        for (size_t i = 0; i < old_size; ++i) {
+            if (old[i] != NULL && old[i] != &guard_removed) {
+                GuardPut(g, old[i]);
+            }
+        }
+        free(old);
+    }
+    GuardPut(g, p);
+}
+
+/**
+ * Usuwa blok z tablicy haszującej strażnika.
+ * @param[in,out] g : strażnik
+ * @param[in] p : wskaźnik na blok
+ * @return Czy blok był zapamiętany?
+ */
+static bool GuardRemove(AllocGuard *g, const void *p) {
+    if (g->count == 0) {
+        return false;
+    }
+    size_t i = GuardSlot(g, p);
+    while (g->blocks[i] != NULL) {
+        if (g->blocks[i] == p) {
+            g->blocks[i] = &guard_removed;
+            --g->count;
+            return true;
+        }
+        i = (i + 1) & (g->size - 1);
+    }
+    return false;
+}
+
+/**
+ * Zwraca bieżący czas monotoniczny.
+ * @return czas w nanosekundach
+ */
+static uint64_t GuardNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+/**
+ * Przerywa operację wykonywaną pod strażnikiem bieżącego wątku:
+ * zwalnia przydzielone w jej trakcie bloki i wraca do miejsca
+ * zapamiętanego przez strażnika.
+ * @param[in] reason : przyczyna przerwania
+ */
+static _Noreturn void AllocFail(AllocAbort reason) {
+    AllocGuard *g = alloc_guard;
+    alloc_guard = NULL;
+    atomic_fetch_sub_explicit(&guard_active, 1, memory_order_relaxed);
+    for (size_t i = 0; i < g->size; ++i) {
+        if (g->blocks[i] != NULL && g->blocks[i] != &guard_removed) {
+            PolyFree(g->blocks[i]);
+        }
+    }
+    free(g->blocks);
+    longjmp(g->env, (int) reason);
+}
+
+/**
+ * Sprawdza, czy przydział @p size bajtów zmieści się w limicie.
+ * Jeśli nie, przerywa operację wykonywaną pod strażnikiem.
+ * @param[in] size : rozmiar przydziału
+ */
+static inline void AllocReserve(size_t size) {
+    if (alloc_guard != NULL) {
+        // Przydziały poza strażnikiem mogły już przekroczyć limit.
+        size_t used = atomic_load_explicit(&alloc_used, memory_order_relaxed);
+        if (used > alloc_limit || size > alloc_limit - used) {
+            AllocFail(ALLOC_ABORT_MEMORY);
+        }
+    }
+}
+
+void *AllocLimitedMalloc(size_t size) {
+    AllocReserve(size);
+    void *p = malloc(size);
+    if (p == NULL) {
+        if (alloc_guard != NULL) {
+            AllocFail(ALLOC_ABORT_MEMORY);
+        }
+        return NULL;
+    }
+    atomic_fetch_add_explicit(&alloc_used, malloc_usable_size(p), memory_order_relaxed);
+    if (alloc_guard != NULL) {
+        GuardInsert(alloc_guard, p);
+    }
+    return p;
+}
+
+void *AllocLimitedRealloc(void *p, size_t old, size_t size) {
+    if (size > old) {
+        AllocReserve(size - old);
+    }
+    // Blok przydzielony przed operacją nadal należy do swojego właściciela.
+    bool tracked = alloc_guard != NULL && (p == NULL || GuardRemove(alloc_guard, p));
+    void *r = realloc(p, size);
+    if (r == NULL) {
+        if (alloc_guard != NULL) {
+            // Niezmieniony blok trzeba zwolnić razem z pozostałymi.
+            if (tracked && p != NULL) {
+                GuardInsert(alloc_guard, p);
+            }
+            AllocFail(ALLOC_ABORT_MEMORY);
+        }
+        return NULL;
+    }
+    atomic_fetch_sub_explicit(&alloc_used, old, memory_order_relaxed);
+    atomic_fetch_add_explicit(&alloc_used, malloc_usable_size(r), memory_order_relaxed);
+    if (tracked) {
+        GuardInsert(alloc_guard, r);
+    }
+    return r;
+}
+
+void AllocLimitedRelease(void *p, size_t size) {
+    atomic_fetch_sub_explicit(&alloc_used, size, memory_order_relaxed);
+    if (alloc_guard != NULL) {
+        GuardRemove(alloc_guard, p);
+    }
+}
+
+void AllocGuardBegin(AllocGuard *g) {
+    g->blocks = NULL;
+    g->size = 0;
+    g->used = 0;
+    g->count = 0;
+    g->deadline = alloc_timeout_ns != 0 ? GuardNow() + alloc_timeout_ns : 0;
+    g->terms = alloc_stats.terms;
+    g->epoch = atomic_load_explicit(&guard_epoch, memory_order_relaxed);
+    g->ticks = GUARD_POLL_TICKS;
+    atomic_fetch_add_explicit(&guard_active, 1, memory_order_relaxed);
+    alloc_guard = g;
+    if (guard_pending) {
+        guard_pending = false;
+        AllocFail(ALLOC_ABORT_CANCEL);
+    }
+}
+
+void AllocGuardEnd(AllocGuard *g) {
+    alloc_guard = NULL;
+    atomic_fetch_sub(&guard_active, 1);
+    // Operacja mogła się zakończyć bez sprawdzenia anulowania, np. gdy nie
+    // wywołuje AllocGuardPoll(); wtedy anulowanie czeka na kolejną operację.
+    // Kolejność odwrotna niż w AllocGuardCancel() sprawia, że anulowanie
+    // zauważy ta funkcja albo AllocGuardCancel() zwróci false.
+    if (atomic_load(&guard_epoch) != g->epoch) {
+        guard_pending = true;
+    }
+    free(g->blocks);
+}
+
+void AllocGuardCheck(void) {
+    AllocGuard *g = alloc_guard;
+    g->ticks = GUARD_POLL_TICKS;
+    if (atomic_load_explicit(&guard_epoch, memory_order_relaxed) != g->epoch) {
+        AllocFail(ALLOC_ABORT_CANCEL);
+    } else if (alloc_max_terms != 0 && alloc_stats.terms - g->terms > alloc_max_terms) {
+        AllocFail(ALLOC_ABORT_TERMS);
+    } else if (g->deadline != 0 && GuardNow() > g->deadline) {
+        AllocFail(ALLOC_ABORT_TIMEOUT);
+    }
+}
+
+void AllocGuardAbort(AllocAbort reason) {
+    AllocFail(reason);
+}
+
+void AllocGuardForgetCancel(void) {
+    guard_pending = false;
+}
+
+bool AllocGuardCancel(void) {
+    atomic_fetch_add(&guard_epoch, 1);
+    return atomic_load(&guard_active) != 0;
+}
+
+void AllocStatsReset(void) {
+    alloc_stats = (AllocStats) {.live_bytes = alloc_stats.live_bytes, .peak_bytes = alloc_stats.live_bytes};
+}
+
+AllocStats AllocStatsDelta(const AllocStats *before, const AllocStats *after) {
+    return (AllocStats) {
+        .allocs = after->allocs - before->allocs,
+        .alloc_bytes = after->alloc_bytes - before->alloc_bytes,
+        .free_bytes = after->free_bytes - before->free_bytes,
+        .live_bytes = after->live_bytes - before->live_bytes,
+        .peak_bytes = after->peak_bytes - before->live_bytes,
+        .terms = after->terms - before->terms,
+    };
+}
+
+void AllocStatsMerge(const AllocStats *delta) {
+    int64_t peak = alloc_stats.live_bytes + delta->peak_bytes;
+    alloc_stats.allocs += delta->allocs;
+    alloc_stats.alloc_bytes += delta->alloc_bytes;
+    alloc_stats.free_bytes += delta->free_bytes;
+    alloc_stats.live_bytes += delta->live_bytes;
+    alloc_stats.terms += delta->terms;
+    if (peak > alloc_stats.peak_bytes) {
+        alloc_stats.peak_bytes = peak;
+    }
+}
@@ -0,0 +1,286 @@
+/** @file
+ * Liczniki alokacji pamięci na wielomiany.
+ *
+ * Tablice jednomianów i bufory pomocnicze biblioteki wielomianów
+ * przydzielane są funkcjami z tego pliku, które oprócz przydziału
+ * zliczają alokacje, przydzielone i zwolnione bajty, szczytową liczbę
+ * zajętych bajtów oraz liczbę jednomianów w utworzonych wielomianach.
+ * Rozmiar bloku odczytywany jest funkcją `malloc_usable_size`, więc
+ * zwolnienie bloku przydzielonego przez inny moduł jest liczone
+ * poprawnie, o ile ten moduł też korzysta z tych funkcji.
+ *
+ * Liczniki są lokalne dla wątku, więc ich aktualizacja nie wymaga
+ * synchronizacji; koszt liczenia to kilka dodawań na alokację.
+ *
+ * Opcjonalnie cała pamięć przydzielona tymi funkcjami, przez wszystkie
+ * wątki, jest liczona względem limitu #alloc_limit. Operacja wykonywana
+ * pod strażnikiem (patrz AllocGuardBegin()), która przekroczyłaby limit
+ * lub której przydział się nie powiódł, jest przerywana: bloki
+ * przydzielone w jej trakcie są zwalniane, a sterowanie wraca do miejsca
+ * wskazanego przez strażnika. Przydziały poza strażnikiem są tylko liczone.
+ * Tak samo przerywana jest operacja, która trwa dłużej niż #alloc_timeout_ns,
+ * utworzyła więcej niż #alloc_max_terms jednomianów albo została anulowana
+ * funkcją AllocGuardCancel(). Te warunki sprawdzają długie pętle biblioteki
+ * wielomianów, wywołując AllocGuardPoll().
+ *
+ * Plik nagłówkowy do użytku wewnętrznego modułów operujących
+ * na wielomianach.
+ *
+ * @author Mateusz Sulimowicz <ms429603@students.mimuw.edu.pl>
+ * @date 2021
+ */
+
+#ifndef __ALLOC_H__
+#define __ALLOC_H__
+
+#include <malloc.h>
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/** To jest struktura przechowująca liczniki alokacji. */
+typedef struct AllocStats {
+    uint64_t allocs; ///< liczba alokacji, łącznie z realokacjami
+    uint64_t alloc_bytes; ///< liczba przydzielonych bajtów
+    uint64_t free_bytes; ///< liczba zwolnionych bajtów
+    int64_t live_bytes; ///< liczba zajętych bajtów
+    int64_t peak_bytes; ///< największa liczba zajętych bajtów
+    uint64_t terms; ///< liczba jednomianów w tablicach utworzonych wielomianów
+} AllocStats;
+
+/** Liczniki alokacji bieżącego wątku. */
+extern _Thread_local AllocStats alloc_stats;
+
+/**
+ * To jest struktura strażnika operacji przerywanej po przekroczeniu limitu
+ * pamięci. Zapamiętuje bloki przydzielone w trakcie operacji w tablicy
+ * haszującej z adresowaniem otwartym, by w razie przerwania je zwolnić.
+ */
+typedef struct AllocGuard {
+    jmp_buf env; ///< miejsce powrotu po przerwaniu operacji
+    void **blocks; ///< tablica haszująca bloków lub NULL
+    size_t size; ///< rozmiar tablicy, potęga dwójki
+    size_t used; ///< liczba zajętych miejsc, łącznie z usuniętymi blokami
+    size_t count; ///< liczba zapamiętanych bloków
+    uint64_t deadline; ///< chwila, po której operacja jest przerywana, lub 0
+    uint64_t terms; ///< licznik jednomianów wątku na początku operacji
+    unsigned epoch; ///< numer anulowania na początku operacji
+    unsigned ticks; ///< liczba wywołań AllocGuardPoll() do kolejnego sprawdzenia
+} AllocGuard;
+
+/**
+ * To jest typ wyliczeniowy przyczyn przerwania operacji, zwracanych
+ * przez `setjmp` strażnika.
+ */
+typedef enum AllocAbort {
+    ALLOC_ABORT_NONE, ///< operacja nie została przerwana
+    ALLOC_ABORT_MEMORY, ///< przekroczono limit pamięci lub przydział się nie powiódł
+    ALLOC_ABORT_TIMEOUT, ///< przekroczono limit czasu
+    ALLOC_ABORT_TERMS, ///< przekroczono limit liczby jednomianów
+    ALLOC_ABORT_CANCEL ///< operację anulowano
+} AllocAbort;
+
+/**
+ * Limit pamięci przydzielonej przez wszystkie wątki w bajtach lub 0,
+ * gdy przydziały nie są liczone, a strażnicy są wyłączeni. Limit
+ * `SIZE_MAX` włącza strażników bez ograniczania pamięci.
+ */
+extern size_t alloc_limit;
+
+/** Limit czasu operacji pod strażnikiem w nanosekundach lub 0. */
+extern uint64_t alloc_timeout_ns;
+
+/** Limit liczby jednomianów tworzonych przez operację pod strażnikiem lub 0. */
+extern uint64_t alloc_max_terms;
+
+/** Strażnik operacji wykonywanej przez bieżący wątek lub NULL. */
+extern _Thread_local AllocGuard *alloc_guard;
+
+/**
+ * Przydziela pamięć, licząc ją względem limitu. Pod strażnikiem zapamiętuje
+ * blok, a gdy limit zostałby przekroczony – przerywa operację.
+ * @param[in] size : rozmiar
+ * @return wskaźnik na pamięć lub NULL
+ */
+void *AllocLimitedMalloc(size_t size);
+
+/**
+ * Zmienia rozmiar pamięci, licząc ją względem limitu – patrz AllocLimitedMalloc().
+ * @param[in] p : wskaźnik na pamięć lub NULL
+ * @param[in] old : rozmiar bloku @p p
+ * @param[in] size : nowy rozmiar
+ * @return wskaźnik na pamięć lub NULL
+ */
+void *AllocLimitedRealloc(void *p, size_t old, size_t size);
+
+/**
+ * Odlicza od pamięci liczonej względem limitu blok, który zaraz zostanie zwolniony.
+ * @param[in] p : wskaźnik na blok
+ * @param[in] size : rozmiar bloku
+ */
+void AllocLimitedRelease(void *p, size_t size);
+
+/**
+ * Zlicza przydział bloku pamięci.
+ * @param[in] p : wskaźnik na blok lub NULL
+ */
+static inline void AllocCount(void *p) {
+    if (p != NULL) {
+        size_t size = malloc_usable_size(p);
+        ++alloc_stats.allocs;
+        alloc_stats.alloc_bytes += size;
+        alloc_stats.live_bytes += (int64_t) size;
+        if (alloc_stats.live_bytes > alloc_stats.peak_bytes) {
+            alloc_stats.peak_bytes = alloc_stats.live_bytes;
+        }
+    }
+}
+
+/**
+ * Przydziela pamięć tak jak `malloc`, zliczając przydział.
+ * @param[in] size : rozmiar
+ * @return wskaźnik na pamięć lub NULL
+ */
+static inline void *PolyMalloc(size_t size) {
+    void *p = alloc_limit != 0 ? AllocLimitedMalloc(size) : malloc(size);
+    AllocCount(p);
+    return p;
+}
+
+/**
+ * Zwalnia pamięć tak jak `free`, zliczając zwolnienie.
+ * @param[in] p : wskaźnik na pamięć lub NULL
+ */
+static inline void PolyFree(void *p) {
+    if (p != NULL) {
+        size_t size = malloc_usable_size(p);
+        alloc_stats.free_bytes += size;
+        alloc_stats.live_bytes -= (int64_t) size;
+        if (alloc_limit != 0) {
+            AllocLimitedRelease(p, size);
+        }
+        free(p);
+    }
+}
+
+/**
+ * Zmienia rozmiar pamięci tak jak `realloc`. Zmiana liczona jest
+ * jak zwolnienie starego bloku i przydział nowego.
+ * @param[in] p : wskaźnik na pamięć lub NULL
+ * @param[in] size : nowy rozmiar
+ * @return wskaźnik na pamięć lub NULL
+ */
+static inline void *PolyRealloc(void *p, size_t size) {
+    size_t old = p != NULL ? malloc_usable_size(p) : 0;
+    void *r = alloc_limit != 0 ? AllocLimitedRealloc(p, old, size) : realloc(p, size);
+    if (r != NULL) {
+        alloc_stats.free_bytes += old;
+        alloc_stats.live_bytes -= (int64_t) old;
+        AllocCount(r);
+    }
+    return r;
+}
+
+/**
+ * Zeruje liczniki alokacji bieżącego wątku. Zajęta pamięć pozostaje
+ * zajęta, więc szczytowa liczba zajętych bajtów liczona jest od
+ * bieżącej liczby zajętych bajtów.
+ */
+void AllocStatsReset(void);
+
+/**
+ * Zwraca przyrost liczników między dwoma odczytami.
+ * @param[in] before : wcześniejszy odczyt
+ * @param[in] after : późniejszy odczyt
+ * @return przyrost liczników; szczytowa liczba bajtów to przyrost
+ * szczytu względem zajętych bajtów wcześniejszego odczytu, więc ma sens,
+ * jeśli tuż przed wcześniejszym odczytem szczyt zrównano z zajętymi bajtami
+ */
+AllocStats AllocStatsDelta(const AllocStats *before, const AllocStats *after);
+
+/**
+ * Dolicza do liczników bieżącego wątku przyrost zmierzony w innym wątku,
+ * np. przez wątek, który przygotował wielomiany przekazane bieżącemu.
+ * @param[in] delta : przyrost liczników – patrz AllocStatsDelta()
+ */
+void AllocStatsMerge(const AllocStats *delta);
+
+/**
+ * Rozpoczyna operację pod strażnikiem @p g, który musi być wcześniej
+ * przygotowany wywołaniem `setjmp(g->env)`. Gdy operacja zostanie przerwana,
+ * `setjmp` zwróci wartość niezerową, a strażnik będzie już zakończony.
+ * Wywoływana tylko, gdy ustawiono limit pamięci.
+ * @param[out] g : strażnik
+ */
+void AllocGuardBegin(AllocGuard *g);
+
+/**
+ * Kończy operację pod strażnikiem. Przydzielone w jej trakcie bloki
+ * należą odtąd do wywołującego. Jeśli operację anulowano, ale nie
+ * sprawdziła ona tego przed zakończeniem, anulowanie przerwie kolejną
+ * operację bieżącego wątku już w AllocGuardBegin().
+ * @param[in,out] g : strażnik
+ */
+void AllocGuardEnd(AllocGuard *g);
+
+/**
+ * Sprawdza limit czasu, limit liczby jednomianów i anulowanie operacji
+ * wykonywanej pod strażnikiem; jeśli któryś warunek jest spełniony,
+ * przerywa ją. Wywoływana przez AllocGuardPoll().
+ */
+void AllocGuardCheck(void);
+
+/**
+ * Przerywa operację wykonywaną pod strażnikiem bieżącego wątku – patrz
+ * AllocGuardBegin(). Pozwala przekazać dalej przerwanie operacji wykonywanej
+ * pod strażnikiem zagnieżdżonym na czas zawieszenia zewnętrznego.
+ * @param[in] reason : przyczyna przerwania
+ */
+_Noreturn void AllocGuardAbort(AllocAbort reason);
+
+/**
+ * Punkt, w którym długa pętla pozwala przerwać operację. Warunki przerwania
+ * sprawdzane są co pewną liczbę wywołań, więc koszt wywołania poza
+ * strażnikiem i między sprawdzeniami to jedno porównanie.
+ */
+static inline void AllocGuardPoll(void) {
+    if (alloc_guard != NULL && --alloc_guard->ticks == 0) {
+        AllocGuardCheck();
+    }
+}
+
+/**
+ * Anuluje operacje wykonywane pod strażnikami przez wszystkie wątki.
+ * Można ją wywołać z funkcji obsługi sygnału.
+ * @return Czy jakaś operacja była wykonywana?
+ */
+bool AllocGuardCancel(void);
+
+/**
+ * Zapomina anulowanie czekające na kolejną operację bieżącego wątku – patrz
+ * AllocGuardEnd(). Wywoływana, gdy wątek zaczyna niezależną pracę, np. sesję.
+ */
+void AllocGuardForgetCancel(void);
+
+/**
+ * Zawiesza strażnika bieżącego wątku: do wywołania AllocGuardResume()
+ * przydziały są tylko liczone. Pozwala to przekazać przydzielone bloki
+ * strukturom, które przetrwają przerwanie operacji.
+ * @return zawieszony strażnik lub NULL
+ */
+static inline AllocGuard *AllocGuardSuspend(void) {
+    AllocGuard *g = alloc_guard;
+    alloc_guard = NULL;
+    return g;
+}
+
+/**
+ * Wznawia strażnika zawieszonego funkcją AllocGuardSuspend().
+ * @param[in] g : strażnik lub NULL
+ */
+static inline void AllocGuardResume(AllocGuard *g) {
+    alloc_guard = g;
+}
+
+#endif //__ALLOC_H__
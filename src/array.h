@@ -0,0 +1,36 @@
+/** @file
+ * Powiększanie tablic dynamicznych.
+ *
+ * Plik nagłówkowy do użytku wewnętrznego modułów kalkulatora.
+ *
+ * @author Mateusz Sulimowicz <ms429603@students.mimuw.edu.pl>
+ * @date 2021
+ */
+
+#ifndef __ARRAY_H__
+#define __ARRAY_H__
+
+#include <stdlib.h>
+#include "poly.h"
+
+/** Mnożnik rozmiaru tablicy do realokacji. */
+#define ARRAY_MULTIPLIER 2
+
+/**
+ * Zapewnia miejsce na kolejny element tablicy, w razie potrzeby
+ * powiększając ją.
+ * @param[in,out] arr : wskaźnik na tablicę
+ * @param[in,out] size : rozmiar tablicy
+ * @param[in] count : liczba elementów tablicy
+ * @param[in] elem_size : rozmiar elementu
+ * @param[in] init_size : rozmiar pustej tablicy po pierwszym powiększeniu
+ */
+static inline void ArrayReserve(void **arr, size_t *size, size_t count, size_t elem_size, size_t init_size) {
+    if (count == *size) {
+        *size = *size == 0 ? init_size : ARRAY_MULTIPLIER * *size;
+        *arr = realloc(*arr, *size * elem_size);
+        CHECK_PTR(*arr);
+    }
+}
+
+#endif /* __ARRAY_H__ */
@@ -8,440 +8,2141 @@
 /** Makro potrzebne do korzystania z GNU C Library. */
 #define _GNU_SOURCE
 
-#include <stdio.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include "alloc.h"
+#include "array.h"
+#include "code.h"
+#include "input.h"
+#include "lazy.h"
+#include "namemap.h"
+#include "number.h"
 #include "parser.h"
+#include "pipeline.h"
+#include "prob.h"
+#include "serial.h"
+#include "server.h"
 #include "stack.h"
+#include "trace.h"
+#include "writer.h"
+
+/** Początkowy rozmiar alokowanej tablicy */
+#define INIT_SIZE 4
+
+/** Oznaczenie bloku, który nie należy do żadnego makra. */
+#define NO_MACRO SIZE_MAX
+
+/** Oznaczenie bloku REPEAT, którego ciało wykonywane jest raz, bez pętli. */
+#define NO_LOOP SIZE_MAX
+
+/** Liczba stosów kalkulatora, między którymi można się przełączać. */
+#define MAX_STACKS 256
+
+/** To jest typ wyliczeniowy opisujący rodzaj bloku. */
+typedef enum BlockKind {
+    BLOCK_DEF, ///< definicja makra
+    BLOCK_REPEAT, ///< pętla REPEAT
+    BLOCK_DEAD ///< blok, który nie zostanie wykonany (np. REPEAT 0 lub błędny)
+} BlockKind;
+
+/** To jest struktura opisująca otwarty blok DEF lub REPEAT. */
+typedef struct Block {
+    BlockKind kind; ///< rodzaj bloku
+    size_t line; ///< numer wiersza otwierającego blok
+    size_t macro; ///< indeks makra, do którego kompilowany jest blok, lub #NO_MACRO
+    size_t start; ///< indeks początku ciała pętli w kodzie lub #NO_LOOP
+    char *name; ///< nazwa definiowanego makra
+    bool clone; ///< czy stałe w bloku trzeba kopiować, bo blok wykonywany jest wielokrotnie
+} Block;
+
+/** To jest struktura przechowująca miejsce powrotu z makra. */
+typedef struct ExecFrame {
+    Code *code; ///< kod, do którego wracamy
+    size_t pc; ///< indeks instrukcji, od której kontynuujemy
+} ExecFrame;
+
+/**
+ * To jest struktura przechowująca rejestr kalkulatora.
+ * W trybie zwykłym rejestr jest właścicielem wielomianu, a w trybie
+ * leniwym przechowuje odwołanie do wyrażenia, współdzielone ze stosami.
+ */
+typedef struct Register {
+    bool full; ///< czy rejestr przechowuje wartość
+    Poly p; ///< wartość rejestru w trybie zwykłym
+    struct Expr *e; ///< wartość rejestru w trybie leniwym
+} Register;
+
+/** To jest struktura przechowująca stan kalkulatora. */
+typedef struct Calc {
+    Stack s; ///< aktywny stos kalkulatora
+    Stack *stacks; ///< stosy kalkulatora według numerów; miejsce aktywnego stosu jest nieaktualne
+    size_t stacks_count; ///< rozmiar tablicy stosów
+    size_t stack_idx; ///< numer aktywnego stosu
+    size_t spill_keep; ///< liczba wierzchnich wielomianów stosu trzymanych w pamięci lub 0 – patrz StackSetSpill()
+    Register *regs; ///< rejestry kalkulatora
+    size_t regs_size; ///< rozmiar tablicy rejestrów
+    size_t regs_count; ///< liczba rejestrów
+    NameMap reg_names; ///< indeksy rejestrów według nazw
+    bool lazy; ///< czy kalkulator działa w trybie leniwym
+    ExprStack exprs; ///< stos wyrażeń kalkulatora w trybie leniwym
+    uint64_t seed; ///< stan generatora punktów dla poleceń PROB_EQ i PROB_ZERO
+    Writer out; ///< buforowane wyjście wyników
+    bool errors_to_out; ///< czy komunikaty o błędach trafiają do wyjścia wyników zamiast na standardowe wyjście błędu
+    Writer *latency; ///< zapis czasów wykonania poleceń lub NULL
+    bool timed; ///< czy mierzyć czas wykonania poleceń
+    struct CommandStats *stats; ///< liczniki wykonań poleceń według identyfikatorów
+    Code top; ///< kod wierszy spoza definicji makr
+    Code *macros; ///< kod makr
+    size_t macros_size; ///< rozmiar tablicy makr
+    size_t macros_count; ///< liczba makr
+    NameMap macro_names; ///< indeksy makr według nazw
+    Block *blocks; ///< stos otwartych bloków
+    size_t blocks_size; ///< rozmiar stosu bloków
+    size_t blocks_count; ///< liczba otwartych bloków
+    ExecFrame *frames; ///< stos miejsc powrotu z makr
+    size_t frames_size; ///< rozmiar stosu miejsc powrotu
+    size_t frames_count; ///< liczba miejsc powrotu na stosie
+    size_t *loops; ///< stos liczników wykonywanych pętli
+    size_t loops_size; ///< rozmiar stosu liczników
+    size_t loops_count; ///< liczba liczników na stosie
+} Calc;
+
+/** Liczba bitów wartości funkcji haszującej nazwy poleceń. */
+#define COMMAND_HASH_BITS 6
+
+/** Rozmiar tablicy haszującej nazwy poleceń. */
+#define COMMAND_HASH_SIZE (1 << COMMAND_HASH_BITS)
 
-/** Długość nazwy polecenia "DEG_BY" */
-#define DEG_BY_LENGTH 6
+/** To jest typ wyliczeniowy opisujący rodzaj parametru polecenia. */
+typedef enum CommandArgType {
+    ARG_NONE, ///< polecenie bez parametru
+    ARG_UNSIGNED, ///< liczba nieujemna, parsowana tak jak przez `strtoul`
+    ARG_SIGNED, ///< liczba całkowita, parsowana tak jak przez `strtol`
+    ARG_PATH, ///< ścieżka do pliku – cała reszta wiersza
+    ARG_NAME, ///< nazwa makra
+    ARG_REGISTER ///< nazwa rejestru, zamieniana podczas kompilacji na jego indeks
+} CommandArgType;
 
-/** Długość nazwy polecenia "AT" */
-#define AT_LENGTH 2
+/** To jest typ wyliczeniowy identyfikujący polecenie kalkulatora. */
+typedef enum CommandId {
+    CMD_ZERO, ///< polecenie ZERO
+    CMD_IS_COEFF, ///< polecenie IS_COEFF
+    CMD_IS_ZERO, ///< polecenie IS_ZERO
+    CMD_CLONE, ///< polecenie CLONE
+    CMD_ADD, ///< polecenie ADD
+    CMD_MUL, ///< polecenie MUL
+    CMD_NEG, ///< polecenie NEG
+    CMD_SUB, ///< polecenie SUB
+    CMD_IS_EQ, ///< polecenie IS_EQ
+    CMD_DEG, ///< polecenie DEG
+    CMD_PRINT, ///< polecenie PRINT
+    CMD_POP, ///< polecenie POP
+    CMD_DEG_BY, ///< polecenie DEG_BY
+    CMD_SHAPE, ///< polecenie SHAPE
+    CMD_AT, ///< polecenie AT
+    CMD_COMPOSE, ///< polecenie COMPOSE
+    CMD_SAVE, ///< polecenie SAVE
+    CMD_LOAD, ///< polecenie LOAD
+    CMD_CHECKPOINT, ///< polecenie CHECKPOINT
+    CMD_PROB_EQ, ///< polecenie PROB_EQ
+    CMD_PROB_ZERO, ///< polecenie PROB_ZERO
+    CMD_STORE, ///< polecenie STORE
+    CMD_LOAD_REG, ///< polecenie LOAD_REG
+    CMD_DROP, ///< polecenie DROP
+    CMD_STACK, ///< polecenie STACK
+    CMD_STATS, ///< polecenie STATS
+    CMD_STATS_RESET, ///< polecenie STATS_RESET
+    CMD_DEF, ///< dyrektywa DEF, rozpoczynająca definicję makra
+    CMD_REPEAT, ///< dyrektywa REPEAT, rozpoczynająca pętlę
+    CMD_END, ///< dyrektywa END, kończąca blok
+    CMD_COUNT ///< liczba poleceń i dyrektyw
+} CommandId;
 
-/** Długość nazwy polecenia "COMPOSE" */
-#define COMPOSE_LENGTH 7
+/** To jest struktura przechowująca liczniki wykonań polecenia. */
+typedef struct CommandStats {
+    uint64_t calls; ///< liczba wykonań
+    uint64_t timed; ///< liczba wykonań, których czas zmierzono
+    uint64_t ns; ///< łączny czas wykonań w nanosekundach
+    uint64_t max_ns; ///< najdłuższy czas wykonania w nanosekundach
+    uint64_t alloc_bytes; ///< liczba bajtów przydzielonych na wielomiany
+    uint64_t free_bytes; ///< liczba bajtów zwolnionych z wielomianów
+    uint64_t terms; ///< liczba jednomianów w utworzonych wielomianach
+} CommandStats;
+
+/**
+ * Kody operacji kodu bajtowego, które nie są poleceniami kalkulatora.
+ * Kodem operacji polecenia jest jego identyfikator.
+ */
+enum {
+    OP_PUSH = CMD_COUNT, ///< wstawia na stos stałą, przejmując ją z puli
+    OP_PUSH_CLONE, ///< wstawia na stos kopię stałej z puli
+    OP_ERROR, ///< wypisuje komunikat o błędzie wykrytym podczas kompilacji
+    OP_REPEAT, ///< rozpoczyna pętlę o zadanej liczbie obrotów
+    OP_LOOP, ///< kończy obrót pętli, skacząc na początek jej ciała
+    OP_CALL ///< wywołuje makro
+};
+
+/** To jest struktura opisująca polecenie kalkulatora. */
+typedef struct Command {
+    const char *name; ///< nazwa polecenia
+    size_t name_len; ///< długość nazwy polecenia
+    size_t arity; ///< liczba wielomianów ze stosu potrzebnych do wykonania polecenia
+    bool arg_arity; ///< czy parametr zwiększa liczbę potrzebnych wielomianów
+    CommandArgType arg; ///< rodzaj parametru polecenia
+    const char *arg_error; ///< komunikat o niepoprawnym parametrze
+    bool builds; ///< czy polecenie tworzy wielomian, więc brak pamięci może je przerwać
+} Command;
+
+/**
+ * Zwraca liczbę wielomianów na stosie kalkulatora.
+ * @param[in] c : wskaźnik na stan kalkulatora
+ * @return liczba wielomianów na stosie
+ */
+static inline size_t CalcCount(const Calc *c) {
+    return c->lazy ? ExprStackCount(&c->exprs) : StackPolyCount(c->s);
+}
+
+/**
+ * Wstawia wielomian na stos kalkulatora, przejmując go na własność.
+ * @param[in,out] c : wskaźnik na stan kalkulatora
+ * @param[in] p : wielomian
+ */
+static inline void CalcPush(Calc *c, const Poly *p) {
+    if (c->lazy) {
+        ExprStackPush(&c->exprs, p);
+    } else {
+        StackPush(c->s, p);
+    }
+}
+
+/**
+ * Zdejmuje wielomian z wierzchołka stosu kalkulatora i przejmuje go
+ * na własność. W trybie leniwym oblicza go.
+ * @param[in,out] c : wskaźnik na stan kalkulatora
+ * @param[out] err : wskaźnik na informację o błędzie
+ * @return wielomian z wierzchołka stosu
+ */
+static inline Poly CalcPop(Calc *c, bool *err) {
+    return c->lazy ? ExprStackTake(&c->exprs) : StackPop(c->s, err);
+}
+
+/**
+ * Zwraca wielomian z wierzchołka stosu kalkulatora, ale go nie zdejmuje.
+ * W trybie leniwym oblicza go.
+ * @param[in,out] c : wskaźnik na stan kalkulatora
+ * @param[out] err : wskaźnik na informację o błędzie
+ * @return wielomian z wierzchołka stosu
+ */
+static inline Poly CalcTop(Calc *c, bool *err) {
+    return c->lazy ? *ExprStackPeek(&c->exprs, 0) : StackTop(c->s, err);
+}
+
+/**
+ * Zwraca wskaźnik na wielomian leżący @p depth miejsc pod wierzchołkiem
+ * stosu kalkulatora. W trybie leniwym oblicza go.
+ * @param[in,out] c : wskaźnik na stan kalkulatora
+ * @param[in] depth : głębokość, mniejsza niż liczba wielomianów na stosie
+ * @return wskaźnik na wielomian
+ */
+static inline const Poly *CalcPeek(Calc *c, size_t depth) {
+    return c->lazy ? ExprStackPeek(&c->exprs, depth) : StackPeek(c->s, depth);
+}
+
+/**
+ * Zastępuje @p count wierzchnich wielomianów stosu wielomianem @p r,
+ * przejmując go na własność. Polecenia obliczają wynik z argumentów
+ * pozostawionych na stosie i dopiero wtedy je usuwają, więc przerwane
+ * z braku pamięci pozostawiają stos bez zmian.
+ * @param[in,out] c : wskaźnik na stan kalkulatora
+ * @param[in] count : liczba usuwanych wielomianów
+ * @param[in] r : wielomian
+ */
+static void CalcReplace(Calc *c, size_t count, const Poly *r) {
+    bool err = false;
+    for (size_t i = 0; i < count; ++i) {
+        if (c->lazy) {
+            ExprStackPop(&c->exprs);
+        } else {
+            Poly p = StackPop(c->s, &err);
+            PolyDestroy(&p);
+        }
+    }
+    CalcPush(c, r);
+}
 
 /**
  * Wstawia na wierzchołek stosu wielomian
  * tożsamościowo równy zeru.
- * @param[in,out] s : wskaźnik na stos kalkulatora
+ * @param[in,out] c : wskaźnik na stan kalkulatora
  */
-static void CommandZeroExec(Stack s) {
+static void CommandZeroExec(Calc *c) {
     Poly p = PolyZero();
-    StackPush(s, &p);
+    CalcPush(c, &p);
 }
 
 /**
  * Sprawdza, czy wielomian na wierzchołku stosu
  * jest współczynnikiem – wypisuje na standardowe wyjście 0 lub 1.
- * W przypadku wykrycia błędu, ustawia `*err = true`.
- * @param[in] s : wskaźnik na stos kalkulatora
+ * @param[in,out] c : wskaźnik na stan kalkulatora
  * @param[out] err : wskaźnik na informację o błędzie
  */
-static void CommandIsCoeffExec(Stack s, bool *err) {
-    if (StackPolyCount(s) >= 1) {
-        Poly p = StackTop(s, err);
-        printf("%d\n", PolyIsCoeff(&p));
-    } else {
-        *err = true;
-    }
+static void CommandIsCoeffExec(Calc *c, bool *err) {
+    Poly p = CalcTop(c, err);
+    WriterLong(&c->out, PolyIsCoeff(&p));
+    WriterEndLine(&c->out);
 }
 
 /**
  * Sprawdza, czy wielomian na wierzchołku stosu
  * jest tożsamościowo równy zeru – wypisuje na standardowe wyjście 0 lub 1.
- * W przypadku wykrycia błędu, ustawia `*err = true`.
- * @param[in] s : wskaźnik na stos kalkulatora
+ * @param[in,out] c : wskaźnik na stan kalkulatora
  * @param[out] err : wskaźnik na informację o błędzie
  */
-static void CommandIsZeroExec(Stack s, bool *err) {
-    if (StackPolyCount(s) >= 1) {
-        Poly p = StackTop(s, err);
-        printf("%d\n", PolyIsZero(&p));
-    } else {
-        *err = true;
-    }
+static void CommandIsZeroExec(Calc *c, bool *err) {
+    Poly p = CalcTop(c, err);
+    WriterLong(&c->out, PolyIsZero(&p));
+    WriterEndLine(&c->out);
 }
 
 /**
  * Wstawia na stos kopię wielomianu z wierzchołka.
- * W przypadku wykrycia błędu, ustawia `*err = true`.
- * @param[in,out] s : wskaźnik na stos kalkulatora
+ * @param[in,out] c : wskaźnik na stan kalkulatora
  * @param[out] err : wskaźnik na informację o błędzie
  */
-static void CommandCloneExec(Stack s, bool *err) {
-    if (StackPolyCount(s) >= 1) {
-        Poly p = StackTop(s, err);
-        Poly q = PolyClone(&p);
-        StackPush(s, &q);
-    } else {
-        *err = true;
+static void CommandCloneExec(Calc *c, bool *err) {
+    if (c->lazy) {
+        ExprStackClone(&c->exprs);
+        return;
     }
+    Poly p = CalcTop(c, err);
+    Poly q = PolyClone(&p);
+    CalcPush(c, &q);
 }
 
 /**
  * Dodaje dwa wielomiany z wierzchu stosu,
  * usuwa je i wstawia na wierzchołek stosu ich sumę.
- * W przypadku wykrycia błędu, ustawia `*err = true`.
- * @param[in,out] s : wskaźnik na stos kalkulatora
- * @param[out] err : wskaźnik na informację o błędzie
+ * @param[in,out] c : wskaźnik na stan kalkulatora
  */
-static void CommandAddExec(Stack s, bool *err) {
-    if (StackPolyCount(s) >= 2) {
-        Poly p = StackPop(s, err);
-        Poly q = StackPop(s, err);
-        Poly r = PolyAdd(&p, &q);
-        StackPush(s, &r);
-        PolyDestroy(&q);
-        PolyDestroy(&p);
-    } else {
-        *err = true;
+static void CommandAddExec(Calc *c) {
+    if (c->lazy) {
+        ExprStackAdd(&c->exprs);
+        return;
     }
+    const Poly *q = CalcPeek(c, 1);
+    const Poly *p = CalcPeek(c, 0);
+    Poly r = PolyAdd(p, q);
+    CalcReplace(c, 2, &r);
 }
 
 /**
  * Mnoży dwa wielomiany z wierzchu stosu,
  * usuwa je i wstawia na wierzchołek stosu ich iloczyn.
- * W przypadku wykrycia błędu, ustawia `*err = true`.
- * @param[in,out] s : wskaźnik na stos kalkulatora
- * @param[out] err : wskaźnik na informację o błędzie
+ * @param[in,out] c : wskaźnik na stan kalkulatora
  */
-static void CommandMulExec(Stack s, bool *err) {
-    if (StackPolyCount(s) >= 2) {
-        Poly p = StackPop(s, err);
-        Poly q = StackPop(s, err);
-        Poly r = PolyMul(&p, &q);
-        StackPush(s, &r);
-        PolyDestroy(&q);
-        PolyDestroy(&p);
-    } else {
-        *err = true;
+static void CommandMulExec(Calc *c) {
+    if (c->lazy) {
+        ExprStackMul(&c->exprs);
+        return;
     }
+    const Poly *q = CalcPeek(c, 1);
+    const Poly *p = CalcPeek(c, 0);
+    Poly r = PolyMul(p, q);
+    CalcReplace(c, 2, &r);
 }
 
 /**
  * Neguje wielomian na wierzchołku stosu.
- * W przypadku wykrycia błędu, ustawia `*err = true`.
- * @param[in,out] s : wskaźnik na stos kalkulatora
- * @param[out] err : wskaźnik na informację o błędzie
+ * @param[in,out] c : wskaźnik na stan kalkulatora
  */
-static void CommandNegExec(Stack s, bool *err) {
-    if (StackPolyCount(s) >= 1) {
-        Poly p = StackPop(s, err);
-        Poly r = PolyNeg(&p);
-        StackPush(s, &r);
-        PolyDestroy(&p);
-    } else {
-        *err = true;
+static void CommandNegExec(Calc *c) {
+    if (c->lazy) {
+        ExprStackNeg(&c->exprs);
+        return;
     }
+    Poly r = PolyNeg(CalcPeek(c, 0));
+    CalcReplace(c, 1, &r);
 }
 
 /**
  * Odejmuje od wielomianu z wierzchołka wielomian pod wierzchołkiem,
  * usuwa je i wstawia na wierzchołek stosu różnicę.
- * W przypadku wykrycia błędu, ustawia `*err = true`.
- * @param[in,out] s : stos kalkulatora
- * @param[out] err : wskaźnik na informację o błędzie
+ * @param[in,out] c : wskaźnik na stan kalkulatora
  */
-static void CommandSubExec(Stack s, bool *err) {
-    if (StackPolyCount(s) >= 2) {
-        Poly p = StackPop(s, err);
-        Poly q = StackPop(s, err);
-        Poly r = PolySub(&p, &q);
-        StackPush(s, &r);
-        PolyDestroy(&q);
-        PolyDestroy(&p);
-    } else {
-        *err = true;
+static void CommandSubExec(Calc *c) {
+    if (c->lazy) {
+        ExprStackSub(&c->exprs);
+        return;
     }
+    const Poly *q = CalcPeek(c, 1);
+    const Poly *p = CalcPeek(c, 0);
+    Poly r = PolySub(p, q);
+    CalcReplace(c, 2, &r);
 }
 
 /**
  * Sprawdza, czy dwa wielomiany na wierzchu stosu
  * są równe – wypisuje na standardowe wyjście 0 lub 1.
- * W przypadku wykrycia błędu, ustawia `*err = true`.
- * @param[in] s : wskaźnik na stos kalkulatora
- * @param[out] err : wskaźnik na informację o błędzie
+ * Stos się nie zmienia.
+ * @param[in,out] c : wskaźnik na stan kalkulatora
  */
-static void CommandIsEqExec(Stack s, bool *err) {
-    if (StackPolyCount(s) >= 2) {
-        Poly p = StackPop(s, err);
-        Poly q = StackTop(s, err);
-        printf("%d\n", PolyIsEq(&p, &q));
-        StackPush(s, &p);
-    } else {
-        *err = true;
-    }
+static void CommandIsEqExec(Calc *c) {
+    const Poly *p = CalcPeek(c, 0);
+    const Poly *q = CalcPeek(c, 1);
+    WriterLong(&c->out, PolyIsEq(p, q));
+    WriterEndLine(&c->out);
 }
 
 /**
  * Wypisuje na standardowe wyjście stopień wielomianu
  * (−1 dla wielomianu tożsamościowo równego zeru).
- * W przypadku wykrycia błędu, ustawia `*err = true`.
- * @param[in] s : wskaźnik na stos kalkulatora
+ * @param[in,out] c : wskaźnik na stan kalkulatora
  * @param[out] err : wskaźnik na informację o błędzie
  */
-static void CommandDegExec(Stack s, bool *err) {
-    if (StackPolyCount(s) >= 1) {
-        Poly p = StackTop(s, err);
-        printf("%d\n", PolyDeg(&p));
-    } else {
-        *err = true;
-    }
+static void CommandDegExec(Calc *c, bool *err) {
+    Poly p = CalcTop(c, err);
+    WriterLong(&c->out, PolyDeg(&p));
+    WriterEndLine(&c->out);
 }
 
 /**
  * Wypisuje na standardowe wyjście stopień wielomianu
  * ze względu na zadaną zmienną
  * (−1 dla wielomianu tożsamościowo równego zeru).
- * W przypadku wykrycia błędu, ustawia `*err = true`.
- * @param[in] s : wskaźnik na stos kalkulatora
+ * @param[in,out] c : wskaźnik na stan kalkulatora
  * @param[in] var_idx : indeks zmiennej
  * @param[out] err : wskaźnik na informację o błędzie
  */
-static void CommandDegByExec(Stack s, size_t var_idx, bool *err) {
-    if (StackPolyCount(s) >= 1) {
-        Poly p = StackTop(s, err);
-        printf("%d\n", PolyDegBy(&p, var_idx));
+static void CommandDegByExec(Calc *c, size_t var_idx, bool *err) {
+    Poly p = CalcTop(c, err);
+    WriterLong(&c->out, PolyDegBy(&p, var_idx));
+    WriterEndLine(&c->out);
+}
+
+/**
+ * Wypisuje liczbę bez znaku, która może nie mieścić się w typie long.
+ * @param[in,out] w : zapis
+ * @param[in] x : liczba
+ */
+static void CalcWriteUnsigned(Writer *w, unsigned long x) {
+    if (x > LONG_MAX) {
+        WriterLong(w, (long) (x / 10));
+        WriterChar(w, (char) ('0' + x % 10));
     } else {
-        *err = true;
+        WriterLong(w, (long) x);
     }
 }
 
+/**
+ * Wypisuje liczbę jako wartość pola wiersza statystyk.
+ * @param[in,out] w : zapis
+ * @param[in] key : nazwa pola
+ * @param[in] val : wartość
+ */
+static void CalcWriteStat(Writer *w, const char *key, long val) {
+    WriterChar(w, ' ');
+    WriterWrite(w, key, strlen(key));
+    WriterChar(w, '=');
+    WriterLong(w, val);
+}
+
+/**
+ * Wypisuje ułamek @p num / @p den nie większy niż 1 jako wartość pola
+ * wiersza statystyk, zaokrąglony w dół do trzech cyfr po przecinku.
+ * @param[in,out] w : zapis
+ * @param[in] key : nazwa pola
+ * @param[in] num : licznik
+ * @param[in] den : mianownik, dodatni
+ */
+static void CalcWriteRatio(Writer *w, const char *key, size_t num, size_t den) {
+    unsigned frac = (unsigned) (num * 1000 / den);
+    WriterChar(w, ' ');
+    WriterWrite(w, key, strlen(key));
+    WriterChar(w, '=');
+    WriterChar(w, (char) ('0' + frac / 1000));
+    WriterChar(w, '.');
+    WriterChar(w, (char) ('0' + frac / 100 % 10));
+    WriterChar(w, (char) ('0' + frac / 10 % 10));
+    WriterChar(w, (char) ('0' + frac % 10));
+}
+
+/**
+ * Wypisuje kształt wielomianu z wierzchołka stosu: wiersz SHAPE z głębokością,
+ * liczbą wielomianów, liczbą jednomianów po rozwinięciu, największą wartością
+ * bezwzględną współczynnika i rozmiarem pamięci, a po nim wiersz LEVEL dla
+ * każdego poziomu zagnieżdżenia ze stopniem ze względu na jego zmienną,
+ * liczbą wielomianów i jednomianów oraz gęstością, czyli stosunkiem liczby
+ * jednomianów do liczby możliwych wykładników.
+ * @param[in,out] c : wskaźnik na stan kalkulatora
+ * @param[out] err : wskaźnik na informację o błędzie
+ */
+static void CommandShapeExec(Calc *c, bool *err) {
+    Poly p = CalcTop(c, err);
+    PolyStats s = PolyGetStats(&p);
+    Writer *w = &c->out;
+    WriterWrite(w, "SHAPE", strlen("SHAPE"));
+    CalcWriteStat(w, "depth", (long) s.depth);
+    CalcWriteStat(w, "nodes", (long) s.nodes);
+    CalcWriteStat(w, "terms", (long) s.terms);
+    WriterWrite(w, " max_coeff=", strlen(" max_coeff="));
+    CalcWriteUnsigned(w, s.max_coeff);
+    CalcWriteStat(w, "bytes", (long) s.bytes);
+    WriterEndLine(w);
+    for (size_t i = 0; i < s.depth; ++i) {
+        const PolyLevelStats *l = &s.levels[i];
+        WriterWrite(w, "LEVEL ", strlen("LEVEL "));
+        WriterLong(w, (long) i);
+        CalcWriteStat(w, "deg", l->deg);
+        CalcWriteStat(w, "nodes", (long) l->nodes);
+        CalcWriteStat(w, "monos", (long) l->monos);
+        CalcWriteRatio(w, "density", l->monos, l->slots);
+        WriterEndLine(w);
+    }
+    PolyStatsDestroy(&s);
+}
+
 /**
  * Wylicza wartość wielomianu w zadanym punkcie,
  * usuwa wielomian z wierzchołka i wstawia na stos wynik operacji.
- * W przypadku wykrycia błędu, ustawia `*err = true`.
- * @param[in,out] s : wskaźnik na stos kalkulatora
+ * @param[in,out] c : wskaźnik na stan kalkulatora
  * @param[in] x : punkt
- * @param[out] err : wskaźnik na informację o błędzie
  */
-static void CommandAtExec(Stack s, poly_coeff_t x, bool *err) {
-    if (StackPolyCount(s) >= 1) {
-        Poly p = StackPop(s, err);
-        Poly r = PolyAt(&p, x);
-        StackPush(s, &r);
-        PolyDestroy(&p);
-    } else {
-        *err = true;
-    }
+static void CommandAtExec(Calc *c, poly_coeff_t x) {
+    Poly r = PolyAt(CalcPeek(c, 0), x);
+    CalcReplace(c, 1, &r);
 }
 
 /**
  * Wypisuje na standardowe wyjście wielomian z wierzchołka stosu,
- * W przypadku wykrycia błędu, ustawia `*err = true`.
- * @param[in] s : wskaźnik na stos kalkulatora
+ * @param[in,out] c : wskaźnik na stan kalkulatora
  * @param[out] err : wskaźnik na informację o błędzie
  */
-static void CommandPrintExec(Stack s, bool *err) {
-    if (StackPolyCount(s) >= 1) {
-        Poly p = StackTop(s, err);
-        PolyPrint(&p);
-    } else {
-        *err = true;
-    }
+static void CommandPrintExec(Calc *c, bool *err) {
+    Poly p = CalcTop(c, err);
+    PolyWrite(&p, &c->out);
+    WriterEndLine(&c->out);
 }
 
 /**
  * Usuwa wielomian z wierzchołka stosu.
- * W przypadku wykrycia błędu, ustawia `*err = true`.
- * @param[in,out] s : wskaźnik na stos kalkulatora
+ * @param[in,out] c : wskaźnik na stan kalkulatora
  * @param[out] err : wskaźnik na informację o błędzie
  */
-static void CommandPopExec(Stack s, bool *err) {
-    if (StackPolyCount(s) >= 1) {
-        Poly p = StackPop(s, err);
-        PolyDestroy(&p);
-    } else {
-        *err = true;
+static void CommandPopExec(Calc *c, bool *err) {
+    if (c->lazy) {
+        ExprStackPop(&c->exprs);
+        return;
     }
+    Poly p = CalcPop(c, err);
+    PolyDestroy(&p);
 }
 
 /**
 * Wykonuje składanie wielomianów
-* W przypadku wykrycia błędu, ustawia `*err = true`.
-* @param[in,out] s : wskaźnik na stos kalkulatora
+* @param[in,out] c : wskaźnik na stan kalkulatora
 * @param[in] k : liczba wielomianów ze stosu, z którymi ma być złożony wielomian z wierzchołka
-* @param[out] err : wskaźnik na informację o błędzie
 */
-static void CommandComposeExec(Stack s, size_t k, bool *err) {
-    if (StackPolyCount(s) > k) {
-        Poly p = StackPop(s, err);
-        Poly *q = malloc(k * sizeof(Poly));
-        CHECK_PTR(q);
-        for (size_t i = 0; i < k; ++i) {
-            q[k - 1 - i] = StackPop(s, err);
-        }
-        Poly r = PolyCompose(&p, k, q);
-        StackPush(s, &r);
-        PolyDestroy(&p);
-        for (size_t i = 0; i < k; ++i) {
-            PolyDestroy(&q[i]);
-        }
-        free(q);
+static void CommandComposeExec(Calc *c, size_t k) {
+    // Tablica zawiera płytkie kopie wielomianów, które pozostają na stosie.
+    Poly *q = PolyMalloc(k * sizeof(Poly));
+    CHECK_PTR(q);
+    for (size_t i = k; i > 0; --i) {
+        q[k - i] = *CalcPeek(c, i);
+    }
+    Poly r = PolyCompose(CalcPeek(c, 0), k, q);
+    PolyFree(q);
+    CalcReplace(c, k + 1, &r);
+}
+
+/**
+ * Zapisuje wielomian z wierzchołka stosu do pliku w formacie binarnym.
+ * Stos się nie zmienia.
+ * @param[in,out] c : wskaźnik na stan kalkulatora
+ * @param[in] path : ścieżka do pliku
+ * @param[out] err : wskaźnik na informację o błędzie
+ * @return Czy udało się zapisać plik?
+ */
+static bool CommandSaveExec(Calc *c, const char *path, bool *err) {
+    Poly p = CalcTop(c, err);
+    return PolySave(&p, path);
+}
+
+/**
+ * Wstawia na stos wielomian odczytany z pliku w formacie binarnym.
+ * @param[in,out] c : wskaźnik na stan kalkulatora
+ * @param[in] path : ścieżka do pliku
+ * @return Czy udało się odczytać plik?
+ */
+static bool CommandLoadExec(Calc *c, const char *path) {
+    Poly p;
+    if (!PolyLoad(path, &p)) {
+        return false;
+    }
+    CalcPush(c, &p);
+    return true;
+}
+
+/**
+ * Zapisuje całą zawartość aktywnego stosu do pliku w formacie binarnym,
+ * z którego można ją odtworzyć opcją `--restore`. Stos się nie zmienia.
+ * @param[in,out] c : wskaźnik na stan kalkulatora
+ * @param[in] path : ścieżka do pliku
+ * @return Czy udało się zapisać plik?
+ */
+static bool CommandCheckpointExec(Calc *c, const char *path) {
+    if (!c->lazy) {
+        return StackSave(c->s, path);
+    }
+    size_t count = CalcCount(c);
+    const Poly **arr = PolyMalloc((count > 0 ? count : 1) * sizeof(Poly *));
+    CHECK_PTR(arr);
+    // Obliczona wartość wyrażenia pozostaje ważna, dopóki leży ono na stosie,
+    // więc wskaźniki z trybu leniwego można zebrać przed zapisem.
+    for (size_t i = 0; i < count; ++i) {
+        arr[i] = CalcPeek(c, count - 1 - i);
+    }
+    bool ok = PolyArraySave(arr, count, path);
+    PolyFree(arr);
+    return ok;
+}
+
+/**
+ * Odtwarza zawartość stosu zapisaną poleceniem CHECKPOINT, wstawiając
+ * wielomiany na aktywny stos. Jeśli włączono strażników, plik jest
+ * odczytywany pod strażnikiem – patrz alloc.h.
+ * @param[in,out] c : wskaźnik na stan kalkulatora
+ * @param[in] path : ścieżka do pliku
+ * @param[out] reason : wskaźnik na przyczynę przerwania odczytu
+ * @return Czy udało się odczytać plik?
+ */
+static bool CalcRestore(Calc *c, const char *path, AllocAbort *reason) {
+    Poly *arr;
+    size_t count;
+    AllocGuard g;
+    if (alloc_limit != 0) {
+        int jumped = setjmp(g.env);
+        if (jumped != 0) {
+            *reason = (AllocAbort) jumped;
+            return false;
+        }
+        AllocGuardBegin(&g);
+    }
+    bool ok = PolyArrayLoad(path, &arr, &count);
+    if (alloc_limit != 0) {
+        AllocGuardEnd(&g);
+    }
+    if (!ok) {
+        return false;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        CalcPush(c, &arr[i]);
+    }
+    PolyFree(arr);
+    return true;
+}
+
+/**
+ * Sprawdza probabilistycznie, czy dwa wielomiany na wierzchu stosu są równe,
+ * albo – dla @p count równego 1 – czy wielomian na wierzchołku jest równy
+ * zeru. Wypisuje na standardowe wyjście 0 lub 1 oraz ograniczenie
+ * prawdopodobieństwa błędu: 0 dla odpowiedzi pewnej lub @f$ 2^{-k} @f$.
+ * W trybie leniwym wyrażenia nie są obliczane. Stos się nie zmienia.
+ * @param[in,out] c : wskaźnik na stan kalkulatora
+ * @param[in] count : liczba porównywanych wielomianów (1 lub 2)
+ * @param[in] rounds : liczba rund porównania
+ * @return Czy liczba rund jest poprawna?
+ */
+static bool CommandProbEqExec(Calc *c, size_t count, size_t rounds) {
+    if (rounds == 0) {
+        return false;
+    }
+    bool eq;
+    unsigned long bits;
+    if (c->lazy) {
+        eq = ExprStackProbablyEq(&c->exprs, count, rounds, &c->seed, &bits);
+    } else if (count == 2) {
+        const Poly *q = CalcPeek(c, 1);
+        const Poly *p = CalcPeek(c, 0);
+        eq = PolyProbablyEq(p, q, rounds, &c->seed, &bits);
+    } else {
+        Poly zero = PolyZero();
+        eq = PolyProbablyEq(CalcPeek(c, 0), &zero, rounds, &c->seed, &bits);
+    }
+    WriterLong(&c->out, eq);
+    WriterChar(&c->out, ' ');
+    if (bits == PROB_EXACT) {
+        WriterLong(&c->out, 0);
     } else {
-        *err = true;
+        WriterWrite(&c->out, "2^-", 3);
+        WriterLong(&c->out, (long) bits);
     }
+    WriterEndLine(&c->out);
+    return true;
 }
 
 /**
- * Parsuje wiersz na polecenie kalkulatora i je wykonuje.
- * W przypadku niepowodzenia, odpowiednia informacja
- * jest wypisywana na standardowe wyjście błędu.
- * @param[in,out] s : wskaźnik na stos kalkulatora
- * @param[in] str : napis
+ * Usuwa z pamięci wartość rejestru i opróżnia go.
+ * @param[in,out] c : wskaźnik na stan kalkulatora
+ * @param[in,out] r : rejestr
+ */
+static void RegisterClear(Calc *c, Register *r) {
+    if (r->full) {
+        if (c->lazy) {
+            ExprStackRelease(&c->exprs, r->e);
+        } else {
+            PolyDestroy(&r->p);
+        }
+        r->full = false;
+    }
+}
+
+/**
+ * Zdejmuje wielomian z wierzchołka stosu i przenosi go do rejestru,
+ * zastępując poprzednią wartość rejestru. Wielomian nie jest kopiowany.
+ * @param[in,out] c : wskaźnik na stan kalkulatora
+ * @param[in] reg : indeks rejestru
+ * @param[out] err : wskaźnik na informację o błędzie
+ */
+static void CommandStoreExec(Calc *c, size_t reg, bool *err) {
+    Register *r = &c->regs[reg];
+    RegisterClear(c, r);
+    if (c->lazy) {
+        r->e = ExprStackTakeRef(&c->exprs);
+    } else {
+        r->p = CalcPop(c, err);
+    }
+    r->full = true;
+}
+
+/**
+ * Wstawia na stos wartość rejestru. W trybie leniwym wstawia kolejne
+ * odwołanie do wyrażenia, a w trybie zwykłym – kopię wielomianu.
+ * @param[in,out] c : wskaźnik na stan kalkulatora
+ * @param[in] reg : indeks rejestru
+ * @return Czy rejestr przechowuje wartość?
+ */
+static bool CommandLoadRegExec(Calc *c, size_t reg) {
+    Register *r = &c->regs[reg];
+    if (!r->full) {
+        return false;
+    }
+    if (c->lazy) {
+        ExprStackPushRef(&c->exprs, r->e);
+    } else {
+        Poly p = PolyClone(&r->p);
+        CalcPush(c, &p);
+    }
+    return true;
+}
+
+/**
+ * Opróżnia rejestr.
+ * @param[in,out] c : wskaźnik na stan kalkulatora
+ * @param[in] reg : indeks rejestru
+ * @return Czy rejestr przechowywał wartość?
+ */
+static bool CommandDropExec(Calc *c, size_t reg) {
+    Register *r = &c->regs[reg];
+    if (!r->full) {
+        return false;
+    }
+    RegisterClear(c, r);
+    return true;
+}
+
+/**
+ * Uaktywnia stos o zadanym numerze. Stos, który nie był dotąd używany, jest pusty.
+ * @param[in,out] c : wskaźnik na stan kalkulatora
+ * @param[in] k : numer stosu
+ * @return Czy numer stosu jest poprawny?
+ */
+static bool CommandStackExec(Calc *c, size_t k) {
+    if (k >= MAX_STACKS) {
+        return false;
+    }
+    if (c->lazy) {
+        ExprStackSelect(&c->exprs, k);
+        return true;
+    }
+    if (k >= c->stacks_count) {
+        c->stacks = realloc(c->stacks, (k + 1) * sizeof(Stack));
+        CHECK_PTR(c->stacks);
+        for (size_t i = c->stacks_count; i <= k; ++i) {
+            c->stacks[i] = NULL;
+        }
+        c->stacks_count = k + 1;
+    }
+    c->stacks[c->stack_idx] = c->s;
+    if (c->stacks[k] == NULL) {
+        StackInit(&c->stacks[k]);
+        if (c->spill_keep > 0) {
+            StackSetSpill(c->stacks[k], c->spill_keep);
+        }
+    }
+    c->s = c->stacks[k];
+    c->stack_idx = k;
+    return true;
+}
+
+/** Ustawia nazwę polecenia i jej długość w opisie polecenia. */
+#define COMMAND_NAME(s) .name = (s), .name_len = sizeof(s) - 1
+
+/** Opisy wszystkich poleceń kalkulatora. */
+static const Command commands[CMD_COUNT] = {
+    [CMD_ZERO] = {COMMAND_NAME("ZERO"), .arity = 0, .builds = true},
+    [CMD_IS_COEFF] = {COMMAND_NAME("IS_COEFF"), .arity = 1},
+    [CMD_IS_ZERO] = {COMMAND_NAME("IS_ZERO"), .arity = 1},
+    [CMD_CLONE] = {COMMAND_NAME("CLONE"), .arity = 1, .builds = true},
+    [CMD_ADD] = {COMMAND_NAME("ADD"), .arity = 2, .builds = true},
+    [CMD_MUL] = {COMMAND_NAME("MUL"), .arity = 2, .builds = true},
+    [CMD_NEG] = {COMMAND_NAME("NEG"), .arity = 1, .builds = true},
+    [CMD_SUB] = {COMMAND_NAME("SUB"), .arity = 2, .builds = true},
+    [CMD_IS_EQ] = {COMMAND_NAME("IS_EQ"), .arity = 2},
+    [CMD_DEG] = {COMMAND_NAME("DEG"), .arity = 1},
+    [CMD_PRINT] = {COMMAND_NAME("PRINT"), .arity = 1},
+    [CMD_POP] = {COMMAND_NAME("POP"), .arity = 1},
+    [CMD_DEG_BY] = {COMMAND_NAME("DEG_BY"), .arity = 1, .arg = ARG_UNSIGNED,
+                    .arg_error = "DEG BY WRONG VARIABLE"},
+    [CMD_SHAPE] = {COMMAND_NAME("SHAPE"), .arity = 1},
+    [CMD_AT] = {COMMAND_NAME("AT"), .arity = 1, .arg = ARG_SIGNED, .arg_error = "AT WRONG VALUE",
+                .builds = true},
+    [CMD_COMPOSE] = {COMMAND_NAME("COMPOSE"), .arity = 1, .arg_arity = true, .arg = ARG_UNSIGNED,
+                     .arg_error = "COMPOSE WRONG PARAMETER", .builds = true},
+    [CMD_SAVE] = {COMMAND_NAME("SAVE"), .arity = 1, .arg = ARG_PATH, .arg_error = "SAVE WRONG FILE"},
+    [CMD_LOAD] = {COMMAND_NAME("LOAD"), .arity = 0, .arg = ARG_PATH, .arg_error = "LOAD WRONG FILE",
+                  .builds = true},
+    [CMD_CHECKPOINT] = {COMMAND_NAME("CHECKPOINT"), .arity = 0, .arg = ARG_PATH,
+                        .arg_error = "CHECKPOINT WRONG FILE"},
+    [CMD_PROB_EQ] = {COMMAND_NAME("PROB_EQ"), .arity = 2, .arg = ARG_UNSIGNED,
+                     .arg_error = "PROB EQ WRONG ROUNDS"},
+    [CMD_PROB_ZERO] = {COMMAND_NAME("PROB_ZERO"), .arity = 1, .arg = ARG_UNSIGNED,
+                       .arg_error = "PROB ZERO WRONG ROUNDS"},
+    [CMD_STORE] = {COMMAND_NAME("STORE"), .arity = 1, .arg = ARG_REGISTER, .arg_error = "STORE WRONG REGISTER"},
+    [CMD_LOAD_REG] = {COMMAND_NAME("LOAD_REG"), .arity = 0, .arg = ARG_REGISTER,
+                      .arg_error = "LOAD REG WRONG REGISTER", .builds = true},
+    [CMD_DROP] = {COMMAND_NAME("DROP"), .arity = 0, .arg = ARG_REGISTER, .arg_error = "DROP WRONG REGISTER"},
+    [CMD_STACK] = {COMMAND_NAME("STACK"), .arity = 0, .arg = ARG_UNSIGNED, .arg_error = "STACK WRONG NUMBER"},
+    [CMD_STATS] = {COMMAND_NAME("STATS"), .arity = 0},
+    [CMD_STATS_RESET] = {COMMAND_NAME("STATS_RESET"), .arity = 0},
+    [CMD_DEF] = {COMMAND_NAME("DEF"), .arg = ARG_NAME, .arg_error = "DEF WRONG NAME"},
+    [CMD_REPEAT] = {COMMAND_NAME("REPEAT"), .arg = ARG_UNSIGNED, .arg_error = "REPEAT WRONG COUNT"},
+    [CMD_END] = {COMMAND_NAME("END")},
+};
+
+/**
+ * Tablica haszująca nazwy poleceń: indeks polecenia w tablicy `commands`
+ * powiększony o 1 lub 0 dla pustego miejsca.
+ */
+static unsigned char command_slots[COMMAND_HASH_SIZE];
+
+/** Ziarno funkcji haszującej, dla którego jest ona różnowartościowa na nazwach poleceń. */
+static uint32_t command_seed;
+
+/** Mnożnik funkcji haszującej FNV-1a. */
+#define FNV_PRIME 16777619u
+
+/** Mnożnik mieszający bity wartości funkcji haszującej. */
+#define HASH_MIX 2654435769u
+
+/**
+ * Sprawdza, czy znak jest białym znakiem, tak jak `isspace` w locale "C".
+ * @param[in] c : znak
+ * @return Czy @p c jest białym znakiem?
+ */
+static inline bool CharIsSpace(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+/**
+ * Haszuje nazwę polecenia: jej długość oraz pierwszy, środkowy i ostatni
+ * znak, więc koszt nie zależy od długości nazwy. Nazwy poleceń muszą się
+ * różnić długością lub którymś z tych znaków.
+ * @param[in] name : nazwa polecenia
+ * @param[in] len : długość nazwy
+ * @param[in] seed : ziarno funkcji haszującej
+ * @return indeks w tablicy haszującej
+ */
+static inline size_t CommandHash(const char *name, size_t len, uint32_t seed) {
+    if (len == 0) {
+        return 0;
+    }
+    uint32_t h = seed ^ (uint32_t) len;
+    h = (h ^ (unsigned char) name[0]) * FNV_PRIME;
+    h = (h ^ (unsigned char) name[len / 2]) * FNV_PRIME;
+    h = (h ^ (unsigned char) name[len - 1]) * FNV_PRIME;
+    // Bez tego mieszania starsze bity zależą od ziarna zbyt słabo
+    // i dla niektórych zbiorów nazw żadne ziarno nie jest dobre.
+    h ^= h >> 16;
+    return (h * HASH_MIX) >> (32 - COMMAND_HASH_BITS);
+}
+
+/**
+ * Wyszukuje ziarno, dla którego funkcja haszująca jest doskonała
+ * na zbiorze nazw poleceń, i wypełnia tablicę haszującą.
+ * Musi zostać wywołana przed pierwszym wykonaniem polecenia.
+ */
+static void CommandTableInit(void) {
+    bool ok = false;
+    for (command_seed = 0; !ok; ++command_seed) {
+        memset(command_slots, 0, sizeof(command_slots));
+        ok = true;
+        for (size_t i = 0; ok && i < CMD_COUNT; ++i) {
+            size_t h = CommandHash(commands[i].name, commands[i].name_len, command_seed);
+            ok = command_slots[h] == 0;
+            command_slots[h] = (unsigned char) (i + 1);
+        }
+    }
+    --command_seed;
+}
+
+/**
+ * Wyszukuje polecenie o podanej nazwie.
+ * @param[in] name : nazwa polecenia
+ * @param[in] len : długość nazwy
+ * @return opis polecenia lub NULL, jeśli nie ma polecenia o tej nazwie
+ */
+static inline const Command *CommandLookup(const char *name, size_t len) {
+    unsigned char slot = command_slots[CommandHash(name, len, command_seed)];
+    if (slot == 0) {
+        return NULL;
+    }
+    const Command *cmd = &commands[slot - 1];
+    return cmd->name_len == len && memcmp(cmd->name, name, len) == 0 ? cmd : NULL;
+}
+
+/**
+ * Wyszukuje polecenie, którego nazwa jest początkiem wiersza
+ * aż do pierwszego białego znaku. Najpierw sprawdzamy cały wiersz,
+ * bo większość poleceń nie ma parametru – wtedy nie trzeba szukać
+ * końca nazwy.
+ * @param[in] str : wiersz
+ * @param[in] end : koniec wiersza
+ * @param[out] name_end : koniec nazwy polecenia
+ * @return opis polecenia lub NULL, jeśli nie ma polecenia o tej nazwie
+ */
+static const Command *CommandFind(const char *str, const char *end, const char **name_end) {
+    const Command *cmd = CommandLookup(str, (size_t) (end - str));
+    if (cmd != NULL) {
+        *name_end = end;
+        return cmd;
+    }
+    const char *p = str;
+    while (p < end && !CharIsSpace(*p)) {
+        ++p;
+    }
+    *name_end = p;
+    return p == end ? NULL : CommandLookup(str, (size_t) (p - str));
+}
+
+/**
+ * Parsuje nieujemny parametr polecenia, tak jak robi to `strtoul`.
+ * Parametr musi zaczynać się cyfrą, chyba że jest zerem poprzedzonym
+ * znakiem '-', i musi kończyć się razem z wierszem.
+ * @param[in] val : początek parametru
+ * @param[in] end : koniec wiersza
+ * @param[out] res : sparsowany parametr
+ * @return Czy parametr jest poprawny?
+ */
+static bool CommandArgUnsigned(const char *val, const char *end, size_t *res) {
+    bool neg = val < end && *val == '-';
+    const char *digits = val + neg;
+    unsigned long x;
+    bool overflow = false;
+    const char *endptr = NumberParseULong(digits, end, &x, &overflow);
+    *res = x;
+    return endptr != digits && endptr == end && !overflow && (!neg || x == 0);
+}
+
+/**
+ * Parsuje parametr polecenia będący liczbą całkowitą, tak jak robi to `strtol`.
+ * Parametr musi zaczynać się cyfrą lub znakiem '-'
+ * i musi kończyć się razem z wierszem.
+ * @param[in] val : początek parametru
+ * @param[in] end : koniec wiersza
+ * @param[out] res : sparsowany parametr
+ * @return Czy parametr jest poprawny?
+ */
+static bool CommandArgSigned(const char *val, const char *end, poly_coeff_t *res) {
+    bool overflow = false;
+    const char *endptr = NumberParseLong(val, end, res, &overflow);
+    return endptr != val && endptr == end && !overflow;
+}
+
+/**
+ * Parsuje parametr polecenia będący ścieżką do pliku.
+ * Ścieżka jest niepustą resztą wiersza bez znaków '\0'.
+ * @param[in] val : początek parametru
+ * @param[in] end : koniec wiersza
+ * @param[out] res : ścieżka zakończona znakiem '\0', do zwolnienia przez `free`
+ * @return Czy parametr jest poprawny?
+ */
+static bool CommandArgPath(const char *val, const char *end, char **res) {
+    size_t len = (size_t) (end - val);
+    if (len == 0 || memchr(val, '\0', len) != NULL) {
+        return false;
+    }
+    *res = strndup(val, len);
+    CHECK_PTR(*res);
+    return true;
+}
+
+/**
+ * Parsuje parametr polecenia będący nazwą makra. Nazwa zaczyna się
+ * literą, po której następują litery, cyfry lub znaki '_'.
+ * @param[in] val : początek parametru
+ * @param[in] end : koniec wiersza
+ * @param[out] res : nazwa zakończona znakiem '\0', do zwolnienia przez `free`
+ * @return Czy parametr jest poprawny?
+ */
+static bool CommandArgName(const char *val, const char *end, char **res) {
+    if (val == end || !isalpha((unsigned char) *val)) {
+        return false;
+    }
+    for (const char *p = val; p < end; ++p) {
+        if (!isalnum((unsigned char) *p) && *p != '_') {
+            return false;
+        }
+    }
+    return CommandArgPath(val, end, res);
+}
+
+/**
+ * Wypisuje liczniki kalkulatora: wiersz dla każdego wykonanego polecenia
+ * z liczbą wykonań, łącznym i najdłuższym czasem, liczbą bajtów przydzielonych
+ * i zwolnionych przez wielomiany oraz liczbą utworzonych jednomianów,
+ * a na koniec wiersz MEMORY z licznikami alokacji – patrz alloc.h.
+ * @param[in] c : wskaźnik na stan kalkulatora
+ * @param[in,out] w : zapis
+ */
+static void CalcWriteStats(const Calc *c, Writer *w) {
+    for (size_t i = 0; i < CMD_COUNT; ++i) {
+        const CommandStats *st = &c->stats[i];
+        if (st->calls > 0) {
+            WriterWrite(w, commands[i].name, commands[i].name_len);
+            CalcWriteStat(w, "calls", (long) st->calls);
+            CalcWriteStat(w, "timed_calls", (long) st->timed);
+            CalcWriteStat(w, "time_ns", (long) st->ns);
+            CalcWriteStat(w, "max_ns", (long) st->max_ns);
+            CalcWriteStat(w, "alloc_bytes", (long) st->alloc_bytes);
+            CalcWriteStat(w, "free_bytes", (long) st->free_bytes);
+            CalcWriteStat(w, "terms", (long) st->terms);
+            WriterEndLine(w);
+        }
+    }
+    WriterWrite(w, "MEMORY", strlen("MEMORY"));
+    CalcWriteStat(w, "allocs", (long) alloc_stats.allocs);
+    CalcWriteStat(w, "alloc_bytes", (long) alloc_stats.alloc_bytes);
+    CalcWriteStat(w, "free_bytes", (long) alloc_stats.free_bytes);
+    CalcWriteStat(w, "live_bytes", (long) alloc_stats.live_bytes);
+    CalcWriteStat(w, "peak_bytes", (long) alloc_stats.peak_bytes);
+    CalcWriteStat(w, "terms", (long) alloc_stats.terms);
+    WriterEndLine(w);
+}
+
+/**
+ * Zeruje liczniki kalkulatora.
+ * @param[in,out] c : wskaźnik na stan kalkulatora
+ */
+static void CommandStatsResetExec(Calc *c) {
+    memset(c->stats, 0, CMD_COUNT * sizeof(CommandStats));
+    AllocStatsReset();
+}
+
+/**
+ * Parsuje parametr polecenia zgodnie z jego rodzajem.
+ * @param[in] type : rodzaj parametru
+ * @param[in] val : początek parametru
+ * @param[in] end : koniec wiersza
+ * @param[out] arg : sparsowany parametr
+ * @param[out] str : napis zaalokowany dla parametru będącego ścieżką lub nazwą
+ * @return Czy parametr jest poprawny?
+ */
+static bool CommandArgParse(CommandArgType type, const char *val, const char *end, CodeArg *arg, char **str) {
+    switch (type) {
+        case ARG_UNSIGNED:
+            return CommandArgUnsigned(val, end, &arg->idx);
+        case ARG_SIGNED:
+            return CommandArgSigned(val, end, &arg->value);
+        case ARG_PATH:
+            return CommandArgPath(val, end, str);
+        case ARG_NAME:
+        case ARG_REGISTER:
+            return CommandArgName(val, end, str);
+        default:
+            return true;
+    }
+}
+
+/**
+ * Wykonuje polecenie, dla którego na stosie jest wystarczająco wiele wielomianów.
+ * Wywołania funkcji wykonujących polecenia są bezpośrednie, dzięki czemu
+ * kompilator może je rozwinąć w miejscu wywołania.
+ * @param[in,out] c : wskaźnik na stan kalkulatora
+ * @param[in] id : identyfikator polecenia
+ * @param[in] arg : sparsowany parametr polecenia
+ * @param[in] str : parametr polecenia będący ścieżką do pliku
+ * @param[out] err : wskaźnik na informację o błędzie
+ * @return Czy parametr polecenia był poprawny?
+ */
+static inline bool CommandRun(Calc *c, CommandId id, const CodeArg *arg, const char *str, bool *err) {
+    switch (id) {
+        case CMD_ZERO:
+            CommandZeroExec(c);
+            break;
+        case CMD_IS_COEFF:
+            CommandIsCoeffExec(c, err);
+            break;
+        case CMD_IS_ZERO:
+            CommandIsZeroExec(c, err);
+            break;
+        case CMD_CLONE:
+            CommandCloneExec(c, err);
+            break;
+        case CMD_ADD:
+            CommandAddExec(c);
+            break;
+        case CMD_MUL:
+            CommandMulExec(c);
+            break;
+        case CMD_NEG:
+            CommandNegExec(c);
+            break;
+        case CMD_SUB:
+            CommandSubExec(c);
+            break;
+        case CMD_IS_EQ:
+            CommandIsEqExec(c);
+            break;
+        case CMD_DEG:
+            CommandDegExec(c, err);
+            break;
+        case CMD_PRINT:
+            CommandPrintExec(c, err);
+            break;
+        case CMD_POP:
+            CommandPopExec(c, err);
+            break;
+        case CMD_DEG_BY:
+            CommandDegByExec(c, arg->idx, err);
+            break;
+        case CMD_SHAPE:
+            CommandShapeExec(c, err);
+            break;
+        case CMD_AT:
+            CommandAtExec(c, arg->value);
+            break;
+        case CMD_COMPOSE:
+            CommandComposeExec(c, arg->idx);
+            break;
+        case CMD_SAVE:
+            return CommandSaveExec(c, str, err);
+        case CMD_LOAD:
+            return CommandLoadExec(c, str);
+        case CMD_CHECKPOINT:
+            return CommandCheckpointExec(c, str);
+        case CMD_PROB_EQ:
+            return CommandProbEqExec(c, 2, arg->idx);
+        case CMD_PROB_ZERO:
+            return CommandProbEqExec(c, 1, arg->idx);
+        case CMD_STORE:
+            CommandStoreExec(c, arg->idx, err);
+            break;
+        case CMD_LOAD_REG:
+            return CommandLoadRegExec(c, arg->idx);
+        case CMD_DROP:
+            return CommandDropExec(c, arg->idx);
+        case CMD_STACK:
+            return CommandStackExec(c, arg->idx);
+        case CMD_STATS:
+            CalcWriteStats(c, &c->out);
+            c->timed = true;
+            break;
+        case CMD_STATS_RESET:
+            CommandStatsResetExec(c);
+            c->timed = true;
+            break;
+        default:
+            assert(false);
+    }
+    return true;
+}
+
+/**
+ * Wypisuje komunikat o błędzie w wierszu @p line. W trybie serwera
+ * komunikat trafia do wyjścia wyników, by klient otrzymał wyniki
+ * i błędy w kolejności wierszy.
+ * @param[in,out] c : wskaźnik na stan kalkulatora
  * @param[in] line : numer wiersza
- * @param[in] len : długość wiersza
+ * @param[in] msg : komunikat
  */
-static void CommandExec(Stack s, char *str, size_t line, ssize_t len) {
-    assert(str != NULL && isalpha(*str) && str[len - 1] == '\n');
-    errno = 0;
-    char *name = str;
-    char *val = NULL;
-    char *endptr = str;
+static void CalcReportError(Calc *c, size_t line, const char *msg) {
+    if (c->errors_to_out) {
+        WriterWrite(&c->out, "ERROR ", strlen("ERROR "));
+        WriterLong(&c->out, (long) line);
+        WriterChar(&c->out, ' ');
+        WriterWrite(&c->out, msg, strlen(msg));
+        WriterEndLine(&c->out);
+    } else {
+        fprintf(stderr, "ERROR %zu %s\n", line, msg);
+    }
+}
+
+/**
+ * Zwraca bieżący czas monotoniczny.
+ * @return czas w nanosekundach
+ */
+static uint64_t CalcNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+/**
+ * Zwraca komunikat o błędzie dla przyczyny przerwania operacji.
+ * @param[in] reason : przyczyna przerwania
+ * @return komunikat lub NULL, jeśli operacja nie została przerwana
+ */
+static const char *CalcAbortMessage(AllocAbort reason) {
+    switch (reason) {
+        case ALLOC_ABORT_MEMORY:
+            return "OUT OF MEMORY";
+        case ALLOC_ABORT_TIMEOUT:
+            return "TIMEOUT";
+        case ALLOC_ABORT_TERMS:
+            return "TOO MANY TERMS";
+        case ALLOC_ABORT_CANCEL:
+            return "CANCELLED";
+        default:
+            return NULL;
+    }
+}
+
+/**
+ * Wykonuje polecenie tworzące wielomian pod strażnikiem – patrz alloc.h.
+ * Jeśli zabrakło pamięci, przekroczono limit czasu lub liczby jednomianów
+ * albo polecenie anulowano, jest ono przerywane, a stos pozostaje bez zmian.
+ * @param[in,out] c : wskaźnik na stan kalkulatora
+ * @param[in] id : identyfikator polecenia
+ * @param[in] arg : sparsowany parametr polecenia
+ * @param[in] str : parametr polecenia będący ścieżką do pliku
+ * @param[out] err : wskaźnik na informację o błędzie
+ * @param[out] reason : wskaźnik na przyczynę przerwania polecenia
+ * @return Czy parametr polecenia był poprawny?
+ */
+static bool CommandRunGuarded(Calc *c, CommandId id, const CodeArg *arg, const char *str, bool *err,
+                              AllocAbort *reason) {
+    AllocGuard g;
+    int jumped = setjmp(g.env);
+    if (jumped != 0) {
+        *reason = (AllocAbort) jumped;
+        return true;
+    }
+    AllocGuardBegin(&g);
+    bool ok = CommandRun(c, id, arg, str, err);
+    AllocGuardEnd(&g);
+    return ok;
+}
+
+/**
+ * Wykonuje polecenie kalkulatora. Jeśli na stosie jest za mało
+ * wielomianów, parametr okazał się niepoprawny lub polecenie przerwano,
+ * wypisuje odpowiedni komunikat o błędzie.
+ * @param[in,out] c : wskaźnik na stan kalkulatora
+ * @param[in] id : identyfikator polecenia
+ * @param[in] line : numer wiersza
+ * @param[in] arg : sparsowany parametr polecenia
+ * @param[in] str : parametr polecenia będący ścieżką do pliku
+ */
+static inline void CommandDispatch(Calc *c, CommandId id, size_t line, const CodeArg *arg, const char *str) {
+    const Command *cmd = &commands[id];
     bool err = false; // Jeśli na stosie jest za mało wielomianów, by wykonać polecenie, to `err = true`;
-    str[len - 1] = '\0';
-    if (memcmp(name, "ZERO", len) == 0) {
-        CommandZeroExec(s);
-    } else if (memcmp(name, "IS_COEFF", len) == 0) {
-        CommandIsCoeffExec(s, &err);
-    } else if (memcmp(name, "IS_ZERO", len) == 0) {
-        CommandIsZeroExec(s, &err);
-    } else if (memcmp(name, "CLONE", len) == 0) {
-        CommandCloneExec(s, &err);
-    } else if (memcmp(name, "ADD", len) == 0) {
-        CommandAddExec(s, &err);
-    } else if (memcmp(name, "MUL", len) == 0) {
-        CommandMulExec(s, &err);
-    } else if (memcmp(name, "NEG", len) == 0) {
-        CommandNegExec(s, &err);
-    } else if (memcmp(name, "SUB", len) == 0) {
-        CommandSubExec(s, &err);
-    } else if (memcmp(name, "IS_EQ", len) == 0) {
-        CommandIsEqExec(s, &err);
-    } else if (memcmp(name, "DEG", len) == 0) {
-        CommandDegExec(s, &err);
-    } else if (memcmp(name, "PRINT", len) == 0) {
-        CommandPrintExec(s, &err);
-    } else if (memcmp(name, "POP", len) == 0) {
-        CommandPopExec(s, &err);
-    } else if (memcmp(name, "DEG_BY", DEG_BY_LENGTH) == 0) {
-        size_t var_idx;
-        val = str + DEG_BY_LENGTH + 1;
-        var_idx = strtoul(val, &endptr, DECIMAL_BASE);
-        if (isspace(str[DEG_BY_LENGTH]) || DEG_BY_LENGTH + 1 == len) {
-            if (str[DEG_BY_LENGTH] == ' ' && (isdigit(*val) || (*val == '-' && var_idx == 0)) && errno == 0 &&
-                endptr == str + len - 1) {
-                CommandDegByExec(s, var_idx, &err);
-            } else {
-                fprintf(stderr, "ERROR %zu DEG BY WRONG VARIABLE\n", line);
+    AllocAbort reason = ALLOC_ABORT_NONE;
+    size_t count = CalcCount(c);
+    if (count < cmd->arity || (cmd->arg_arity && count - cmd->arity < arg->idx)) {
+        err = true;
+    } else if (!(cmd->builds && alloc_limit != 0 ? CommandRunGuarded(c, id, arg, str, &err, &reason)
+                                                  : CommandRun(c, id, arg, str, &err))) {
+        CalcReportError(c, line, cmd->arg_error);
+    }
+    if (err) {
+        CalcReportError(c, line, "STACK UNDERFLOW");
+    }
+    if (reason != ALLOC_ABORT_NONE) {
+        CalcReportError(c, line, CalcAbortMessage(reason));
+    }
+}
+
+/**
+ * Wykonuje polecenie kalkulatora – patrz CommandDispatch(). Dolicza do liczników
+ * polecenia jego wykonanie oraz przydzieloną i zwolnioną w tym czasie pamięć.
+ * Odczyt zegara kosztuje więcej niż wiele poleceń, więc czas wykonania mierzony
+ * jest tylko wtedy, gdy ktoś go odczytuje – patrz pole `timed` w #Calc.
+ * Jeśli włączono zapis czasów, dopisuje do niego wiersz z nazwą polecenia
+ * i czasem jego wykonania w nanosekundach.
+ * @param[in,out] c : wskaźnik na stan kalkulatora
+ * @param[in] id : identyfikator polecenia
+ * @param[in] line : numer wiersza
+ * @param[in] arg : sparsowany parametr polecenia
+ * @param[in] str : parametr polecenia będący ścieżką do pliku
+ */
+static inline void CommandExec(Calc *c, CommandId id, size_t line, const CodeArg *arg, const char *str) {
+    const Command *cmd = &commands[id];
+    CommandStats *st = &c->stats[id];
+    uint64_t alloc_bytes = alloc_stats.alloc_bytes;
+    uint64_t free_bytes = alloc_stats.free_bytes;
+    uint64_t terms = alloc_stats.terms;
+    bool timed = c->timed;
+    uint64_t start = timed ? CalcNow() : 0;
+    CommandDispatch(c, id, line, arg, str);
+    // Po wyzerowaniu liczników ich wcześniejsze wartości są nieaktualne.
+    if (id != CMD_STATS_RESET) {
+        ++st->calls;
+        st->alloc_bytes += alloc_stats.alloc_bytes - alloc_bytes;
+        st->free_bytes += alloc_stats.free_bytes - free_bytes;
+        st->terms += alloc_stats.terms - terms;
+    }
+    if (timed) {
+        uint64_t ns = CalcNow() - start;
+        if (id != CMD_STATS_RESET) {
+            ++st->timed;
+            st->ns += ns;
+            st->max_ns = ns > st->max_ns ? ns : st->max_ns;
+        }
+        if (c->latency != NULL) {
+            WriterWrite(c->latency, cmd->name, cmd->name_len);
+            WriterChar(c->latency, ' ');
+            WriterLong(c->latency, (long) ns);
+            WriterEndLine(c->latency);
+        }
+    }
+}
+
+/**
+ * Wstawia na stos kopię wielomianu. Jeśli włączono strażników,
+ * kopiowanie odbywa się pod strażnikiem – patrz alloc.h.
+ * @param[in,out] c : wskaźnik na stan kalkulatora
+ * @param[in] p : wielomian
+ * @return przyczyna przerwania kopiowania
+ */
+static AllocAbort CalcPushClone(Calc *c, const Poly *p) {
+    AllocGuard g;
+    if (alloc_limit != 0) {
+        int jumped = setjmp(g.env);
+        if (jumped != 0) {
+            return (AllocAbort) jumped;
+        }
+        AllocGuardBegin(&g);
+    }
+    Poly q = PolyClone(p);
+    CalcPush(c, &q);
+    if (alloc_limit != 0) {
+        AllocGuardEnd(&g);
+    }
+    return ALLOC_ABORT_NONE;
+}
+
+/**
+ * Wykonuje kod. Makra wywoływane są bez rekurencji: powrót z makra
+ * zapamiętywany jest na stosie ramek, a liczniki pętli na stosie liczników.
+ * Stałe z instrukcji #OP_PUSH są przejmowane z puli kodu,
+ * dlatego kod z takimi instrukcjami można wykonać tylko raz.
+ * @param[in,out] c : wskaźnik na stan kalkulatora
+ * @param[in,out] code : kod
+ */
+static void CalcExec(Calc *c, Code *code) {
+    size_t pc = 0;
+    size_t frames_bottom = c->frames_count;
+    for (;;) {
+        if (pc == code->count) {
+            if (c->frames_count == frames_bottom) {
+                break;
             }
-        } else {
-            fprintf(stderr, "ERROR %zu WRONG COMMAND\n", line);
-        }
-    } else if (memcmp(name, "AT", AT_LENGTH) == 0) {
-        poly_coeff_t x;
-        val = str + AT_LENGTH + 1;
-        x = strtol(val, &endptr, DECIMAL_BASE);
-        if (isspace(str[AT_LENGTH]) || AT_LENGTH + 1 == len) {
-            if (str[AT_LENGTH] == ' ' && (isdigit(*val) || *val == '-') && errno == 0 && endptr == str + len - 1) {
-                CommandAtExec(s, x, &err);
-            } else {
-                fprintf(stderr, "ERROR %zu AT WRONG VALUE\n", line);
+            // Powrót z makra.
+            ExecFrame *f = &c->frames[--c->frames_count];
+            code = f->code;
+            pc = f->pc;
+            continue;
+        }
+        const Instr *instr = &code->arr[pc++];
+        switch (instr->op) {
+            case OP_PUSH: {
+                Poly *p = &code->consts[instr->arg.idx];
+                CalcPush(c, p);
+                *p = PolyZero();
+                break;
             }
-        } else {
-            fprintf(stderr, "ERROR %zu WRONG COMMAND\n", line);
-        }
-    } else if (memcmp(name, "COMPOSE", COMPOSE_LENGTH) == 0) {
-        val = str + COMPOSE_LENGTH + 1;
-        size_t k = strtoul(val, &endptr, DECIMAL_BASE);
-        if (isspace(str[COMPOSE_LENGTH]) || COMPOSE_LENGTH + 1 == len) {
-            if (str[COMPOSE_LENGTH] == ' ' && (isdigit(*val) || (*val == '-' && k == 0)) && errno == 0 &&
-                endptr == str + len - 1) {
-                CommandComposeExec(s, k, &err);
-            } else {
-                fprintf(stderr, "ERROR %zu COMPOSE WRONG PARAMETER\n", line);
+            case OP_PUSH_CLONE: {
+                AllocAbort reason = CalcPushClone(c, &code->consts[instr->arg.idx]);
+                if (reason != ALLOC_ABORT_NONE) {
+                    CalcReportError(c, instr->line, CalcAbortMessage(reason));
+                }
+                break;
             }
+            case OP_ERROR:
+                CalcReportError(c, instr->line, instr->arg.msg);
+                break;
+            case OP_REPEAT:
+                ArrayReserve((void **) &c->loops, &c->loops_size, c->loops_count, sizeof(size_t), INIT_SIZE);
+                c->loops[c->loops_count++] = instr->arg.idx;
+                break;
+            case OP_LOOP:
+                if (--c->loops[c->loops_count - 1] > 0) {
+                    pc = instr->arg.idx;
+                } else {
+                    --c->loops_count;
+                }
+                break;
+            case OP_CALL:
+                ArrayReserve((void **) &c->frames, &c->frames_size, c->frames_count, sizeof(ExecFrame), INIT_SIZE);
+                c->frames[c->frames_count++] = (ExecFrame) {.code = code, .pc = pc};
+                code = &c->macros[instr->arg.idx];
+                pc = 0;
+                break;
+            default: {
+                bool path = commands[instr->op].arg == ARG_PATH;
+                CommandExec(c, (CommandId) instr->op, instr->line, &instr->arg,
+                            path ? code->strs[instr->arg.idx] : NULL);
+            }
+        }
+    }
+}
+
+/**
+ * Daje kod, do którego kompilowane są wiersze wewnątrz bloku @p b.
+ * Wiersze spoza bloków nie są kompilowane, tylko od razu wykonywane.
+ * @param[in,out] c : wskaźnik na stan kalkulatora
+ * @param[in] b : blok lub NULL
+ * @return kod lub NULL, jeśli @p b jest NULL
+ */
+static Code *CalcBlockCode(Calc *c, const Block *b) {
+    if (b == NULL) {
+        return NULL;
+    }
+    return b->macro == NO_MACRO ? &c->top : &c->macros[b->macro];
+}
+
+/**
+ * Zgłasza błąd wykryty podczas kompilacji: dopisuje do kodu instrukcję
+ * wypisującą komunikat albo, poza blokami, od razu go wypisuje.
+ * @param[in,out] c : wskaźnik na stan kalkulatora
+ * @param[in,out] code : kod lub NULL
+ * @param[in] line : numer wiersza
+ * @param[in] msg : komunikat
+ */
+static void CalcError(Calc *c, Code *code, size_t line, const char *msg) {
+    if (code == NULL) {
+        CalcReportError(c, line, msg);
+    } else {
+        CodeEmit(code, OP_ERROR, line, (CodeArg) {.msg = msg});
+    }
+}
+
+/**
+ * Otwiera blok DEF lub REPEAT.
+ * @param[in,out] c : wskaźnik na stan kalkulatora
+ * @param[in] b : opis otwieranego bloku
+ */
+static void CalcBlockOpen(Calc *c, Block b) {
+    ArrayReserve((void **) &c->blocks, &c->blocks_size, c->blocks_count, sizeof(Block), INIT_SIZE);
+    c->blocks[c->blocks_count++] = b;
+}
+
+/**
+ * Kompiluje wiersz DEF, REPEAT lub END.
+ * @param[in,out] c : wskaźnik na stan kalkulatora
+ * @param[in] id : identyfikator dyrektywy
+ * @param[in] ok : czy parametr dyrektywy jest poprawny
+ * @param[in] arg : sparsowany parametr dyrektywy
+ * @param[in] name : nazwa makra dla dyrektywy DEF (przejmowana na własność)
+ * @param[in] line : numer wiersza
+ */
+static void CalcCompileDirective(Calc *c, CommandId id, bool ok, CodeArg arg, char *name, size_t line) {
+    Block *outer = c->blocks_count > 0 ? &c->blocks[c->blocks_count - 1] : NULL;
+    Code *code = CalcBlockCode(c, outer);
+    bool clone = outer != NULL && outer->clone;
+    if (id == CMD_END) {
+        if (outer == NULL) {
+            CalcError(c, code, line, "WRONG COMMAND");
+            return;
+        }
+        Block b = *outer;
+        --c->blocks_count;
+        if (b.kind == BLOCK_REPEAT && b.start != NO_LOOP) {
+            CodeEmit(code, OP_LOOP, line, (CodeArg) {.idx = b.start});
+        } else if (b.kind == BLOCK_DEF) {
+            NameMapSet(&c->macro_names, b.name, strlen(b.name), b.macro);
+            free(b.name);
+        }
+        return;
+    }
+    if (id == CMD_DEF) {
+        if (ok && (outer != NULL || CommandLookup(name, strlen(name)) != NULL)) {
+            // Makra definiujemy tylko poza blokami, a ich nazwy
+            // nie mogą przesłaniać poleceń.
+            ok = false;
+            free(name);
+        }
+        if (!ok) {
+            CalcError(c, code, line, commands[id].arg_error);
+            CalcBlockOpen(c, (Block) {.kind = BLOCK_DEAD, .line = line});
+            return;
+        }
+        ArrayReserve((void **) &c->macros, &c->macros_size, c->macros_count, sizeof(Code), INIT_SIZE);
+        CodeInit(&c->macros[c->macros_count]);
+        CalcBlockOpen(c, (Block) {.kind = BLOCK_DEF, .line = line, .macro = c->macros_count++, .name = name,
+                                  .clone = true});
+        return;
+    }
+    assert(id == CMD_REPEAT);
+    if (!ok || arg.idx == 0) {
+        if (!ok) {
+            CalcError(c, code, line, commands[id].arg_error);
+        }
+        CalcBlockOpen(c, (Block) {.kind = BLOCK_DEAD, .line = line});
+        return;
+    }
+    Block b = {.kind = BLOCK_REPEAT, .line = line, .macro = outer == NULL ? NO_MACRO : outer->macro,
+               .start = NO_LOOP, .clone = clone};
+    if (code == NULL) {
+        // Pętlę spoza bloków kompilujemy do kodu wykonywanego po jej zakończeniu.
+        code = &c->top;
+    }
+    if (arg.idx > 1) {
+        // Stałe w ciele pętli wykonywanej wielokrotnie muszą być kopiowane.
+        CodeEmit(code, OP_REPEAT, line, arg);
+        b.start = code->count;
+        b.clone = true;
+    }
+    CalcBlockOpen(c, b);
+}
+
+/**
+ * Zwraca indeks rejestru o podanej nazwie, tworząc pusty rejestr,
+ * jeśli nazwa pojawia się po raz pierwszy.
+ * @param[in,out] c : wskaźnik na stan kalkulatora
+ * @param[in] name : nazwa rejestru
+ * @return indeks rejestru
+ */
+static size_t CalcRegister(Calc *c, const char *name) {
+    size_t len = strlen(name);
+    size_t reg;
+    if (!NameMapFind(&c->reg_names, name, len, &reg)) {
+        ArrayReserve((void **) &c->regs, &c->regs_size, c->regs_count, sizeof(Register), INIT_SIZE);
+        reg = c->regs_count++;
+        c->regs[reg] = (Register) {.full = false};
+        NameMapSet(&c->reg_names, name, len, reg);
+    }
+    return reg;
+}
+
+/**
+ * Kompiluje wiersz z poleceniem, dyrektywą lub wywołaniem makra,
+ * a poza blokami od razu go wykonuje.
+ * Nazwą polecenia jest początek wiersza aż do pierwszego białego znaku.
+ * Parametr, jeśli polecenie go wymaga, następuje po jednej spacji.
+ * Błędy wykryte podczas kompilacji bloku stają się instrukcjami #OP_ERROR,
+ * więc komunikaty są wypisywane w kolejności wykonania.
+ * @param[in,out] c : wskaźnik na stan kalkulatora
+ * @param[in] str : napis (bez znaku końca wiersza)
+ * @param[in] line : numer wiersza
+ * @param[in] len : długość wiersza
+ */
+static void CalcCompileCommand(Calc *c, const char *str, size_t line, size_t len) {
+    assert(str != NULL && len > 0 && isalpha(*str));
+    const char *end = str + len;
+    const char *name_end;
+    const Command *cmd = CommandFind(str, end, &name_end);
+    Block *outer = c->blocks_count > 0 ? &c->blocks[c->blocks_count - 1] : NULL;
+    CommandId id = cmd == NULL ? CMD_COUNT : (CommandId) (cmd - commands);
+    if (outer != NULL && outer->kind == BLOCK_DEAD) {
+        // Wiersze bloku, który nie zostanie wykonany, pomijamy,
+        // śledząc jedynie zagnieżdżenie bloków.
+        if (id == CMD_DEF || id == CMD_REPEAT) {
+            CalcBlockOpen(c, (Block) {.kind = BLOCK_DEAD, .line = line});
+        } else if (id == CMD_END && name_end == end) {
+            --c->blocks_count;
+        }
+        return;
+    }
+    Code *code = CalcBlockCode(c, outer);
+    size_t macro;
+    if (cmd == NULL || (cmd->arg == ARG_NONE && name_end != end)) {
+        if (!NameMapFind(&c->macro_names, str, len, &macro)) {
+            CalcError(c, code, line, "WRONG COMMAND");
+        } else if (code == NULL) {
+            CalcExec(c, &c->macros[macro]);
         } else {
-            fprintf(stderr, "ERROR %zu WRONG COMMAND\n", line);
+            CodeEmit(code, OP_CALL, line, (CodeArg) {.idx = macro});
+        }
+        return;
+    }
+    CodeArg arg = {0};
+    char *s = NULL;
+    bool ok = cmd->arg == ARG_NONE
+              || (name_end < end && *name_end == ' ' && CommandArgParse(cmd->arg, name_end + 1, end, &arg, &s));
+    if (ok && cmd->arg == ARG_REGISTER) {
+        arg.idx = CalcRegister(c, s);
+        free(s);
+        s = NULL;
+    }
+    if (id >= CMD_DEF) {
+        CalcCompileDirective(c, id, ok, arg, s, line);
+    } else if (!ok) {
+        CalcError(c, code, line, cmd->arg_error);
+    } else if (code == NULL) {
+        CommandExec(c, id, line, &arg, s);
+        if (s != NULL) {
+            free(s);
         }
     } else {
-        fprintf(stderr, "ERROR %zu WRONG COMMAND\n", line);
+        if (s != NULL) {
+            arg.idx = CodeAddString(code, s);
+        }
+        CodeEmit(code, id, line, arg);
     }
-    if (err) {
-        fprintf(stderr, "ERROR %zu STACK UNDERFLOW\n", line);
+}
+
+/**
+ * Sprawdza, czy wiersze należą do bloku, który nie zostanie wykonany.
+ * @param[in] c : wskaźnik na stan kalkulatora
+ * @return Czy najbardziej wewnętrzny otwarty blok jest martwy?
+ */
+static bool CalcInDeadBlock(const Calc *c) {
+    return c->blocks_count > 0 && c->blocks[c->blocks_count - 1].kind == BLOCK_DEAD;
+}
+
+/**
+ * Kompiluje wiersz z już sparsowanym wielomianem, a poza blokami od razu
+ * wstawia go na stos. Przejmuje wielomian na własność.
+ * @param[in,out] c : wskaźnik na stan kalkulatora
+ * @param[in] p : wielomian
+ * @param[in] err : komunikat o błędzie, jeśli wiersz nie dał wielomianu, lub NULL
+ * @param[in] line : numer wiersza
+ */
+static void CalcCompileParsed(Calc *c, Poly *p, const char *err, size_t line) {
+    Block *outer = c->blocks_count > 0 ? &c->blocks[c->blocks_count - 1] : NULL;
+    if (outer != NULL && outer->kind == BLOCK_DEAD) {
+        PolyDestroy(p);
+        return;
+    }
+    Code *code = CalcBlockCode(c, outer);
+    if (err != NULL) {
+        CalcError(c, code, line, err);
+    } else if (code == NULL) {
+        CalcPush(c, p);
+    } else {
+        bool clone = outer != NULL && outer->clone;
+        CodeEmit(code, clone ? OP_PUSH_CLONE : OP_PUSH, line, (CodeArg) {.idx = CodeAddConst(code, p)});
+    }
+}
+
+/**
+ * Parsuje wielomian pod strażnikiem – patrz alloc.h.
+ * @param[in] str : napis
+ * @param[in] len : długość napisu
+ * @param[out] p : sparsowany wielomian
+ * @param[out] err : wskaźnik na informację o niepoprawnym wielomianie
+ * @return przyczyna przerwania parsowania
+ */
+static AllocAbort CalcParseGuarded(const char *str, size_t len, Poly *p, bool *err) {
+    AllocGuard g;
+    int jumped = setjmp(g.env);
+    if (jumped != 0) {
+        *p = PolyZero();
+        return (AllocAbort) jumped;
+    }
+    AllocGuardBegin(&g);
+    *p = PolyParse(str, len, err);
+    AllocGuardEnd(&g);
+    return ALLOC_ABORT_NONE;
+}
+
+/**
+ * Kompiluje wiersz z wielomianem, a poza blokami od razu wstawia go na stos.
+ * @param[in,out] c : wskaźnik na stan kalkulatora
+ * @param[in] str : napis (bez znaku końca wiersza)
+ * @param[in] line : numer wiersza
+ * @param[in] len : długość wiersza
+ */
+static void CalcCompilePoly(Calc *c, const char *str, size_t line, size_t len) {
+    if (CalcInDeadBlock(c)) {
+        return;
+    }
+    bool err = false;
+    AllocAbort reason = ALLOC_ABORT_NONE;
+    Poly p;
+    uint64_t start = TraceStart();
+    if (alloc_limit != 0) {
+        reason = CalcParseGuarded(str, len, &p, &err);
+    } else {
+        p = PolyParse(str, len, &err);
+    }
+    TracePhase("PolyParse", start, 1, (TraceArg[]) {{"bytes", (long) len}});
+    CalcCompileParsed(c, &p, reason != ALLOC_ABORT_NONE ? CalcAbortMessage(reason) : err ? "WRONG POLY" : NULL, line);
+}
+
+/** Największa liczba argumentów odcinka wiersza w przebiegu obliczeń. */
+#define TRACE_LINE_ARGS 3
+
+/**
+ * Przygotowuje argumenty odcinka wiersza w przebiegu obliczeń: numer wiersza
+ * oraz, poza trybem leniwym, liczby jednomianów dwóch wierzchnich wielomianów
+ * przed wykonaniem wiersza. W trybie leniwym wielomiany nie są jeszcze obliczone,
+ * a wielomianów odłożonych na dysk nie odczytujemy tylko po to, by je policzyć.
+ * @param[in,out] c : wskaźnik na stan kalkulatora
+ * @param[in] line : numer wiersza
+ * @param[out] args : argumenty, co najmniej #TRACE_LINE_ARGS
+ * @return liczba argumentów
+ */
+static size_t CalcTraceArgs(Calc *c, size_t line, TraceArg args[]) {
+    args[0] = (TraceArg) {"line", (long) line};
+    size_t argc = 1;
+    if (!c->lazy) {
+        static const char *const keys[] = {"top_monos", "next_monos"};
+        size_t count = CalcCount(c);
+        const Poly *p;
+        for (size_t i = 0; i < count && i < TRACE_LINE_ARGS - 1 && (p = StackPeekResident(c->s, i)) != NULL; ++i) {
+            args[argc++] = (TraceArg) {keys[i], PolyIsCoeff(p) ? 0 : (long) p->size};
+        }
     }
+    return argc;
+}
+
+/**
+ * Dopisuje do przebiegu obliczeń odcinek wykonania wiersza, nazwany
+ * nazwą polecenia lub `poly` dla wiersza z wielomianem.
+ * @param[in] str : wiersz
+ * @param[in] len : długość wiersza
+ * @param[in] kind : rodzaj wiersza
+ * @param[in] start : czas początku wykonania wiersza
+ * @param[in] argc : liczba argumentów
+ * @param[in] args : argumenty – patrz CalcTraceArgs()
+ */
+static void CalcTraceLine(const char *str, size_t len, LineKind kind, uint64_t start,
+                          size_t argc, const TraceArg args[]) {
+    size_t name_len = 0;
+    if (kind == LINE_COMMAND) {
+        while (name_len < len && str[name_len] != ' ') {
+            ++name_len;
+        }
+    } else {
+        str = "poly";
+        name_len = strlen(str);
+    }
+    TraceSpan("line", str, name_len, start, argc, args);
+}
+
+/**
+ * Wykonuje skompilowane wiersze spoza bloków, jeśli żaden blok nie jest otwarty.
+ * @param[in,out] c : wskaźnik na stan kalkulatora
+ */
+static void CalcFlushTop(Calc *c) {
+    if (c->blocks_count == 0 && c->top.count > 0) {
+        CalcExec(c, &c->top);
+        CodeClear(&c->top);
+    }
+}
+
+/**
+ * Inicjuje stan kalkulatora.
+ * @param[out] c : wskaźnik na stan kalkulatora
+ * @param[in] lazy : czy kalkulator ma działać w trybie leniwym
+ * @param[in] out_fd : deskryptor wyjścia wyników
+ * @param[in] errors_to_out : czy wypisywać komunikaty o błędach na wyjście wyników
+ */
+static void CalcInit(Calc *c, bool lazy, int out_fd, bool errors_to_out) {
+    // Punkty porównań losujemy od nowa przy każdym uruchomieniu,
+    // więc żadne konkretne wejście nie daje stale błędnej odpowiedzi.
+    // Adres stanu odróżnia sesje serwera rozpoczęte w tej samej chwili.
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    uint64_t seed = (uint64_t) ts.tv_sec ^ ((uint64_t) ts.tv_nsec << 20) ^ ((uint64_t) getpid() << 32);
+    *c = (Calc) {.lazy = lazy, .errors_to_out = errors_to_out, .seed = seed ^ (uint64_t) (uintptr_t) c};
+    c->stats = calloc(CMD_COUNT, sizeof(CommandStats));
+    CHECK_PTR(c->stats);
+    // Liczniki alokacji są lokalne dla wątku, a wątek serwera obsługuje
+    // kolejne sesje, więc każda sesja liczy od zera.
+    AllocStatsReset();
+    StackInit(&c->s);
+    ExprStackInit(&c->exprs);
+    WriterInitFd(&c->out, out_fd);
+    CodeInit(&c->top);
+    NameMapInit(&c->macro_names);
+    NameMapInit(&c->reg_names);
+}
+
+/**
+ * Zwalnia zasoby kalkulatora.
+ * @param[in,out] c : wskaźnik na stan kalkulatora
+ */
+static void CalcDestroy(Calc *c) {
+    for (size_t i = 0; i < c->blocks_count; ++i) {
+        free(c->blocks[i].name);
+    }
+    free(c->blocks);
+    for (size_t i = 0; i < c->macros_count; ++i) {
+        CodeDestroy(&c->macros[i]);
+    }
+    free(c->macros);
+    NameMapDestroy(&c->macro_names);
+    CodeDestroy(&c->top);
+    free(c->frames);
+    free(c->loops);
+    free(c->stats);
+    WriterDestroy(&c->out);
+    for (size_t i = 0; i < c->regs_count; ++i) {
+        RegisterClear(c, &c->regs[i]);
+    }
+    free(c->regs);
+    NameMapDestroy(&c->reg_names);
+    for (size_t i = 0; i < c->stacks_count; ++i) {
+        if (i != c->stack_idx && c->stacks[i] != NULL) {
+            StackDestroy(c->stacks[i]);
+        }
+    }
+    free(c->stacks);
+    StackDestroy(c->s);
+    ExprStackDestroy(&c->exprs);
+}
+
+/**
+ * Opróżnia wyjście kalkulatora, zanim czytanie wejścia zaczeka na dane.
+ * @param[in,out] arg : wskaźnik na stan kalkulatora
+ */
+static void CalcInputWait(void *arg) {
+    WriterFlush(&((Calc *) arg)->out);
 }
 
 /**
- * Sprowadza wiersz do postaci normalnej,
- * czyli jeśli nie kończy się końcem wiersza,
- * to wstawia na jego koniec ten znak.
- * @param[in] str : wskaźnik na wiersz tekstu
- * @param[in] len : wskaźnik na długość tekstu
+ * Wykonuje wiersze z potoku: wielomiany parsowane są w @p workers wątkach
+ * równolegle z wykonywaniem, a wiersze wykonywane są w kolejności wejścia.
+ * @param[in,out] c : wskaźnik na stan kalkulatora
+ * @param[in] fd : deskryptor wejścia
+ * @param[in] workers : liczba wątków parsujących
  */
-void NormalizeLine(char **str, ssize_t *len) {
-    assert(*len > 0);
-    if ((*str)[*len - 1] != '\n') {
-        *str = realloc(*str, (*len + 2) * sizeof(char)); // +2 bo `\n` i jeszcze `\0`.
-        CHECK_PTR(str);
-        (*str)[*len] = '\n';
-        (*str)[*len + 1] = '\0';
-        ++(*len); // Długość nie uwzględnia znaku `\0` na końcu.
+static void CalcRunPipeline(Calc *c, int fd, size_t workers) {
+    Pipeline pl;
+    PipelineInit(&pl, fd, workers, &c->out);
+    PipelineBatch *b;
+    while ((b = PipelineNext(&pl)) != NULL) {
+        // Wielomiany porcji przydzielił wątek parsujący, a zwolni je ten wątek.
+        AllocStatsMerge(&b->stats);
+        for (size_t i = 0; i < b->count; ++i) {
+            PipelineLine *l = &b->lines[i];
+            TraceArg args[TRACE_LINE_ARGS];
+            size_t argc = trace_on ? CalcTraceArgs(c, l->line, args) : 0;
+            uint64_t start = TraceStart();
+            if (l->kind == LINE_COMMAND) {
+                CalcCompileCommand(c, b->base + l->off, l->line, l->len);
+            } else {
+                CalcCompileParsed(c, &l->p, l->err ? "WRONG POLY" : NULL, l->line);
+            }
+            CalcFlushTop(c);
+            if (trace_on) {
+                CalcTraceLine(b->base + l->off, l->len, l->kind, start, argc, args);
+            }
+        }
     }
+    PipelineDestroy(&pl);
 }
 
 /**
- * Parsuje polecenia ze standardowego wejścia i
- * wykonuje je na kalkulatorze.
- * @param[in,out] s : wskaźnik na stos kalkulatora
+ * Parsuje polecenia z deskryptora @p fd i wykonuje je
+ * na kalkulatorze. Wiersze spoza bloków wykonywane są od razu;
+ * wiersze bloków kompilowane są do kodu bajtowego, a pętla spoza
+ * bloków wykonywana jest po jej zakończeniu. Zanim czytanie zaczeka
+ * na kolejne wiersze, wyniki wcześniejszych są opróżniane na wyjście.
+ * Jeśli @p workers jest dodatnie, wielomiany parsowane są w potoku – patrz pipeline.h.
+ * @param[in,out] c : wskaźnik na stan kalkulatora
+ * @param[in] fd : deskryptor wejścia
+ * @param[in] workers : liczba wątków parsujących lub 0
  * */
-static void CalcRun(Stack s) {
-    char *str = NULL;
-    ssize_t len = 0;
-    size_t n = 0;
-    size_t line = 0;
-    errno = 0;
-    while ((len = getline(&str, &n, stdin)) > 0) {
-        ++line;
-        if ((len == 1 && str[0] == '\n') || str[0] == '#') {
-            // Linia zaczynająca się znakiem '#' lub pusta, jest ignorowana.
-            continue;
-        } else {
-            NormalizeLine(&str, &len);
-            char c = *str;
-            if (isalpha(c)) {
-                CommandExec(s, str, line, len);
+static void CalcRun(Calc *c, int fd, size_t workers) {
+    if (workers > 0) {
+        CalcRunPipeline(c, fd, workers);
+    } else {
+        Input in;
+        InputInit(&in, fd);
+        InputSetWaitHook(&in, CalcInputWait, c);
+        const char *str;
+        size_t len;
+        size_t line = 0;
+        while (InputNextLine(&in, &str, &len)) {
+            ++line;
+            LineKind kind = LineKindOf(str, len);
+            if (kind == LINE_SKIP) {
+                continue;
+            }
+            TraceArg args[TRACE_LINE_ARGS];
+            size_t argc = trace_on ? CalcTraceArgs(c, line, args) : 0;
+            uint64_t start = TraceStart();
+            if (kind == LINE_COMMAND) {
+                CalcCompileCommand(c, str, line, len);
             } else {
-                bool err = false;
-                Poly p = PolyParse(str, line, len, &err);
-                if (!err) {
-                    StackPush(s, &p);
-                }
+                CalcCompilePoly(c, str, line, len);
+            }
+            CalcFlushTop(c);
+            if (trace_on) {
+                CalcTraceLine(str, len, kind, start, argc, args);
             }
         }
-        errno = 0;
+        InputDestroy(&in);
+    }
+    // Bloki niedomknięte do końca wejścia nie są wykonywane.
+    for (size_t i = 0; i < c->blocks_count; ++i) {
+        CalcReportError(c, c->blocks[i].line, "MISSING END");
+    }
+}
+
+/**
+ * Obsługuje połączenie z klientem serwera: wykonuje przysłane wiersze
+ * na osobnym kalkulatorze i odsyła wyniki oraz komunikaty o błędach.
+ * @param[in] fd : deskryptor połączenia
+ * @param[in] arg : wskaźnik na flagę trybu leniwego
+ */
+static void CalcSession(int fd, void *arg) {
+    Calc c;
+    AllocGuardForgetCancel();
+    CalcInit(&c, *(const bool *) arg, fd, true);
+    CalcRun(&c, fd, 0);
+    CalcDestroy(&c);
+}
+
+/**
+ * Parsuje dodatnią liczbę podaną jako wartość opcji programu.
+ * @param[in] str : napis
+ * @param[out] res : wynik
+ * @return Czy napis jest poprawną dodatnią liczbą?
+ */
+static bool CalcParseCount(const char *str, size_t *res) {
+    char *end;
+    errno = 0;
+    unsigned long n = strtoul(str, &end, 10);
+    *res = n;
+    return isdigit(*str) && *end == '\0' && errno == 0 && n > 0;
+}
+
+/**
+ * Parsuje rozmiar pamięci podany jako wartość opcji programu: dodatnią
+ * liczbę bajtów, opcjonalnie z przyrostkiem K, M lub G (potęgi 1024).
+ * @param[in] str : napis
+ * @param[out] res : wynik w bajtach
+ * @return Czy napis jest poprawnym rozmiarem?
+ */
+static bool CalcParseSize(const char *str, size_t *res) {
+    char *end;
+    errno = 0;
+    unsigned long n = strtoul(str, &end, 10);
+    unsigned shift = 0;
+    if (*end != '\0' && end[1] == '\0') {
+        const char *units = "KMG";
+        const char *u = strchr(units, *end);
+        if (u != NULL) {
+            shift = 10 * (unsigned) (u - units + 1);
+            ++end;
+        }
     }
-    if (len < 0 && errno == ENOMEM) {
-        // Wystąpił błąd alokacji pamięci.
-        exit(1);
+    *res = (size_t) n << shift;
+    return isdigit(*str) && *end == '\0' && errno == 0 && n > 0 && n <= (SIZE_MAX >> shift);
+}
+
+/**
+ * Obsługuje przerwanie w trybie wsadowym: anuluje wykonywane polecenie,
+ * a jeśli żadne nie jest wykonywane, kończy program jak domyślna obsługa.
+ * @param[in] sig : numer sygnału
+ */
+static void CalcInterrupt(int sig) {
+    if (!AllocGuardCancel()) {
+        signal(sig, SIG_DFL);
+        raise(sig);
     }
-    free(str);
 }
 
 /**
- * Realizacja kalkulatora.
+ * Obsługuje sygnał anulowania w trybie serwera: anuluje polecenia
+ * wykonywane we wszystkich sesjach.
+ * @param[in] sig : numer sygnału
+ */
+static void CalcCancel(int sig) {
+    (void) sig;
+    AllocGuardCancel();
+}
+
+/**
+ * Realizacja kalkulatora. Opcja `--lazy` włącza tryb leniwy, w którym
+ * działania arytmetyczne są odkładane do czasu, gdy ich wynik jest
+ * potrzebny, a następnie obliczane wspólnie – patrz lazy.h.
+ * Opcja `--server PATH` uruchamia serwer, który na gnieździe uniksowym
+ * @p PATH obsługuje wiele niezależnych sesji kalkulatora w puli
+ * `--threads N` wątków – patrz server.h. Opcja `--parse-threads N` włącza
+ * parsowanie wielomianów w N wątkach równolegle z wykonywaniem – patrz pipeline.h.
+ * Opcja `--restore FILE` wstawia na stos zawartość zapisaną poleceniem CHECKPOINT.
+ * Opcja `--spill-keep K` pozwala odkładać na dysk wielomiany leżące na stosie
+ * głębiej niż K wierzchnich – patrz stack.h.
+ * Opcja `--latency FILE` zapisuje do pliku czas wykonania każdego polecenia.
+ * Opcja `--stats FILE` zapisuje do pliku na koniec pracy liczniki wypisywane
+ * poleceniem STATS.
+ * Opcja `--trace FILE` lub zmienna środowiskowa `POLY_TRACE` zapisuje do pliku
+ * przebieg obliczeń – patrz trace.h.
+ * Opcja `--memory-limit BYTES` ogranicza pamięć zajętą przez wielomiany
+ * i stosy: polecenie, które przekroczyłoby limit, kończy się błędem
+ * OUT OF MEMORY, a stos pozostaje bez zmian – patrz alloc.h.
+ * Tak samo opcja `--timeout MS` ogranicza czas wykonania polecenia
+ * (błąd TIMEOUT), a opcja `--max-terms N` liczbę tworzonych przez nie
+ * jednomianów (błąd TOO MANY TERMS). Przy którejkolwiek z tych opcji
+ * sygnał SIGINT, a w trybie serwera SIGUSR1, anuluje wykonywane polecenia
+ * (błąd CANCELLED); SIGINT poza poleceniem lub bez tych opcji kończy program
+ * jak zwykle, a SIGUSR1 bez tych opcji jest ignorowany.
+ * @param[in] argc : liczba argumentów programu
+ * @param[in] argv : argumenty programu
  * @return kod zakończenia programu
  * */
-int main(void) {
-    Stack s = NULL;
-    StackInit(&s);
+int main(int argc, char *argv[]) {
+    bool lazy = false;
+    const char *path = NULL;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t threads = cpus > 0 ? (size_t) cpus : 1;
+    size_t parse_threads = 0;
+    const char *restore = NULL;
+    size_t spill_keep = 0;
+    const char *latency = NULL;
+    const char *stats = NULL;
+    const char *trace = getenv("POLY_TRACE");
+    size_t memory_limit = 0;
+    size_t timeout_ms = 0;
+    size_t max_terms = 0;
+    bool ok = true;
+    for (int i = 1; i < argc && ok; ++i) {
+        if (strcmp(argv[i], "--lazy") == 0) {
+            lazy = true;
+        } else if (strcmp(argv[i], "--server") == 0 && i + 1 < argc) {
+            path = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            ok = CalcParseCount(argv[++i], &threads);
+        } else if (strcmp(argv[i], "--spill-keep") == 0 && i + 1 < argc) {
+            ok = CalcParseCount(argv[++i], &spill_keep);
+        } else if (strcmp(argv[i], "--restore") == 0 && i + 1 < argc) {
+            restore = argv[++i];
+        } else if (strcmp(argv[i], "--latency") == 0 && i + 1 < argc) {
+            latency = argv[++i];
+        } else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+            stats = argv[++i];
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace = argv[++i];
+        } else if (strcmp(argv[i], "--parse-threads") == 0 && i + 1 < argc) {
+            ok = CalcParseCount(argv[++i], &parse_threads);
+        } else if (strcmp(argv[i], "--memory-limit") == 0 && i + 1 < argc) {
+            ok = CalcParseSize(argv[++i], &memory_limit);
+        } else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+            ok = CalcParseCount(argv[++i], &timeout_ms);
+        } else if (strcmp(argv[i], "--max-terms") == 0 && i + 1 < argc) {
+            ok = CalcParseCount(argv[++i], &max_terms);
+        } else {
+            ok = false;
+        }
+    }
+    bool single = restore != NULL || spill_keep > 0 || latency != NULL || stats != NULL;
+    // Wyrażenia trybu leniwego i wielomiany parsowane z wyprzedzeniem nie należą
+    // do żadnego polecenia, więc nie da się przerwać ich obliczania.
+    bool guarded = memory_limit > 0 || timeout_ms > 0 || max_terms > 0;
+    if (!ok || (path != NULL && single) || (lazy && spill_keep > 0) || (guarded && (lazy || parse_threads > 0))) {
+        fprintf(stderr, "Usage: %s [--lazy] [--parse-threads N] [--restore FILE] [--spill-keep K] [--latency FILE]"
+                        " [--stats FILE] [--trace FILE] |"
+                        " [--restore FILE] [--spill-keep K] [--latency FILE] [--stats FILE] [--trace FILE]"
+                        " [--memory-limit BYTES] [--timeout MS] [--max-terms N] |"
+                        " [--lazy] [--server PATH [--threads N]] [--trace FILE] |"
+                        " [--server PATH [--threads N]] [--trace FILE] [--memory-limit BYTES] [--timeout MS]"
+                        " [--max-terms N]\n",
+                argv[0]);
+        return 1;
+    }
+    // Limit czasu lub liczby jednomianów wymaga strażników także bez limitu pamięci.
+    alloc_limit = memory_limit > 0 ? memory_limit : guarded ? SIZE_MAX : 0;
+    alloc_timeout_ns = (uint64_t) timeout_ms * 1000000u;
+    alloc_max_terms = max_terms;
+    // Bez strażników żadne polecenie nie jest wykonywane pod strażnikiem,
+    // więc SIGINT kończy program, a SIGUSR1 serwera nie ma czego anulować.
+    struct sigaction sa = {.sa_handler = path != NULL ? CalcCancel : CalcInterrupt, .sa_flags = SA_RESTART};
+    sigemptyset(&sa.sa_mask);
+    sigaction(path != NULL ? SIGUSR1 : SIGINT, &sa, NULL);
+    if (trace != NULL && *trace != '\0' && !TraceOpen(trace)) {
+        perror(trace);
+        return 1;
+    }
+    CommandTableInit();
+    if (path != NULL) {
+        bool served = ServerRun(path, threads, CalcSession, &lazy);
+        if (!served) {
+            perror(path);
+        }
+        TraceClose();
+        return served ? 0 : 1;
+    }
+
+    Calc c;
+    CalcInit(&c, lazy, STDOUT_FILENO, false);
+    if (spill_keep > 0) {
+        c.spill_keep = spill_keep;
+        StackSetSpill(c.s, spill_keep);
+    }
+    AllocAbort reason = ALLOC_ABORT_NONE;
+    if (restore != NULL && !CalcRestore(&c, restore, &reason)) {
+        if (reason != ALLOC_ABORT_NONE) {
+            fprintf(stderr, "%s: cannot restore stack from %s: %s\n", argv[0], restore, CalcAbortMessage(reason));
+        } else {
+            fprintf(stderr, "%s: cannot restore stack from %s\n", argv[0], restore);
+        }
+        CalcDestroy(&c);
+        TraceClose();
+        return 1;
+    }
+    Writer latency_out;
+    if (latency != NULL) {
+        int fd = open(latency, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            perror(latency);
+            CalcDestroy(&c);
+            TraceClose();
+            return 1;
+        }
+        WriterInitFd(&latency_out, fd);
+        c.latency = &latency_out;
+    }
+    c.timed = latency != NULL || stats != NULL;
 
-    CalcRun(s);
+    CalcRun(&c, STDIN_FILENO, parse_threads);
 
-    StackDestroy(s);
-    return 0;
-}
\ No newline at end of file
+    int ret = 0;
+    if (stats != NULL) {
+        FILE *f = fopen(stats, "w");
+        bool written = f != NULL;
+        if (written) {
+            char buf[BUFSIZ];
+            Writer w;
+            WriterInitFile(&w, f, buf, sizeof(buf));
+            CalcWriteStats(&c, &w);
+            WriterDestroy(&w);
+            written = !w.err && fclose(f) == 0;
+        }
+        if (!written) {
+            perror(stats);
+            ret = 1;
+        }
+    }
+    CalcDestroy(&c);
+    if (latency != NULL) {
+        WriterDestroy(&latency_out);
+        close(latency_out.fd);
+    }
+    TraceClose();
+    return ret;
+}
@@ -0,0 +1,54 @@
+/** @file
+ * Implementacja kodu bajtowego kalkulatora.
+ *
+ * @author Mateusz Sulimowicz <ms429603@students.mimuw.edu.pl>
+ * @date 2021
+ */
+
+#include <stdlib.h>
+#include "array.h"
+#include "code.h"
+
+/** Początkowy rozmiar alokowanej tablicy */
+#define INIT_SIZE 4
+
+void CodeInit(Code *code) {
+    *code = (Code) {0};
+}
+
+size_t CodeEmit(Code *code, unsigned op, size_t line, CodeArg arg) {
+    ArrayReserve((void **) &code->arr, &code->size, code->count, sizeof(Instr), INIT_SIZE);
+    code->arr[code->count] = (Instr) {.op = op, .line = line, .arg = arg};
+    return code->count++;
+}
+
+size_t CodeAddConst(Code *code, const Poly *p) {
+    ArrayReserve((void **) &code->consts, &code->consts_size, code->consts_count, sizeof(Poly), INIT_SIZE);
+    code->consts[code->consts_count] = *p;
+    return code->consts_count++;
+}
+
+size_t CodeAddString(Code *code, char *s) {
+    ArrayReserve((void **) &code->strs, &code->strs_size, code->strs_count, sizeof(char *), INIT_SIZE);
+    code->strs[code->strs_count] = s;
+    return code->strs_count++;
+}
+
+void CodeClear(Code *code) {
+    for (size_t i = 0; i < code->consts_count; ++i) {
+        PolyDestroy(&code->consts[i]);
+    }
+    for (size_t i = 0; i < code->strs_count; ++i) {
+        free(code->strs[i]);
+    }
+    code->count = 0;
+    code->consts_count = 0;
+    code->strs_count = 0;
+}
+
+void CodeDestroy(Code *code) {
+    CodeClear(code);
+    free(code->arr);
+    free(code->consts);
+    free(code->strs);
+}
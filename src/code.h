@@ -0,0 +1,90 @@
+/** @file
+ * Interfejs kodu bajtowego kalkulatora.
+ *
+ * Kod jest tablicą instrukcji wraz z pulą stałych wielomianów
+ * i pulą napisów (np. ścieżek do plików), do których odwołują się
+ * instrukcje. Znaczenie kodów operacji ustala kalkulator.
+ *
+ * @author Mateusz Sulimowicz <ms429603@students.mimuw.edu.pl>
+ * @date 2021
+ */
+
+#ifndef __CODE_H__
+#define __CODE_H__
+
+#include <stddef.h>
+#include "poly.h"
+
+/** To jest unia przechowująca parametr instrukcji. */
+typedef union CodeArg {
+    size_t idx; ///< liczba nieujemna lub indeks w puli stałych, napisów albo w kodzie
+    poly_coeff_t value; ///< liczba całkowita
+    const char *msg; ///< statyczny komunikat
+} CodeArg;
+
+/** To jest struktura reprezentująca instrukcję. */
+typedef struct Instr {
+    unsigned op; ///< kod operacji
+    size_t line; ///< numer wiersza wejścia, z którego pochodzi instrukcja
+    CodeArg arg; ///< parametr instrukcji
+} Instr;
+
+/** To jest struktura reprezentująca kod. */
+typedef struct Code {
+    Instr *arr; ///< tablica instrukcji
+    size_t size; ///< rozmiar tablicy instrukcji
+    size_t count; ///< liczba instrukcji
+    Poly *consts; ///< pula stałych wielomianów
+    size_t consts_size; ///< rozmiar puli stałych
+    size_t consts_count; ///< liczba stałych
+    char **strs; ///< pula napisów
+    size_t strs_size; ///< rozmiar puli napisów
+    size_t strs_count; ///< liczba napisów
+} Code;
+
+/**
+ * Inicjuje pusty kod.
+ * @param[out] code : kod
+ */
+void CodeInit(Code *code);
+
+/**
+ * Dopisuje instrukcję na końcu kodu.
+ * @param[in,out] code : kod
+ * @param[in] op : kod operacji
+ * @param[in] line : numer wiersza
+ * @param[in] arg : parametr instrukcji
+ * @return indeks instrukcji w kodzie
+ */
+size_t CodeEmit(Code *code, unsigned op, size_t line, CodeArg arg);
+
+/**
+ * Dodaje stały wielomian do puli i przejmuje go na własność.
+ * @param[in,out] code : kod
+ * @param[in] p : wielomian
+ * @return indeks stałej w puli
+ */
+size_t CodeAddConst(Code *code, const Poly *p);
+
+/**
+ * Dodaje napis do puli i przejmuje go na własność.
+ * @param[in,out] code : kod
+ * @param[in] s : napis zaalokowany przez `malloc`
+ * @return indeks napisu w puli
+ */
+size_t CodeAddString(Code *code, char *s);
+
+/**
+ * Usuwa wszystkie instrukcje, stałe i napisy, zachowując
+ * zaalokowane tablice do ponownego użycia.
+ * @param[in,out] code : kod
+ */
+void CodeClear(Code *code);
+
+/**
+ * Zwalnia pamięć zajmowaną przez kod.
+ * @param[in] code : kod
+ */
+void CodeDestroy(Code *code);
+
+#endif //__CODE_H__
@@ -0,0 +1,112 @@
+/** @file
+ * Stos ramek zastępujący rekurencję przy przechodzeniu wielomianów.
+ *
+ * Plik nagłówkowy do użytku wewnętrznego modułów operujących
+ * na wielomianach.
+ *
+ * @author Mateusz Sulimowicz <ms429603@students.mimuw.edu.pl>
+ * @date 2021
+ */
+
+#ifndef __FRAMES_H__
+#define __FRAMES_H__
+
+#include <stdlib.h>
+#include <string.h>
+#include "alloc.h"
+#include "poly.h"
+
+/** Początkowy rozmiar stosu ramek zastępującego rekurencję. */
+#define FRAMES_INIT_SIZE 32
+
+/** Mnożnik rozmiaru stosu ramek do realokacji. */
+#define FRAMES_MULTIPLIER 2
+
+/**
+ * To jest struktura przechowująca ramkę przechodzenia wielomianu.
+ * Ramki zastępują wywołania rekurencyjne, dzięki czemu głębokość
+ * zagnieżdżenia wielomianu nie jest ograniczona rozmiarem stosu wywołań.
+ */
+typedef struct PolyFrame {
+    const Poly *p; ///< przechodzony wielomian
+    const Poly *q; ///< drugi przechodzony wielomian (przy porównywaniu)
+    Poly *r; ///< budowany wielomian (przy kopiowaniu)
+    size_t i; ///< indeks kolejnego jednomianu
+    size_t level; ///< poziom zagnieżdżenia wielomianu @p p
+    poly_exp_t e; ///< suma wykładników na ścieżce od korzenia do @p p
+} PolyFrame;
+
+/**
+ * To jest stos ramek przechodzenia wielomianu.
+ * Płytkie wielomiany obsługiwane są bez alokacji pamięci na stercie.
+ */
+typedef struct PolyFrames {
+    PolyFrame *arr; ///< tablica ramek
+    size_t size; ///< rozmiar tablicy ramek
+    size_t top; ///< liczba ramek na stosie
+    PolyFrame buf[FRAMES_INIT_SIZE]; ///< początkowa tablica ramek
+} PolyFrames;
+
+/**
+ * Inicjuje pusty stos ramek.
+ * @param[out] fs : stos ramek
+ */
+static inline void FramesInit(PolyFrames *fs) {
+    fs->arr = fs->buf;
+    fs->size = FRAMES_INIT_SIZE;
+    fs->top = 0;
+}
+
+/**
+ * Wstawia ramkę na stos ramek.
+ * Wskaźniki na ramki uzyskane wcześniej tracą ważność.
+ * @param[in,out] fs : stos ramek
+ * @param[in] f : ramka
+ */
+static inline void FramesPush(PolyFrames *fs, PolyFrame f) {
+    if (fs->top == fs->size) {
+        size_t new_size = FRAMES_MULTIPLIER * fs->size;
+        PolyFrame *arr;
+        if (fs->arr == fs->buf) {
+            arr = PolyMalloc(new_size * sizeof(PolyFrame));
+            CHECK_PTR(arr);
+            memcpy(arr, fs->buf, fs->size * sizeof(PolyFrame));
+        } else {
+            arr = PolyRealloc(fs->arr, new_size * sizeof(PolyFrame));
+            CHECK_PTR(arr);
+        }
+        fs->arr = arr;
+        fs->size = new_size;
+    }
+    fs->arr[fs->top++] = f;
+}
+
+/**
+ * Daje ramkę z wierzchołka stosu ramek lub NULL, jeśli stos jest pusty.
+ * @param[in] fs : stos ramek
+ * @return wskaźnik na ramkę z wierzchołka
+ */
+static inline PolyFrame *FramesTop(PolyFrames *fs) {
+    return fs->top > 0 ? &fs->arr[fs->top - 1] : NULL;
+}
+
+/**
+ * Usuwa ramkę z wierzchołka stosu ramek.
+ * @param[in,out] fs : stos ramek
+ */
+static inline void FramesPop(PolyFrames *fs) {
+    assert(fs->top > 0);
+    --fs->top;
+}
+
+/**
+ * Zwalnia pamięć zajmowaną przez stos ramek.
+ * @param[in] fs : stos ramek
+ */
+static inline void FramesDestroy(PolyFrames *fs) {
+    if (fs->arr != fs->buf) {
+        PolyFree(fs->arr);
+    }
+}
+
+#endif //__FRAMES_H__
@@ -0,0 +1,153 @@
+/** @file
+ * Implementacja wczytywania wejścia kalkulatora wierszami.
+ *
+ * @author Mateusz Sulimowicz <ms429603@students.mimuw.edu.pl>
+ * @date 2021
+ */
+
+/** Makro potrzebne do korzystania z GNU C Library. */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "input.h"
+#include "poly.h"
+
+/** Mnożnik rozmiaru bufora do realokacji. */
+#define MULTIPLIER 2
+
+/**
+ * Co tyle bajtów przetworzonej części zmapowanego pliku
+ * oddajemy jej strony systemowi.
+ */
+#define INPUT_RELEASE_STEP (64 << 20)
+
+/**
+ * Próbuje zmapować do pamięci zwykły plik.
+ * Czytanie zaczyna się od bieżącej pozycji w pliku.
+ * @param[in,out] in : wskaźnik na źródło wierszy
+ * @return Czy plik został zmapowany?
+ */
+static bool InputMap(Input *in) {
+    struct stat st;
+    if (fstat(in->fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+        return false;
+    }
+    off_t offset = lseek(in->fd, 0, SEEK_CUR);
+    if (offset < 0 || offset >= st.st_size) {
+        return false;
+    }
+    void *map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, in->fd, 0);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    madvise(map, (size_t) st.st_size, MADV_SEQUENTIAL);
+    in->data = map;
+    in->cap = (size_t) st.st_size;
+    in->begin = in->scan = in->released = (size_t) offset;
+    in->end = (size_t) st.st_size;
+    in->mapped = true;
+    in->eof = true;
+    return true;
+}
+
+void InputInit(Input *in, int fd) {
+    *in = (Input) {.fd = fd};
+    if (!InputMap(in)) {
+        in->cap = INPUT_CHUNK_SIZE;
+        in->data = malloc(in->cap);
+        CHECK_PTR(in->data);
+    }
+}
+
+void InputSetWaitHook(Input *in, InputWaitHook hook, void *arg) {
+    in->wait = hook;
+    in->wait_arg = arg;
+}
+
+/**
+ * Oddaje systemowi strony zmapowanego pliku, które zostały już przetworzone.
+ * Ponowny dostęp do nich wczytałby je z pliku, więc nie zmienia to zawartości.
+ * @param[in,out] in : wskaźnik na źródło wierszy
+ */
+static void InputRelease(Input *in) {
+    if (in->begin - in->released >= INPUT_RELEASE_STEP) {
+        size_t page = (size_t) sysconf(_SC_PAGESIZE);
+        size_t upto = in->begin / page * page;
+        size_t from = in->released / page * page;
+        if (upto > from) {
+            madvise(in->data + from, upto - from, MADV_DONTNEED);
+        }
+        in->released = upto;
+    }
+}
+
+/**
+ * Wczytuje do bufora kolejny blok danych. Przesuwa nieprzetworzony
+ * fragment na początek bufora, a jeśli bufor jest pełny, powiększa go.
+ * Przed czytaniem wywołuje funkcję ustawioną przez InputSetWaitHook().
+ * @param[in,out] in : wskaźnik na źródło wierszy
+ */
+static void InputFill(Input *in) {
+    if (in->begin > 0) {
+        memmove(in->data, in->data + in->begin, in->end - in->begin);
+        in->end -= in->begin;
+        in->scan -= in->begin;
+        in->begin = 0;
+    }
+    if (in->end == in->cap) {
+        in->cap *= MULTIPLIER;
+        in->data = realloc(in->data, in->cap);
+        CHECK_PTR(in->data);
+    }
+    if (in->wait != NULL) {
+        in->wait(in->wait_arg);
+    }
+    ssize_t n;
+    do {
+        n = read(in->fd, in->data + in->end, in->cap - in->end);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        in->eof = true;
+    } else {
+        in->end += (size_t) n;
+    }
+}
+
+bool InputNextLine(Input *in, const char **line, size_t *len) {
+    while (true) {
+        char *nl = memchr(in->data + in->scan, '\n', in->end - in->scan);
+        if (nl != NULL) {
+            *line = in->data + in->begin;
+            *len = (size_t) (nl - *line);
+            in->begin = in->scan = (size_t) (nl - in->data) + 1;
+            if (in->mapped) {
+                InputRelease(in);
+            }
+            return true;
+        } else if (in->eof) {
+            // Ostatni wiersz może nie kończyć się znakiem '\n'.
+            if (in->begin == in->end) {
+                return false;
+            }
+            *line = in->data + in->begin;
+            *len = in->end - in->begin;
+            in->begin = in->scan = in->end;
+            return true;
+        }
+        in->scan = in->end;
+        InputFill(in);
+    }
+}
+
+void InputDestroy(Input *in) {
+    if (in->mapped) {
+        munmap(in->data, in->cap);
+    } else {
+        free(in->data);
+    }
+}
@@ -0,0 +1,80 @@
+/** @file
+ * Interfejs wczytywania wejścia kalkulatora wierszami.
+ *
+ * Zwykłe pliki są mapowane do pamięci i dzielone na wiersze bez
+ * kopiowania. Pozostałe źródła (potoki, terminale) są czytane dużymi
+ * blokami do wspólnego bufora.
+ *
+ * @author Mateusz Sulimowicz <ms429603@students.mimuw.edu.pl>
+ * @date 2021
+ */
+
+#ifndef __INPUT_H__
+#define __INPUT_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/** Rozmiar bloku czytanego z wejścia, które nie jest zwykłym plikiem. */
+#define INPUT_CHUNK_SIZE (1 << 20)
+
+/**
+ * To jest typ funkcji wywoływanej, zanim czytanie zaczeka na dane.
+ * @param[in] arg : argument podany przy ustawianiu funkcji
+ */
+typedef void (*InputWaitHook)(void *arg);
+
+/** To jest struktura reprezentująca źródło wierszy wejścia. */
+typedef struct Input {
+    int fd; ///< deskryptor czytanego pliku
+    char *data; ///< zmapowany plik lub bufor z wczytanymi danymi
+    size_t cap; ///< rozmiar mapowania lub bufora
+    size_t begin; ///< początek pierwszego nieprzetworzonego wiersza
+    size_t scan; ///< miejsce, od którego należy szukać końca wiersza
+    size_t end; ///< koniec dostępnych danych
+    size_t released; ///< koniec fragmentu mapowania oddanego systemowi
+    bool mapped; ///< czy plik jest zmapowany do pamięci
+    bool eof; ///< czy osiągnięto koniec pliku
+    InputWaitHook wait; ///< funkcja wywoływana przed czytaniem, które może czekać na dane, lub NULL
+    void *wait_arg; ///< argument funkcji @p wait
+} Input;
+
+/**
+ * Inicjuje czytanie wierszy z deskryptora @p fd.
+ * Jeśli @p fd jest zwykłym plikiem, mapuje go do pamięci,
+ * w przeciwnym wypadku przygotowuje bufor do czytania blokami.
+ * @param[out] in : wskaźnik na źródło wierszy
+ * @param[in] fd : deskryptor pliku
+ */
+void InputInit(Input *in, int fd);
+
+/**
+ * Daje kolejny wiersz wejścia bez końcowego znaku `\n`.
+ * Wiersz nie jest zakończony znakiem `\0` i nie wolno go modyfikować.
+ * Dla zmapowanego pliku wiersz pozostaje ważny aż do wywołania
+ * InputDestroy(), w przeciwnym wypadku do kolejnego wywołania InputNextLine().
+ * @param[in,out] in : wskaźnik na źródło wierszy
+ * @param[out] line : wskaźnik na początek wiersza
+ * @param[out] len : długość wiersza
+ * @return Czy wczytano wiersz? Fałsz oznacza koniec wejścia.
+ */
+bool InputNextLine(Input *in, const char **line, size_t *len);
+
+/**
+ * Ustawia funkcję wywoływaną, zanim czytanie zaczeka na dane, np.
+ * opróżniającą wyjście. Pozwala to interaktywnemu klientowi odebrać
+ * odpowiedzi na wysłane już wiersze, zanim wyśle kolejne.
+ * @param[in,out] in : wskaźnik na źródło wierszy
+ * @param[in] hook : funkcja lub NULL
+ * @param[in] arg : argument funkcji
+ */
+void InputSetWaitHook(Input *in, InputWaitHook hook, void *arg);
+
+/**
+ * Zwalnia zasoby związane ze źródłem wierszy.
+ * Nie zamyka deskryptora pliku.
+ * @param[in] in : wskaźnik na źródło wierszy
+ */
+void InputDestroy(Input *in);
+
+#endif //__INPUT_H__
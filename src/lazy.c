@@ -0,0 +1,527 @@
+/** @file
+ * Implementacja stosu wyrażeń dla leniwego trybu kalkulatora.
+ *
+ * @author Mateusz Sulimowicz <ms429603@students.mimuw.edu.pl>
+ * @date 2021
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "array.h"
+#include "lazy.h"
+
+/** Początkowy rozmiar alokowanej tablicy */
+#define INIT_SIZE 16
+
+/**
+ * Liczba składników nieobliczonej sumy, po przekroczeniu której suma
+ * jest obliczana od razu. Ogranicza pamięć zajmowaną przez argumenty
+ * odłożonych działań.
+ */
+#define MAX_TERMS 256
+
+/** To jest typ wyliczeniowy opisujący rodzaj węzła wyrażenia. */
+typedef enum ExprKind {
+    EXPR_VALUE, ///< obliczony wielomian
+    EXPR_ADD, ///< suma dwóch węzłów
+    EXPR_MUL, ///< iloczyn dwóch węzłów
+    EXPR_NEG ///< węzeł przeciwny do argumentu
+} ExprKind;
+
+/** To jest struktura reprezentująca węzeł wyrażenia. */
+typedef struct Expr {
+    ExprKind kind; ///< rodzaj węzła
+    bool visited; ///< czy argumenty węzła zostały już wstawione do obliczenia
+    size_t refs; ///< liczba odwołań do węzła ze stosu i z innych węzłów
+    size_t terms; ///< liczba składników sumy, którą jest węzeł
+    Poly p; ///< wartość węzła, jeśli został obliczony
+    struct Expr *arg[2]; ///< argumenty operacji
+    struct Expr *next; ///< następny węzeł na liście zwolnionych lub usuwanych węzłów
+    unsigned long stamp; ///< znacznik ostatniego obliczania wartości węzła modulo
+    unsigned long deg; ///< ograniczenie stopnia węzła
+    ProbValue val; ///< wartość węzła modulo, ważna przy znaczniku równym `stamp` stosu
+} Expr;
+
+/** To jest struktura opisująca węzeł przeglądany przy zbieraniu składników sumy. */
+typedef struct ExprWalk {
+    Expr *e; ///< węzeł
+    bool neg; ///< czy węzeł występuje w sumie ze znakiem minus
+} ExprWalk;
+
+/** To jest struktura przechowująca zawartość nieaktywnego stosu. */
+typedef struct ExprSaved {
+    Expr **arr; ///< tablica węzłów na stosie
+    size_t size; ///< rozmiar tablicy węzłów
+    size_t count; ///< liczba węzłów na stosie
+} ExprSaved;
+
+void ExprStackInit(ExprStack *s) {
+    *s = (ExprStack) {0};
+}
+
+/**
+ * Tworzy węzeł z jednym odwołaniem, używając ponownie zwolnionego węzła,
+ * jeśli to możliwe.
+ * @param[in,out] s : stos
+ * @param[in] kind : rodzaj węzła
+ * @return węzeł
+ */
+static Expr *ExprNew(ExprStack *s, ExprKind kind) {
+    Expr *e = s->spare;
+    if (e != NULL) {
+        s->spare = e->next;
+    } else {
+        e = malloc(sizeof(Expr));
+        CHECK_PTR(e);
+    }
+    *e = (Expr) {.kind = kind, .refs = 1, .terms = 1};
+    return e;
+}
+
+/**
+ * Zwraca liczbę argumentów węzła.
+ * @param[in] e : węzeł
+ * @return liczba argumentów
+ */
+static inline size_t ExprArity(const Expr *e) {
+    switch (e->kind) {
+        case EXPR_VALUE:
+            return 0;
+        case EXPR_NEG:
+            return 1;
+        default:
+            return 2;
+    }
+}
+
+/**
+ * Usuwa odwołanie do węzła. Węzły, do których nie ma już odwołań,
+ * trafiają na listę zwolnionych węzłów. Nie korzysta z rekurencji,
+ * więc obsługuje dowolnie głębokie wyrażenia.
+ * @param[in,out] s : stos
+ * @param[in] e : węzeł
+ */
+static void ExprRelease(ExprStack *s, Expr *e) {
+    if (--e->refs > 0) {
+        return;
+    }
+    e->next = NULL;
+    Expr *dead = e;
+    while (dead != NULL) {
+        Expr *d = dead;
+        dead = d->next;
+        if (d->kind == EXPR_VALUE) {
+            PolyDestroy(&d->p);
+        }
+        for (size_t i = 0; i < ExprArity(d); ++i) {
+            Expr *a = d->arg[i];
+            if (--a->refs == 0) {
+                a->next = dead;
+                dead = a;
+            }
+        }
+        d->next = s->spare;
+        s->spare = d;
+    }
+}
+
+/**
+ * Wstawia do tablicy składników sumy kolejny składnik.
+ * @param[in,out] s : stos
+ * @param[in] count : liczba składników w tablicy
+ * @param[in] t : składnik
+ */
+static void ExprTermAdd(ExprStack *s, size_t count, PolyTerm t) {
+    ArrayReserve((void **) &s->terms, &s->terms_size, count, sizeof(PolyTerm), INIT_SIZE);
+    s->terms[count] = t;
+}
+
+/**
+ * Zbiera składniki sumy, którą jest wartość węzła @p root.
+ * Sumy i negacje, do których jest tylko jedno odwołanie, są rozwijane,
+ * a takie iloczyny stają się składnikami-iloczynami. Pozostałe węzły
+ * są składnikami. Wartości zbieranych węzłów nie muszą być obliczone;
+ * po ich obliczeniu trzeba zebrać składniki ponownie.
+ * @param[in,out] s : stos
+ * @param[in] root : węzeł
+ * @return liczba składników
+ */
+static size_t ExprCollect(ExprStack *s, Expr *root) {
+    size_t count = 0;
+    size_t walk_count = 0;
+    ArrayReserve((void **) &s->walk, &s->walk_size, walk_count, sizeof(ExprWalk), INIT_SIZE);
+    s->walk[walk_count++] = (ExprWalk) {.e = root, .neg = false};
+    while (walk_count > 0) {
+        ExprWalk w = s->walk[--walk_count];
+        Expr *e = w.e;
+        bool inner = e == root || (e->refs == 1 && e->kind != EXPR_VALUE);
+        if (inner && e->kind == EXPR_ADD) {
+            for (size_t i = 0; i < 2; ++i) {
+                ArrayReserve((void **) &s->walk, &s->walk_size, walk_count, sizeof(ExprWalk), INIT_SIZE);
+                s->walk[walk_count++] = (ExprWalk) {.e = e->arg[i], .neg = w.neg};
+            }
+        } else if (inner && e->kind == EXPR_NEG) {
+            ArrayReserve((void **) &s->walk, &s->walk_size, walk_count, sizeof(ExprWalk), INIT_SIZE);
+            s->walk[walk_count++] = (ExprWalk) {.e = e->arg[0], .neg = !w.neg};
+        } else if (inner && e->kind == EXPR_MUL) {
+            ExprTermAdd(s, count++, (PolyTerm) {.p = &e->arg[0]->p, .q = &e->arg[1]->p, .neg = w.neg});
+        } else {
+            // Wartość węzła, do którego prowadzi jedyne odwołanie,
+            // możemy przenieść do sumy zamiast ją kopiować.
+            ExprTermAdd(s, count++, (PolyTerm) {.p = &e->p, .neg = w.neg, .own = e->refs == 1});
+        }
+    }
+    return count;
+}
+
+/**
+ * Zwraca węzeł, do którego należy wielomian zebrany jako składnik.
+ * @param[in] p : wskaźnik na pole `p` węzła
+ * @return węzeł
+ */
+static inline Expr *ExprOf(const Poly *p) {
+    return (Expr *) ((const char *) p - offsetof(Expr, p));
+}
+
+/**
+ * Wstawia węzeł na stos węzłów czekających na obliczenie,
+ * jeśli nie jest jeszcze obliczony.
+ * @param[in,out] s : stos
+ * @param[in,out] count : liczba węzłów czekających na obliczenie
+ * @param[in] e : węzeł
+ */
+static void ExprWorkPush(ExprStack *s, size_t *count, Expr *e) {
+    if (e->kind != EXPR_VALUE) {
+        ArrayReserve((void **) &s->work, &s->work_size, *count, sizeof(Expr *), INIT_SIZE);
+        s->work[(*count)++] = e;
+    }
+}
+
+/**
+ * Oblicza wartość węzła. Węzły, od których zależy wynik, obliczane są
+ * najpierw, bez rekurencji. Po obliczeniu węzeł przechowuje wartość,
+ * a jego argumenty są zwalniane.
+ * @param[in,out] s : stos
+ * @param[in] root : węzeł
+ */
+static void ExprForce(ExprStack *s, Expr *root) {
+    size_t work_count = 0;
+    ExprWorkPush(s, &work_count, root);
+    while (work_count > 0) {
+        Expr *e = s->work[work_count - 1];
+        if (e->kind == EXPR_VALUE) {
+            --work_count;
+            continue;
+        }
+        size_t count = ExprCollect(s, e);
+        if (!e->visited) {
+            e->visited = true;
+            for (size_t i = 0; i < count; ++i) {
+                ExprWorkPush(s, &work_count, ExprOf(s->terms[i].p));
+                if (s->terms[i].q != NULL) {
+                    ExprWorkPush(s, &work_count, ExprOf(s->terms[i].q));
+                }
+            }
+            continue;
+        }
+        --work_count;
+        Poly r = PolySumTerms(count, s->terms);
+        for (size_t i = 0; i < ExprArity(e); ++i) {
+            ExprRelease(s, e->arg[i]);
+        }
+        e->kind = EXPR_VALUE;
+        e->p = r;
+    }
+}
+
+/**
+ * Wstawia węzeł na stos.
+ * @param[in,out] s : stos
+ * @param[in] e : węzeł
+ */
+static void ExprStackPushNode(ExprStack *s, Expr *e) {
+    ArrayReserve((void **) &s->arr, &s->size, s->count, sizeof(Expr *), INIT_SIZE);
+    s->arr[s->count++] = e;
+}
+
+/**
+ * Sprawdza, czy węzeł jest obliczonym wielomianem stałym.
+ * @param[in] e : węzeł
+ * @return Czy węzeł jest obliczonym wielomianem stałym?
+ */
+static inline bool ExprIsCoeff(const Expr *e) {
+    return e->kind == EXPR_VALUE && PolyIsCoeff(&e->p);
+}
+
+/**
+ * Zwraca liczbę składników, które węzeł wnosi do sumy, w której jest
+ * argumentem. Węzły współdzielone obliczane są osobno, więc wnoszą jeden.
+ * @param[in] e : węzeł
+ * @return liczba składników
+ */
+static inline size_t ExprTerms(const Expr *e) {
+    return e->refs == 1 ? e->terms : 1;
+}
+
+/**
+ * Tworzy węzeł przeciwny do @p e, przejmując odwołanie do @p e.
+ * Negacja negacji i negacja stałej są upraszczane od razu.
+ * @param[in,out] s : stos
+ * @param[in] e : węzeł
+ * @return węzeł przeciwny
+ */
+static Expr *ExprNegate(ExprStack *s, Expr *e) {
+    if (e->kind == EXPR_NEG && e->refs == 1) {
+        Expr *a = e->arg[0];
+        e->kind = EXPR_VALUE;
+        e->p = PolyZero();
+        e->refs = 0;
+        e->next = s->spare;
+        s->spare = e;
+        return a;
+    }
+    Expr *r = ExprNew(s, EXPR_NEG);
+    if (ExprIsCoeff(e)) {
+        r->kind = EXPR_VALUE;
+        r->p = PolyFromCoeff((-1) * e->p.coeff);
+        ExprRelease(s, e);
+    } else {
+        r->arg[0] = e;
+        r->terms = ExprTerms(e);
+    }
+    return r;
+}
+
+/**
+ * Tworzy węzeł sumy lub iloczynu, przejmując odwołania do argumentów.
+ * Działania na stałych wykonywane są od razu.
+ * @param[in,out] s : stos
+ * @param[in] kind : rodzaj węzła
+ * @param[in] p : pierwszy argument
+ * @param[in] q : drugi argument
+ * @return węzeł
+ */
+static Expr *ExprBinary(ExprStack *s, ExprKind kind, Expr *p, Expr *q) {
+    Expr *r = ExprNew(s, kind);
+    if (ExprIsCoeff(p) && ExprIsCoeff(q)) {
+        r->kind = EXPR_VALUE;
+        r->p = kind == EXPR_ADD ? PolyFromCoeff(p->p.coeff + q->p.coeff)
+                                : PolyFromCoeff(p->p.coeff * q->p.coeff);
+        ExprRelease(s, p);
+        ExprRelease(s, q);
+    } else {
+        r->arg[0] = p;
+        r->arg[1] = q;
+        if (kind == EXPR_ADD) {
+            r->terms = ExprTerms(p) + ExprTerms(q);
+        }
+        if (r->terms > MAX_TERMS) {
+            ExprForce(s, r);
+        }
+    }
+    return r;
+}
+
+void ExprStackPush(ExprStack *s, const Poly *p) {
+    assert(p != NULL);
+    Expr *e = ExprNew(s, EXPR_VALUE);
+    e->p = *p;
+    ExprStackPushNode(s, e);
+}
+
+void ExprStackClone(ExprStack *s) {
+    assert(s->count >= 1);
+    Expr *e = s->arr[s->count - 1];
+    ++e->refs;
+    ExprStackPushNode(s, e);
+}
+
+void ExprStackPop(ExprStack *s) {
+    assert(s->count >= 1);
+    ExprRelease(s, s->arr[--s->count]);
+}
+
+void ExprStackAdd(ExprStack *s) {
+    assert(s->count >= 2);
+    s->count -= 2;
+    s->arr[s->count] = ExprBinary(s, EXPR_ADD, s->arr[s->count + 1], s->arr[s->count]);
+    ++s->count;
+}
+
+void ExprStackMul(ExprStack *s) {
+    assert(s->count >= 2);
+    s->count -= 2;
+    s->arr[s->count] = ExprBinary(s, EXPR_MUL, s->arr[s->count + 1], s->arr[s->count]);
+    ++s->count;
+}
+
+void ExprStackNeg(ExprStack *s) {
+    assert(s->count >= 1);
+    s->arr[s->count - 1] = ExprNegate(s, s->arr[s->count - 1]);
+}
+
+void ExprStackSub(ExprStack *s) {
+    assert(s->count >= 2);
+    s->count -= 2;
+    // Odjęcie negacji staje się dodawaniem, bez liczenia negacji.
+    Expr *q = ExprNegate(s, s->arr[s->count]);
+    s->arr[s->count] = ExprBinary(s, EXPR_ADD, s->arr[s->count + 1], q);
+    ++s->count;
+}
+
+const Poly *ExprStackPeek(ExprStack *s, size_t depth) {
+    assert(depth < s->count);
+    Expr *e = s->arr[s->count - 1 - depth];
+    ExprForce(s, e);
+    return &e->p;
+}
+
+Poly ExprStackTake(ExprStack *s) {
+    assert(s->count >= 1);
+    Expr *e = s->arr[--s->count];
+    ExprForce(s, e);
+    Poly r;
+    if (e->refs == 1) {
+        r = e->p;
+        e->p = PolyZero();
+    } else {
+        r = PolyClone(&e->p);
+    }
+    ExprRelease(s, e);
+    return r;
+}
+
+/**
+ * Oblicza wartość węzła modulo w punkcie o zadanym ziarnie, nie obliczając
+ * samego węzła. Argumenty liczone są przed węzłem, bez rekurencji.
+ * Węzeł w trakcie liczenia ma znacznik o jeden mniejszy od znacznika stosu,
+ * a policzony – równy mu, więc współdzielone węzły liczone są raz.
+ * @param[in,out] s : stos
+ * @param[in] root : węzeł
+ * @param[in] point : ziarno punktu
+ * @param[in] with_deg : czy wyznaczyć ograniczenia stopni obliczonych wielomianów
+ * @return wartość węzła
+ */
+static ProbValue ExprEvalMod(ExprStack *s, Expr *root, uint64_t point, bool with_deg) {
+    size_t work_count = 0;
+    ArrayReserve((void **) &s->work, &s->work_size, work_count, sizeof(Expr *), INIT_SIZE);
+    s->work[work_count++] = root;
+    while (work_count > 0) {
+        Expr *e = s->work[work_count - 1];
+        if (e->stamp == s->stamp) {
+            --work_count;
+            continue;
+        }
+        if (e->kind != EXPR_VALUE && e->stamp != s->stamp - 1) {
+            e->stamp = s->stamp - 1;
+            for (size_t i = 0; i < ExprArity(e); ++i) {
+                if (e->arg[i]->stamp != s->stamp) {
+                    ArrayReserve((void **) &s->work, &s->work_size, work_count, sizeof(Expr *), INIT_SIZE);
+                    s->work[work_count++] = e->arg[i];
+                }
+            }
+            continue;
+        }
+        --work_count;
+        Expr *a = e->arg[0];
+        Expr *b = e->arg[1];
+        switch (e->kind) {
+            case EXPR_VALUE:
+                e->val = PolyEvalMod(&e->p, point);
+                if (with_deg) {
+                    poly_exp_t deg = PolyDeg(&e->p);
+                    e->deg = deg > 0 ? (unsigned long) deg : 0;
+                }
+                break;
+            case EXPR_ADD:
+                e->val = ProbAdd(a->val, b->val);
+                e->deg = a->deg > b->deg ? a->deg : b->deg;
+                break;
+            case EXPR_MUL:
+                e->val = ProbMul(a->val, b->val);
+                e->deg = a->deg > ULONG_MAX - b->deg ? ULONG_MAX : a->deg + b->deg;
+                break;
+            case EXPR_NEG:
+                e->val = ProbNeg(a->val);
+                e->deg = a->deg;
+                break;
+        }
+        e->stamp = s->stamp;
+    }
+    return root->val;
+}
+
+bool ExprStackProbablyEq(ExprStack *s, size_t count, size_t rounds, uint64_t *seed, unsigned long *bits) {
+    assert((count == 1 || count == 2) && s->count >= count);
+    Expr *p = s->arr[s->count - 1];
+    Expr *q = count == 2 ? s->arr[s->count - 2] : NULL;
+    for (size_t i = 0; i < rounds; ++i) {
+        uint64_t point = ProbNext(seed);
+        s->stamp += 2;
+        ProbValue p_val = ExprEvalMod(s, p, point, i == 0);
+        ProbValue q_val = q != NULL ? ExprEvalMod(s, q, point, i == 0) : ProbFromCoeff(0);
+        if (!ProbIsEq(p_val, q_val)) {
+            *bits = PROB_EXACT;
+            return false;
+        }
+    }
+    unsigned long deg = q != NULL && q->deg > p->deg ? q->deg : p->deg;
+    *bits = ProbErrorBits(deg, rounds);
+    return true;
+}
+
+struct Expr *ExprStackTakeRef(ExprStack *s) {
+    assert(s->count >= 1);
+    return s->arr[--s->count];
+}
+
+void ExprStackPushRef(ExprStack *s, struct Expr *e) {
+    ++e->refs;
+    ExprStackPushNode(s, e);
+}
+
+void ExprStackRelease(ExprStack *s, struct Expr *e) {
+    ExprRelease(s, e);
+}
+
+void ExprStackSelect(ExprStack *s, size_t k) {
+    if (k == s->current) {
+        return;
+    }
+    size_t needed = (k > s->current ? k : s->current) + 1;
+    if (needed > s->saved_size) {
+        s->saved = realloc(s->saved, needed * sizeof(ExprSaved));
+        CHECK_PTR(s->saved);
+        memset(s->saved + s->saved_size, 0, (needed - s->saved_size) * sizeof(ExprSaved));
+        s->saved_size = needed;
+    }
+    s->saved[s->current] = (ExprSaved) {.arr = s->arr, .size = s->size, .count = s->count};
+    s->arr = s->saved[k].arr;
+    s->size = s->saved[k].size;
+    s->count = s->saved[k].count;
+    s->current = k;
+}
+
+void ExprStackDestroy(ExprStack *s) {
+    for (size_t k = 0; k < s->saved_size; ++k) {
+        if (k != s->current) {
+            for (size_t i = 0; i < s->saved[k].count; ++i) {
+                ExprRelease(s, s->saved[k].arr[i]);
+            }
+            free(s->saved[k].arr);
+        }
+    }
+    free(s->saved);
+    while (s->count > 0) {
+        ExprStackPop(s);
+    }
+    while (s->spare != NULL) {
+        Expr *e = s->spare;
+        s->spare = e->next;
+        free(e);
+    }
+    free(s->arr);
+    free(s->work);
+    free(s->walk);
+    free(s->terms);
+}
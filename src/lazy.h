@@ -0,0 +1,176 @@
+/** @file
+ * Interfejs stosu wyrażeń dla leniwego trybu kalkulatora.
+ *
+ * Struktura ExprStack przechowuje kilka stosów o kolejnych numerach,
+ * z których jeden jest aktywny; wszystkie działania dotyczą aktywnego.
+ * Stosy współdzielą węzły, więc wyrażenie może trafić na inny stos
+ * lub do rejestru kalkulatora bez kopiowania.
+ * Elementami stosu są węzły wyrażeń: obliczone wielomiany albo
+ * nieobliczone sumy, iloczyny i negacje innych węzłów. Węzły są
+ * współdzielone (np. po poleceniu CLONE) i zliczają odwołania.
+ * Wartość węzła obliczana jest dopiero wtedy, gdy jest potrzebna.
+ * Obliczając węzeł, łączymy sumy i negacje węzłów, do których nie ma
+ * innych odwołań, w jedną sumę wielu składników, a iloczyny w takiej
+ * sumie stają się jej składnikami – patrz PolySumTerms.
+ *
+ * @author Mateusz Sulimowicz <ms429603@students.mimuw.edu.pl>
+ * @date 2021
+ */
+
+#ifndef __LAZY_H__
+#define __LAZY_H__
+
+#include <stddef.h>
+#include "poly.h"
+#include "prob.h"
+
+struct Expr;
+
+struct ExprWalk;
+
+struct ExprSaved;
+
+/** To jest struktura reprezentująca stos wyrażeń. */
+typedef struct ExprStack {
+    struct Expr **arr; ///< tablica węzłów na stosie
+    size_t size; ///< rozmiar tablicy węzłów
+    size_t count; ///< liczba węzłów na stosie
+    struct Expr *spare; ///< lista zwolnionych węzłów do ponownego użycia
+    struct Expr **work; ///< stos węzłów czekających na obliczenie
+    size_t work_size; ///< rozmiar stosu węzłów czekających na obliczenie
+    struct ExprWalk *walk; ///< stos węzłów przeglądanych przy zbieraniu składników sumy
+    size_t walk_size; ///< rozmiar stosu przeglądanych węzłów
+    PolyTerm *terms; ///< składniki obliczanej sumy
+    size_t terms_size; ///< rozmiar tablicy składników
+    unsigned long stamp; ///< znacznik bieżącego obliczania wartości węzłów modulo
+    struct ExprSaved *saved; ///< zawartość nieaktywnych stosów według ich numerów
+    size_t saved_size; ///< rozmiar tablicy nieaktywnych stosów
+    size_t current; ///< numer aktywnego stosu
+} ExprStack;
+
+/**
+ * Inicjuje pusty stos wyrażeń.
+ * @param[out] s : stos
+ */
+void ExprStackInit(ExprStack *s);
+
+/**
+ * Usuwa z pamięci stos wyrażeń wraz z węzłami.
+ * @param[in,out] s : stos
+ */
+void ExprStackDestroy(ExprStack *s);
+
+/**
+ * Zwraca liczbę wyrażeń na stosie.
+ * @param[in] s : stos
+ * @return liczba wyrażeń na stosie
+ */
+static inline size_t ExprStackCount(const ExprStack *s) {
+    return s->count;
+}
+
+/**
+ * Wstawia na stos wielomian, przejmując go na własność.
+ * @param[in,out] s : stos
+ * @param[in] p : wielomian
+ */
+void ExprStackPush(ExprStack *s, const Poly *p);
+
+/**
+ * Wstawia na stos kolejne odwołanie do wyrażenia z wierzchołka.
+ * @param[in,out] s : stos
+ */
+void ExprStackClone(ExprStack *s);
+
+/**
+ * Usuwa wyrażenie z wierzchołka stosu.
+ * @param[in,out] s : stos
+ */
+void ExprStackPop(ExprStack *s);
+
+/**
+ * Zastępuje dwa wyrażenia z wierzchu stosu ich sumą.
+ * @param[in,out] s : stos
+ */
+void ExprStackAdd(ExprStack *s);
+
+/**
+ * Zastępuje dwa wyrażenia z wierzchu stosu ich iloczynem.
+ * @param[in,out] s : stos
+ */
+void ExprStackMul(ExprStack *s);
+
+/**
+ * Zastępuje wyrażenie z wierzchołka stosu wyrażeniem przeciwnym.
+ * @param[in,out] s : stos
+ */
+void ExprStackNeg(ExprStack *s);
+
+/**
+ * Zastępuje dwa wyrażenia z wierzchu stosu różnicą wyrażenia
+ * z wierzchołka i wyrażenia pod wierzchołkiem.
+ * @param[in,out] s : stos
+ */
+void ExprStackSub(ExprStack *s);
+
+/**
+ * Oblicza wyrażenie leżące na stosie. Stos się nie zmienia.
+ * @param[in,out] s : stos
+ * @param[in] depth : odległość wyrażenia od wierzchołka stosu
+ * @return wartość wyrażenia, ważna do czasu zdjęcia go ze stosu
+ */
+const Poly *ExprStackPeek(ExprStack *s, size_t depth);
+
+/**
+ * Zdejmuje wyrażenie z wierzchołka stosu i oblicza je.
+ * Jeśli nie ma innych odwołań do wyrażenia, jego wartość nie jest kopiowana.
+ * @param[in,out] s : stos
+ * @return wartość wyrażenia
+ */
+Poly ExprStackTake(ExprStack *s);
+
+/**
+ * Zdejmuje wyrażenie z wierzchołka stosu bez obliczania go.
+ * Odwołanie do wyrażenia przechodzi na wywołującego.
+ * @param[in,out] s : stos
+ * @return wyrażenie
+ */
+struct Expr *ExprStackTakeRef(ExprStack *s);
+
+/**
+ * Wstawia na stos kolejne odwołanie do wyrażenia.
+ * @param[in,out] s : stos
+ * @param[in] e : wyrażenie
+ */
+void ExprStackPushRef(ExprStack *s, struct Expr *e);
+
+/**
+ * Usuwa odwołanie do wyrażenia, zwalniając je, jeśli było ostatnie.
+ * @param[in,out] s : stos
+ * @param[in] e : wyrażenie
+ */
+void ExprStackRelease(ExprStack *s, struct Expr *e);
+
+/**
+ * Uaktywnia stos o zadanym numerze. Stos, który nie był dotąd używany, jest pusty.
+ * @param[in,out] s : stos
+ * @param[in] k : numer stosu
+ */
+void ExprStackSelect(ExprStack *s, size_t k);
+
+/**
+ * Sprawdza probabilistycznie, czy dwa wyrażenia z wierzchu stosu są
+ * równe, albo – dla @p count równego 1 – czy wyrażenie z wierzchołka
+ * jest równe zeru. Wyrażenia nie są obliczane: wartości w pseudolosowych
+ * punktach liczone są bezpośrednio z węzłów, a każdy współdzielony węzeł
+ * odwiedzany jest raz na rundę. Stos się nie zmienia. Por. PolyProbablyEq.
+ * @param[in,out] s : stos
+ * @param[in] count : liczba porównywanych wyrażeń (1 lub 2)
+ * @param[in] rounds : liczba rund
+ * @param[in,out] seed : stan generatora, z którego losowane są punkty
+ * @param[out] bits : wykładnik ograniczenia prawdopodobieństwa błędu lub #PROB_EXACT
+ * @return Czy wyrażenia są (prawdopodobnie) równe?
+ */
+bool ExprStackProbablyEq(ExprStack *s, size_t count, size_t rounds, uint64_t *seed, unsigned long *bits);
+
+#endif //__LAZY_H__
@@ -0,0 +1,149 @@
+/** @file
+ * Implementacja słownika odwzorowującego nazwy na liczby.
+ *
+ * Kolizje rozwiązywane są liniowym próbkowaniem, a usuwanie przesuwa
+ * kolejne wpisy wstecz, dzięki czemu słownik nie potrzebuje znaczników
+ * usuniętych wpisów.
+ *
+ * @author Mateusz Sulimowicz <ms429603@students.mimuw.edu.pl>
+ * @date 2021
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "namemap.h"
+#include "poly.h"
+
+/** Mnożnik rozmiaru tablicy do realokacji. */
+#define MULTIPLIER 2
+
+/** Początkowy rozmiar alokowanej tablicy */
+#define INIT_SIZE 16
+
+/** Mnożnik funkcji haszującej FNV-1a. */
+#define FNV_PRIME 1099511628211ull
+
+/** Początkowa wartość funkcji haszującej FNV-1a. */
+#define FNV_OFFSET 14695981039346656037ull
+
+/**
+ * Haszuje nazwę.
+ * @param[in] name : nazwa
+ * @param[in] len : długość nazwy
+ * @return wartość funkcji haszującej
+ */
+static size_t NameHash(const char *name, size_t len) {
+    unsigned long long h = FNV_OFFSET;
+    for (size_t i = 0; i < len; ++i) {
+        h = (h ^ (unsigned char) name[i]) * FNV_PRIME;
+    }
+    return (size_t) h;
+}
+
+void NameMapInit(NameMap *m) {
+    m->arr = calloc(INIT_SIZE, sizeof(NameEntry));
+    CHECK_PTR(m->arr);
+    m->size = INIT_SIZE;
+    m->count = 0;
+}
+
+/**
+ * Wyszukuje miejsce nazwy w tablicy wpisów: wpis z tą nazwą
+ * albo puste miejsce, w którym należy ją wstawić.
+ * @param[in] m : słownik
+ * @param[in] name : nazwa
+ * @param[in] len : długość nazwy
+ * @param[in] hash : wartość funkcji haszującej nazwy
+ * @return indeks miejsca w tablicy wpisów
+ */
+static size_t NameMapSlot(const NameMap *m, const char *name, size_t len, size_t hash) {
+    size_t mask = m->size - 1;
+    size_t i = hash & mask;
+    while (m->arr[i].name != NULL
+           && (m->arr[i].hash != hash || m->arr[i].len != len || memcmp(m->arr[i].name, name, len) != 0)) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+bool NameMapFind(const NameMap *m, const char *name, size_t len, size_t *val) {
+    size_t i = NameMapSlot(m, name, len, NameHash(name, len));
+    if (m->arr[i].name == NULL) {
+        return false;
+    }
+    *val = m->arr[i].val;
+    return true;
+}
+
+/**
+ * Powiększa tablicę wpisów słownika i rozmieszcza w niej wpisy od nowa.
+ * @param[in,out] m : słownik
+ */
+static void NameMapExpand(NameMap *m) {
+    NameEntry *old = m->arr;
+    size_t old_size = m->size;
+    m->size *= MULTIPLIER;
+    m->arr = calloc(m->size, sizeof(NameEntry));
+    CHECK_PTR(m->arr);
+    for (size_t i = 0; i < old_size; ++i) {
+        if (old[i].name != NULL) {
+            size_t j = old[i].hash & (m->size - 1);
+            while (m->arr[j].name != NULL) {
+                j = (j + 1) & (m->size - 1);
+            }
+            m->arr[j] = old[i];
+        }
+    }
+    free(old);
+}
+
+void NameMapSet(NameMap *m, const char *name, size_t len, size_t val) {
+    size_t hash = NameHash(name, len);
+    size_t i = NameMapSlot(m, name, len, hash);
+    if (m->arr[i].name == NULL) {
+        // Tablica jest zapełniona co najwyżej w połowie.
+        if (2 * (m->count + 1) > m->size) {
+            NameMapExpand(m);
+            i = NameMapSlot(m, name, len, hash);
+        }
+        char *copy = malloc(len + 1);
+        CHECK_PTR(copy);
+        memcpy(copy, name, len);
+        copy[len] = '\0';
+        m->arr[i] = (NameEntry) {.name = copy, .len = len, .hash = hash};
+        ++m->count;
+    }
+    m->arr[i].val = val;
+}
+
+bool NameMapRemove(NameMap *m, const char *name, size_t len) {
+    size_t mask = m->size - 1;
+    size_t i = NameMapSlot(m, name, len, NameHash(name, len));
+    if (m->arr[i].name == NULL) {
+        return false;
+    }
+    free(m->arr[i].name);
+    // Przesuwamy wstecz wpisy, które trafiłyby na zwolnione miejsce.
+    size_t j = i;
+    for (;;) {
+        m->arr[i].name = NULL;
+        size_t k;
+        do {
+            j = (j + 1) & mask;
+            if (m->arr[j].name == NULL) {
+                --m->count;
+                return true;
+            }
+            k = m->arr[j].hash & mask;
+        } while (i <= j ? (i < k && k <= j) : (i < k || k <= j));
+        m->arr[i] = m->arr[j];
+        i = j;
+    }
+}
+
+void NameMapDestroy(NameMap *m) {
+    for (size_t i = 0; i < m->size; ++i) {
+        free(m->arr[i].name);
+    }
+    free(m->arr);
+}
@@ -0,0 +1,73 @@
+/** @file
+ * Interfejs słownika odwzorowującego nazwy na liczby.
+ *
+ * Słownik jest tablicą haszującą z adresowaniem otwartym.
+ * Nazwy są kopiowane, więc nie muszą być zakończone znakiem `\0`
+ * ani istnieć po wstawieniu do słownika.
+ *
+ * @author Mateusz Sulimowicz <ms429603@students.mimuw.edu.pl>
+ * @date 2021
+ */
+
+#ifndef __NAMEMAP_H__
+#define __NAMEMAP_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/** To jest struktura przechowująca wpis słownika. */
+typedef struct NameEntry {
+    char *name; ///< nazwa lub NULL dla pustego miejsca
+    size_t len; ///< długość nazwy
+    size_t hash; ///< wartość funkcji haszującej nazwy
+    size_t val; ///< wartość przypisana nazwie
+} NameEntry;
+
+/** To jest struktura reprezentująca słownik. */
+typedef struct NameMap {
+    NameEntry *arr; ///< tablica wpisów
+    size_t size; ///< rozmiar tablicy wpisów (potęga dwójki)
+    size_t count; ///< liczba nazw w słowniku
+} NameMap;
+
+/**
+ * Inicjuje pusty słownik.
+ * @param[out] m : słownik
+ */
+void NameMapInit(NameMap *m);
+
+/**
+ * Wyszukuje nazwę w słowniku.
+ * @param[in] m : słownik
+ * @param[in] name : nazwa
+ * @param[in] len : długość nazwy
+ * @param[out] val : wartość przypisana nazwie, jeśli nazwa jest w słowniku
+ * @return Czy nazwa jest w słowniku?
+ */
+bool NameMapFind(const NameMap *m, const char *name, size_t len, size_t *val);
+
+/**
+ * Przypisuje nazwie wartość, zastępując poprzednią wartość.
+ * @param[in,out] m : słownik
+ * @param[in] name : nazwa
+ * @param[in] len : długość nazwy
+ * @param[in] val : wartość
+ */
+void NameMapSet(NameMap *m, const char *name, size_t len, size_t val);
+
+/**
+ * Usuwa nazwę ze słownika.
+ * @param[in,out] m : słownik
+ * @param[in] name : nazwa
+ * @param[in] len : długość nazwy
+ * @return Czy nazwa była w słowniku?
+ */
+bool NameMapRemove(NameMap *m, const char *name, size_t len);
+
+/**
+ * Zwalnia pamięć zajmowaną przez słownik.
+ * @param[in] m : słownik
+ */
+void NameMapDestroy(NameMap *m);
+
+#endif //__NAMEMAP_H__
@@ -0,0 +1,213 @@
+/** @file
+ * Implementacja parsowania i formatowania liczb całkowitych.
+ *
+ * Na maszynach little-endian cyfry są parsowane po osiem naraz
+ * (technika SWAR – SIMD within a register): słowo 64-bitowe jest
+ * sprawdzane, ile zaczyna się od cyfr, a następnie zamieniane na liczbę
+ * trzema mnożeniami. Przepełnienie jest wykrywane dokładnie.
+ *
+ * @author Mateusz Sulimowicz <ms429603@students.mimuw.edu.pl>
+ * @date 2021
+ */
+
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#include "number.h"
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+/** Czy można parsować po osiem cyfr naraz? */
+#define NUMBER_SWAR 1
+#else
+/** Czy można parsować po osiem cyfr naraz? */
+#define NUMBER_SWAR 0
+#endif
+
+/** Liczba bajtów w słowie przetwarzanym naraz. */
+#define WORD_DIGITS 8
+
+/** Bajt o wartości @p b powtórzony w każdym bajcie słowa. */
+#define BYTES(b) (0x0101010101010101ULL * (b))
+
+/** Kolejne potęgi dziesiątki, aż do @f$10^8@f$. */
+static const uint64_t pow10[WORD_DIGITS + 1] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000
+};
+
+/** Zapisy dziesiętne liczb od 00 do 99, po dwa znaki na liczbę. */
+static const char digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/**
+ * Sprawdza, czy znak jest cyfrą dziesiętną.
+ * @param[in] c : znak
+ * @return Czy @p c jest cyfrą?
+ */
+static inline bool IsDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+/**
+ * Daje liczbę cyfr, od których zaczyna się słowo.
+ * Pierwszy znak tekstu jest najmniej znaczącym bajtem słowa. Pożyczki
+ * i przeniesienia przechodzą tylko w stronę bardziej znaczących bajtów,
+ * a cyfry ich nie wytwarzają, więc pierwszy bajt niebędący cyfrą jest
+ * wykrywany dokładnie.
+ * @param[in] w : słowo z ośmioma kolejnymi znakami tekstu
+ * @return liczba początkowych cyfr (od 0 do 8)
+ */
+static inline unsigned WordDigitCount(uint64_t w) {
+    uint64_t below = w - BYTES('0'); // Najwyższy bit ustawiony dla bajtów < '0'.
+    uint64_t above = w + BYTES(0x80 - ('9' + 1)); // ... i dla bajtów > '9'.
+    uint64_t mask = (below | above | w) & BYTES(0x80);
+    return mask == 0 ? WORD_DIGITS : (unsigned) __builtin_ctzll(mask) / 8;
+}
+
+/**
+ * Zamienia @p k początkowych cyfr słowa na liczbę.
+ * @param[in] w : słowo z ośmioma kolejnymi znakami tekstu
+ * @param[in] k : liczba cyfr (od 1 do 8)
+ * @return wartość liczby zapisanej @p k cyframi
+ */
+static inline uint64_t WordDigitsValue(uint64_t w, unsigned k) {
+    // Przesuwamy cyfry na najbardziej znaczące bajty,
+    // zwolnione bajty odpowiadają wiodącym zerom.
+    w = (w << (8 * (WORD_DIGITS - k))) & BYTES(0x0F);
+    w = w * 10 + (w >> 8); // Pary cyfr.
+    w = (w & 0x00FF00FF00FF00FFULL) * 100 + ((w >> 16) & 0x00FF00FF00FF00FFULL); // Czwórki.
+    w = (w & 0x0000FFFF0000FFFFULL) * 10000 + ((w >> 32) & 0x0000FFFF0000FFFFULL); // Ósemka.
+    return (uint32_t) w;
+}
+
+/**
+ * Dopisuje do liczby @p res kolejne cyfry o wartości @p chunk.
+ * Po przepełnieniu ustawia `*overflow = true` i pozostawia wynik nasycony.
+ * @param[in,out] res : wskaźnik na dotychczasową wartość
+ * @param[in] chunk : wartość dopisywanych cyfr
+ * @param[in] scale : @f$10^k@f$, gdzie @f$k@f$ to liczba dopisywanych cyfr
+ * @param[out] overflow : wskaźnik na informację o przekroczeniu zakresu
+ */
+static inline void DigitsAppend(unsigned long *res, uint64_t chunk, uint64_t scale, bool *overflow) {
+    unsigned long temp;
+    if (*res == ULONG_MAX && *overflow) {
+        return;
+    } else if (__builtin_mul_overflow(*res, scale, &temp) || __builtin_add_overflow(temp, chunk, res)) {
+        *overflow = true;
+        *res = ULONG_MAX;
+    }
+}
+
+const char *NumberParseULong(const char *str, const char *end, unsigned long *val, bool *overflow) {
+    unsigned long res = 0;
+    bool res_overflow = false;
+    const char *p = str;
+#if NUMBER_SWAR
+    while (end - p >= WORD_DIGITS) {
+        uint64_t w;
+        memcpy(&w, p, sizeof(w));
+        unsigned k = WordDigitCount(w);
+        if (k == 0) {
+            break;
+        }
+        DigitsAppend(&res, WordDigitsValue(w, k), pow10[k], &res_overflow);
+        p += k;
+        if (k < WORD_DIGITS) {
+            *val = res;
+            *overflow |= res_overflow;
+            return p;
+        }
+    }
+#endif
+    // Końcówka krótsza niż słowo.
+    while (p < end && IsDigit(*p)) {
+        DigitsAppend(&res, (uint64_t) (*p - '0'), DECIMAL_BASE, &res_overflow);
+        ++p;
+    }
+    *val = res;
+    *overflow |= res_overflow;
+    return p;
+}
+
+const char *NumberParseLong(const char *str, const char *end, long *val, bool *overflow) {
+    bool neg = str < end && *str == '-';
+    const char *digits = str + neg;
+    unsigned long abs;
+    bool abs_overflow = false;
+    const char *p = NumberParseULong(digits, end, &abs, &abs_overflow);
+    if (p == digits) { // Brak cyfr – nic nie zostało sparsowane.
+        *val = 0;
+        return str;
+    }
+    // Wartość bezwzględna najmniejszej liczby typu long
+    // jest o jeden większa niż największej.
+    unsigned long limit = neg ? (unsigned long) LONG_MAX + 1 : (unsigned long) LONG_MAX;
+    if (abs_overflow || abs > limit) {
+        *overflow = true;
+        *val = neg ? LONG_MIN : LONG_MAX;
+    } else if (neg) {
+        *val = abs == limit ? LONG_MIN : -(long) abs;
+    } else {
+        *val = (long) abs;
+    }
+    return p;
+}
+
+/**
+ * Daje liczbę cyfr zapisu dziesiętnego liczby.
+ * @param[in] x : liczba
+ * @return liczba cyfr @p x
+ */
+static inline unsigned DigitCount(unsigned long x) {
+    unsigned n = 1;
+    while (true) {
+        if (x < 10) {
+            return n;
+        } else if (x < 100) {
+            return n + 1;
+        } else if (x < 1000) {
+            return n + 2;
+        } else if (x < 10000) {
+            return n + 3;
+        }
+        x /= 10000;
+        n += 4;
+    }
+}
+
+char *NumberFormatULong(unsigned long x, char *buf) {
+    unsigned n = DigitCount(x);
+    char *p = buf + n;
+    // Wypisujemy od końca po dwie cyfry naraz.
+    while (x >= 100) {
+        unsigned pair = (unsigned) (x % 100) * 2;
+        x /= 100;
+        p -= 2;
+        memcpy(p, &digit_pairs[pair], 2);
+    }
+    if (x >= 10) {
+        p -= 2;
+        memcpy(p, &digit_pairs[x * 2], 2);
+    } else {
+        *--p = (char) ('0' + x);
+    }
+    return buf + n;
+}
+
+char *NumberFormatLong(long x, char *buf) {
+    if (x < 0) {
+        *buf++ = '-';
+        // Negacja w typie bez znaku jest poprawna także dla LONG_MIN.
+        return NumberFormatULong(0UL - (unsigned long) x, buf);
+    } else {
+        return NumberFormatULong((unsigned long) x, buf);
+    }
+}
@@ -0,0 +1,72 @@
+/** @file
+ * Interfejs parsowania i formatowania liczb całkowitych.
+ *
+ * Funkcje parsujące działają na napisach zadanych wskaźnikiem na początek
+ * i koniec, więc nie wymagają, aby tekst kończył się znakiem `\0`.
+ *
+ * @author Mateusz Sulimowicz <ms429603@students.mimuw.edu.pl>
+ * @date 2021
+ */
+
+#ifndef __NUMBER_H__
+#define __NUMBER_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/** Podstawa systemu dziesiętnego. */
+#define DECIMAL_BASE 10
+
+/**
+ * Maksymalna długość zapisu dziesiętnego liczby typu `long`
+ * razem ze znakiem '-' (bez znaku `\0`).
+ */
+#define NUMBER_MAX_LENGTH 20
+
+/**
+ * Parsuje liczbę całkowitą typu `long` z napisu `[str, end)`.
+ * Liczba może być poprzedzona znakiem '-'. Tak jak `strtol`, jeśli po
+ * opcjonalnym znaku nie występuje żadna cyfra, zwraca @p str.
+ * Jeśli wartość nie mieści się w zakresie typu, ustawia `*overflow = true`.
+ * @param[in] str : początek napisu
+ * @param[in] end : koniec napisu
+ * @param[out] val : sparsowana wartość
+ * @param[out] overflow : wskaźnik na informację o przekroczeniu zakresu
+ * @return wskaźnik na pierwszy niesparsowany znak
+ */
+const char *NumberParseLong(const char *str, const char *end, long *val, bool *overflow);
+
+/**
+ * Parsuje liczbę całkowitą bez znaku typu `unsigned long` z napisu
+ * `[str, end)`. Liczba składa się z samych cyfr. Jeśli napis nie zaczyna się
+ * cyfrą, zwraca @p str. Jeśli wartość nie mieści się w zakresie typu,
+ * ustawia `*overflow = true`.
+ * @param[in] str : początek napisu
+ * @param[in] end : koniec napisu
+ * @param[out] val : sparsowana wartość
+ * @param[out] overflow : wskaźnik na informację o przekroczeniu zakresu
+ * @return wskaźnik na pierwszy niesparsowany znak
+ */
+const char *NumberParseULong(const char *str, const char *end, unsigned long *val, bool *overflow);
+
+/**
+ * Zapisuje liczbę bez znaku w systemie dziesiętnym.
+ * Nie dopisuje znaku `\0`. Bufor musi mieć co najmniej
+ * #NUMBER_MAX_LENGTH bajtów.
+ * @param[in] x : liczba
+ * @param[out] buf : bufor na zapis liczby
+ * @return wskaźnik za ostatnim zapisanym znakiem
+ */
+char *NumberFormatULong(unsigned long x, char *buf);
+
+/**
+ * Zapisuje liczbę całkowitą w systemie dziesiętnym, tak jak `printf("%ld")`.
+ * Nie dopisuje znaku `\0`. Bufor musi mieć co najmniej
+ * #NUMBER_MAX_LENGTH bajtów.
+ * @param[in] x : liczba
+ * @param[out] buf : bufor na zapis liczby
+ * @return wskaźnik za ostatnim zapisanym znakiem
+ */
+char *NumberFormatLong(long x, char *buf);
+
+#endif //__NUMBER_H__
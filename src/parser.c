@@ -8,11 +8,11 @@
 /** Makro potrzebne do korzystania z GNU C Library. */
 #define _GNU_SOURCE
 
-#include <stdio.h>
 #include <stdlib.h>
-#include <errno.h>
 #include <ctype.h>
 #include <limits.h>
+#include "alloc.h"
+#include "number.h"
 #include "parser.h"
 
 /** Mnożnik rozmiaru tablicy do realokacji. */
@@ -21,76 +21,59 @@
 /** Początkowy rozmiar alokowanej tablicy */
 #define INIT_SIZE 4
 
+/** Znak, którym kończy się wiersz z wielomianem. */
+#define LINE_END '\n'
+
+/**
+ * Daje znak z pozycji @p p napisu kończącego się przed @p end.
+ * Koniec napisu traktowany jest tak jak znak końca wiersza, dzięki czemu
+ * parsowany fragment nie musi kończyć się znakiem `\n`.
+ * @param[in] p : pozycja w napisie
+ * @param[in] end : koniec napisu
+ * @return znak z pozycji @p p lub `\n`, jeśli `p >= end`
+ */
+static inline char CharAt(const char *p, const char *end) {
+    return p < end ? *p : LINE_END;
+}
+
 /**
  * Parsuje tekst na wykładnik jednomianu.
  * Po wykonaniu, `*endptr` wskazuje o jedną pozycję dalej niż sparsowany napis.
  * Jeśli wystąpił błąd w trakcie parsowania, ustawia `*err = true`.
  * @param[in] str : napis
+ * @param[in] end : koniec napisu
  * @param[out] endptr : wskaźnik na pierwszy niesparsowany znak z @p str
  * @param[out] err : wskaźnik na informację o błędzie
  * @return sparsowany wykładnik z @p str
  */
-static poly_exp_t MonoExpParse(const char *str, char **endptr, bool *err) {
+static poly_exp_t MonoExpParse(const char *str, const char *end, const char **endptr, bool *err) {
     assert(str != NULL && err != NULL && endptr != NULL);
-    errno = 0;
-    long l = strtol(str, endptr, DECIMAL_BASE);
+    long l;
+    bool overflow = false;
+    *endptr = NumberParseLong(str, end, &l, &overflow);
+    char c = CharAt(str, end);
     // Wykładnik może być tylko nieujemną liczbą z zakresu int i
     // nie może być w tekście poprzedzony znakiem '+'.
-    *err |= !(isdigit(*str) || (l == 0 && *str == '-')) || str == *endptr || errno != 0 || l < 0 || l > INT_MAX;
+    *err |= !(isdigit(c) || (l == 0 && c == '-')) || str == *endptr || overflow || l < 0 || l > INT_MAX;
     return (poly_exp_t) l;
 }
 
-static Poly PolyParseHelper(const char *str, char **endptr, bool *err);
-
-/**
- * Parsuje tekst na jednomian.
- * Po wykonaniu, `*endptr` wskazuje o jedną pozycję dalej niż sparsowany napis.
- * Jeśli wystąpił błąd w trakcie parsowania, ustawia `*err = true`.
- * @param[in] str : napis
- * @param[out] endptr : wskaźnik na pierwszy niesparsowany znak z @p str
- * @param[out] err : wskaźnik na informację o błędzie
- * @return sparsowany jednomian z @p str
- */
-static Mono MonoParse(const char *str, char **endptr, bool *err) {
-    assert(str != NULL && err != NULL);
-    Mono res;
-    // Jednomian powinien zaczynać się znakiem '('.
-    *err |= str[0] != '(';
-    const char *temp = str + 1;
-    Poly p = PolyParseHelper(temp, endptr, err);
-    // Współczynnik i wykładnik jednomianu,
-    // powinien rozdzielać przecinek.
-    *err |= **endptr != ',';
-    if (!*err) {
-        // Po przecinku parsowany jest wykładnik.
-        temp = *endptr + 1;
-        poly_exp_t exp = MonoExpParse(temp, endptr, err);
-        // Jednomian powinien kończyć się znakiem ')'.
-        *err |= **endptr != ')';
-        ++*endptr;
-        res = (Mono) {.p = p, .exp = exp};
-    }
-    if (*err) {
-        PolyDestroy(&p);
-        res = (Mono) {PolyZero(), 0};
-    }
-    return res;
-}
-
 /**
  * Parsuje tekst na wielomian współczynnikowy.
  * Po wykonaniu, `*endptr` wskazuje o jedną pozycję dalej niż sparsowany napis.
  * Jeśli wystąpił błąd w trakcie parsowania, ustawia `*err = true`.
  * @param[in] str : napis
+ * @param[in] end : koniec napisu
  * @param[out] endptr : wskaźnik na pierwszy niesparsowany znak z @p str
  * @param[out] err : wskaźnik na informację o błędzie
  * @return sparsowany współczynnik z @p str
  */
-Poly PolyCoeffParse(const char *str, char **endptr, bool *err) {
+static Poly PolyCoeffParse(const char *str, const char *end, const char **endptr, bool *err) {
     assert(str != NULL && err != NULL && endptr != NULL);
-    errno = 0;
-    poly_coeff_t c = strtol(str, endptr, DECIMAL_BASE);
-    *err |= *str == '+' || errno != 0;
+    poly_coeff_t c;
+    bool overflow = false;
+    *endptr = NumberParseLong(str, end, &c, &overflow);
+    *err |= overflow;
     return PolyFromCoeff(c);
 }
 
@@ -103,11 +86,25 @@ Poly PolyCoeffParse(const char *str, char **endptr, bool *err) {
 static void MonoArrExpand(Mono **monos, size_t count, size_t *size) {
     if (*size == 0) {
         *size = INIT_SIZE;
-        *monos = malloc(*size * sizeof(Mono));
+        *monos = PolyMalloc(*size * sizeof(Mono));
         CHECK_PTR(*monos);
     } else if (count == *size) {
         *size *= MULTIPLIER;
-        *monos = realloc(*monos, *size * sizeof(Mono));
+        *monos = PolyRealloc(*monos, *size * sizeof(Mono));
+        CHECK_PTR(*monos);
+    }
+}
+
+/**
+ * Zmniejsza rozmiar tablicy jednomianów do liczby zajętych pozycji.
+ * @param[in,out] monos : wskaźnik na tablicę jednomianów
+ * @param[in] count : liczba zajętych pozycji
+ * @param[in,out] size : wskaźnik na rozmiar tablicy
+ */
+static void MonoArrShrink(Mono **monos, size_t count, size_t *size) {
+    if (count < *size) {
+        *size = count;
+        *monos = PolyRealloc(*monos, *size * sizeof(Mono));
         CHECK_PTR(*monos);
     }
 }
@@ -123,76 +120,161 @@ static void MonoArrDestroy(Mono *monos, size_t count) {
     }
 }
 
+/**
+ * To jest struktura przechowująca ramkę parsowania sumy jednomianów.
+ * Każdy otwarty, jeszcze niezakończony wielomian niestały ma swoją ramkę.
+ */
+typedef struct ParseFrame {
+    Mono *monos; ///< tablica sparsowanych jednomianów
+    size_t count; ///< liczba sparsowanych jednomianów
+    size_t size; ///< rozmiar tablicy jednomianów
+    /**
+     * Czy dotychczas sparsowane jednomiany mają niezerowe współczynniki
+     * i ściśle rosnące wykładniki?
+     */
+    bool simple;
+} ParseFrame;
+
+/**
+ * Wstawia nową, pustą ramkę na stos ramek parsowania.
+ * @param[in,out] frames : wskaźnik na tablicę ramek
+ * @param[in] count : liczba ramek na stosie
+ * @param[in,out] size : wskaźnik na rozmiar tablicy ramek
+ */
+static void ParseFramePush(ParseFrame **frames, size_t count, size_t *size) {
+    if (*size == 0) {
+        *size = INIT_SIZE;
+        *frames = PolyMalloc(*size * sizeof(ParseFrame));
+        CHECK_PTR(*frames);
+    } else if (count == *size) {
+        *size *= MULTIPLIER;
+        *frames = PolyRealloc(*frames, *size * sizeof(ParseFrame));
+        CHECK_PTR(*frames);
+    }
+    (*frames)[count] = (ParseFrame) {.monos = NULL, .count = 0, .size = 0, .simple = true};
+}
+
+/**
+ * Tworzy wielomian z jednomianów sparsowanej sumy i zwalnia jej ramkę.
+ * Jeśli jednomiany od razu są w najprostszej postaci, tablica jest
+ * przycinana do dokładnego rozmiaru i staje się tablicą wielomianu.
+ * W przeciwnym wypadku jednomiany są sortowane i scalane.
+ * @param[in,out] f : ramka sparsowanej sumy jednomianów
+ * @return wielomian będący sumą jednomianów z ramki
+ */
+static Poly ParseFrameToPoly(ParseFrame *f) {
+    assert(f->count > 0);
+    // Jedyny jednomian postaci c * x^0 upraszcza się do stałej c.
+    bool is_const = f->count == 1 && f->monos[0].exp == 0 && PolyIsCoeff(&f->monos[0].p);
+    if (f->simple && !is_const) {
+        MonoArrShrink(&f->monos, f->count, &f->size);
+        return PolyOwnSimpleMonos(f->count, f->monos);
+    } else {
+        return PolyOwnMonos(f->count, f->monos);
+    }
+}
+
 /**
  * Parsuje tekst na wielomian.
  * Po wykonaniu, `*endptr` wskazuje na o jedną pozycję dalej niż sparsowany napis.
  * Jeśli wystąpił błąd w trakcie parsowania, ustawia `*err = true`.
+ * Zagnieżdżone jednomiany parsowane są bez rekurencji – otwarte sumy
+ * jednomianów przechowywane są na stosie ramek.
  * @param[in] str : napis
+ * @param[in] end : koniec napisu
  * @param[out] endptr : wskaźnik na pierwszy niesparsowany znak z @p str
  * @param[out] err : wskaźnik na informację o błędzie
  * @return sparsowany wielomian z @p str
  */
-static Poly PolyParseHelper(const char *str, char **endptr, bool *err) {
+static Poly PolyParseHelper(const char *str, const char *end, const char **endptr, bool *err) {
     assert(err != NULL && endptr != NULL && str != NULL);
+    ParseFrame *frames = NULL;
+    size_t frames_size = 0;
+    size_t depth = 0;
     Poly r = PolyZero();
-    if (isdigit(str[0]) || str[0] == '-') { // Wielomian stały.
-        r = PolyCoeffParse(str, endptr, err);
-    } else { // Jednomian lub suma jednomianów.
-        *err |= str[0] != '(';
-        Mono m;
-        size_t size = 0;
-        size_t count = 0;
-        Mono *monos = NULL;
-        const char *temp = str;
-        while (!*err && *temp != '\n' && *temp != ',') {
+    const char *temp = str;
+    bool done = false;
+    while (!*err && !done) {
+        // Parsujemy początek wielomianu: stałą lub pierwszy jednomian sumy.
+        char c = CharAt(temp, end);
+        if (isdigit(c) || c == '-') { // Wielomian stały.
+            r = PolyCoeffParse(temp, end, endptr, err);
+            temp = *endptr;
+        } else { // Jednomian lub suma jednomianów.
+            // Głębiej zagnieżdżonych wielomianów nie obsłużą rekurencyjne
+            // działania na wielomianach – patrz POLY_MAX_DEPTH.
+            *err |= c != '(' || depth == POLY_MAX_DEPTH;
+            ParseFramePush(&frames, depth, &frames_size);
+            ++depth;
+            temp += !*err;
+            continue;
+        }
+        // Sparsowany wielomian `r` jest współczynnikiem jednomianu
+        // z ramki na wierzchołku stosu albo całym wynikiem.
+        while (!*err && !done) {
+            if (depth == 0) {
+                done = true;
+                break;
+            }
+            ParseFrame *f = &frames[depth - 1];
+            // Współczynnik i wykładnik jednomianu,
+            // powinien rozdzielać przecinek.
+            *err |= CharAt(temp, end) != ',';
+            if (*err) {
+                break;
+            }
+            poly_exp_t exp = MonoExpParse(temp + 1, end, endptr, err);
+            temp = *endptr;
+            // Jednomian powinien kończyć się znakiem ')'.
+            *err |= CharAt(temp, end) != ')';
+            if (*err) {
+                break;
+            }
+            ++temp;
+            MonoArrExpand(&f->monos, f->count, &f->size);
+            f->simple &= !PolyIsZero(&r) && (f->count == 0 || f->monos[f->count - 1].exp < exp);
+            f->monos[f->count++] = (Mono) {.p = r, .exp = exp};
+            r = PolyZero();
+            if (CharAt(temp, end) == '+') {
+                // Dokładnie jeden znak '+' rozdziela jednomiany,
+                // których sumą jest wynikowy wielomian.
+                *err |= CharAt(temp + 1, end) != '(';
+                temp += *err ? 0 : 2;
+                break;
+            }
             // Jeśli wielomian jest współczynnikiem jednomianu,
             // to kończy się przed znakiem ',',
             // po którym powinien wystąpić wykładnik.
-            char c = *temp;
-            switch (c) {
-                case '(': // Początek jednomianu.
-                    m = MonoParse(temp, endptr, err);
-                    if (!*err) {
-                        MonoArrExpand(&monos, count, &size);
-                        monos[count] = m;
-                        ++count;
-                    }
-                    // Następnie parsowane jest to,
-                    // czego nie sparsowała funkcja MonoParse().
-                    temp = *endptr;
-                    *err |= *temp != '\n' && *temp != ',' && *temp != '+';
-                    break;
-                case '+':
-                    // Dokładnie jeden znak '+' rozdziela jednomiany,
-                    // których sumą jest wynikowy wielomian.
-                    *err |= *(temp + 1) != '(';
-                    ++temp;
-                    break;
-                default:
-                    *err = true;
-                    ++temp;
+            *err |= CharAt(temp, end) != LINE_END && CharAt(temp, end) != ',';
+            if (!*err) {
+                r = ParseFrameToPoly(f);
+                --depth;
             }
         }
-        if (!*err) {
-            r = PolyAddMonos(count, monos);
-        } else {
-            MonoArrDestroy(monos, count);
-        }
-        free(monos);
     }
+    *endptr = temp;
+    if (*err) {
+        PolyDestroy(&r);
+        r = PolyZero();
+    }
+    for (size_t i = 0; i < depth; ++i) {
+        MonoArrDestroy(frames[i].monos, frames[i].count);
+        PolyFree(frames[i].monos);
+    }
+    PolyFree(frames);
     return r;
 }
 
-Poly PolyParse(char *str, size_t line, ssize_t len, bool *err) {
-    assert(str != NULL && str[len - 1] == '\n' && err != NULL);
-    char *endparsed = str;
-    Poly p = PolyParseHelper(str, &endparsed, err);
-    *err |= endparsed != str + len - 1;
+Poly PolyParse(const char *str, size_t len, bool *err) {
+    assert(str != NULL && err != NULL);
+    const char *end = str + len;
+    const char *endparsed = str;
+    Poly p = PolyParseHelper(str, end, &endparsed, err);
+    *err |= endparsed != end;
     if (*err) {
-        fprintf(stderr, "ERROR %zu WRONG POLY\n", line);
         PolyDestroy(&p);
         return PolyZero(); // Atrapa.
     } else {
         return p;
     }
-}
\ No newline at end of file
+}
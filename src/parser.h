@@ -10,18 +10,18 @@
 
 #include "poly.h"
 
-/** Podstawa systemu dziesiętnego. */
-#define DECIMAL_BASE 10
-
 /**
  * Parsuje tekst na wielomian.
- * Jeśli wystąpił błąd w trakcie parsowania, ustawia `*err = true`.
+ * Parsowany jest cały napis `str[0..len)`, który nie musi kończyć się
+ * znakiem `\n` ani `\0`. Napis nie jest modyfikowany.
+ * Jeśli wystąpił błąd w trakcie parsowania, ustawia `*err = true`;
+ * komunikat o błędzie wypisuje wywołujący. Błędem jest też wielomian
+ * zagnieżdżony głębiej niż #POLY_MAX_DEPTH poziomów.
  * @param[in] str : napis
- * @param[in] line : numer parsowanego wiersza
  * @param[in] len : długość parsowanego wiersza
  * @param[out] err : wskaźnik na informację o błędzie
  * @return sparsowany wielomian z @p str
  */
-Poly PolyParse(char *str, size_t line, ssize_t len, bool *err);
+Poly PolyParse(const char *str, size_t len, bool *err);
 
 #endif //__PARSER_H__
\ No newline at end of file
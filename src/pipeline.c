@@ -0,0 +1,236 @@
+/** @file
+ * Implementacja potoku wczytującego i parsującego wiersze kalkulatora.
+ *
+ * @author Mateusz Sulimowicz <ms429603@students.mimuw.edu.pl>
+ * @date 2021
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "parser.h"
+#include "pipeline.h"
+#include "trace.h"
+
+/** Mnożnik rozmiaru bufora do realokacji. */
+#define MULTIPLIER 2
+
+/**
+ * Daje wątkowi czytającemu miejsce na kolejną porcję, czekając,
+ * aż wykonujący zwolni najstarszą.
+ * @param[in,out] pl : potok
+ * @return pusta porcja
+ */
+static PipelineBatch *PipelineAcquire(Pipeline *pl) {
+    pthread_mutex_lock(&pl->lock);
+    while (pl->read_seq >= pl->exec_seq + pl->slots_count) {
+        pthread_cond_wait(&pl->freed, &pl->lock);
+    }
+    PipelineBatch *b = &pl->slots[pl->read_seq % pl->slots_count];
+    pthread_mutex_unlock(&pl->lock);
+    b->count = 0;
+    b->bytes = 0;
+    b->text_len = 0;
+    b->parsed = false;
+    return b;
+}
+
+/**
+ * Wysyła wypełnianą porcję do parsowania.
+ * @param[in,out] pl : potok
+ */
+static void PipelineSubmit(Pipeline *pl) {
+    PipelineBatch *b = pl->filling;
+    b->base = pl->in.mapped ? pl->in.data : b->text;
+    pl->filling = NULL;
+    pthread_mutex_lock(&pl->lock);
+    ++pl->read_seq;
+    pthread_cond_signal(&pl->read);
+    pthread_mutex_unlock(&pl->lock);
+}
+
+/**
+ * Dopisuje wiersz do wypełnianej porcji. Wiersze wejścia, które nie jest
+ * zmapowane, są kopiowane, bo bufor wejścia jest nadpisywany.
+ * @param[in,out] pl : potok
+ * @param[in] str : wiersz
+ * @param[in] len : długość wiersza
+ * @param[in] kind : rodzaj wiersza
+ */
+static void PipelineAppend(Pipeline *pl, const char *str, size_t len, LineKind kind) {
+    PipelineBatch *b = pl->filling;
+    size_t off;
+    if (pl->in.mapped) {
+        off = (size_t) (str - pl->in.data);
+    } else {
+        if (b->text_len + len > b->text_cap) {
+            size_t cap = b->text_cap == 0 ? PIPELINE_BATCH_BYTES : MULTIPLIER * b->text_cap;
+            b->text_cap = cap < b->text_len + len ? b->text_len + len : cap;
+            b->text = realloc(b->text, b->text_cap);
+            CHECK_PTR(b->text);
+        }
+        memcpy(b->text + b->text_len, str, len);
+        off = b->text_len;
+        b->text_len += len;
+    }
+    b->lines[b->count++] = (PipelineLine) {.off = off, .len = len, .line = pl->line, .kind = kind};
+    b->bytes += len;
+}
+
+/**
+ * Wysyła niepełną porcję, zanim wątek czytający zaczeka na dane,
+ * by wiersze wczytane już z interaktywnego wejścia zostały wykonane.
+ * @param[in,out] arg : potok
+ */
+static void PipelineReaderWait(void *arg) {
+    Pipeline *pl = arg;
+    if (pl->filling != NULL && pl->filling->count > 0) {
+        PipelineSubmit(pl);
+    }
+}
+
+/**
+ * Pętla wątku czytającego: dzieli wejście na porcje wierszy.
+ * @param[in,out] arg : potok
+ * @return NULL
+ */
+static void *PipelineReader(void *arg) {
+    Pipeline *pl = arg;
+    const char *str;
+    size_t len;
+    while (InputNextLine(&pl->in, &str, &len)) {
+        ++pl->line;
+        LineKind kind = LineKindOf(str, len);
+        if (kind == LINE_SKIP) {
+            continue;
+        }
+        if (pl->filling == NULL) {
+            pl->filling = PipelineAcquire(pl);
+        }
+        PipelineAppend(pl, str, len, kind);
+        if (pl->filling->count == PIPELINE_BATCH_LINES || pl->filling->bytes >= PIPELINE_BATCH_BYTES) {
+            PipelineSubmit(pl);
+        }
+    }
+    if (pl->filling != NULL) {
+        PipelineSubmit(pl);
+    }
+    pthread_mutex_lock(&pl->lock);
+    pl->eof = true;
+    pthread_cond_broadcast(&pl->read);
+    pthread_cond_signal(&pl->parsed);
+    pthread_mutex_unlock(&pl->lock);
+    return NULL;
+}
+
+/**
+ * Pętla wątku parsującego: parsuje wielomiany kolejnych wysłanych porcji.
+ * @param[in,out] arg : potok
+ * @return NULL
+ */
+static void *PipelineWorker(void *arg) {
+    Pipeline *pl = arg;
+    pthread_mutex_lock(&pl->lock);
+    for (;;) {
+        while (pl->parse_seq == pl->read_seq && !pl->eof) {
+            pthread_cond_wait(&pl->read, &pl->lock);
+        }
+        if (pl->parse_seq == pl->read_seq) {
+            break;
+        }
+        PipelineBatch *b = &pl->slots[pl->parse_seq++ % pl->slots_count];
+        pthread_mutex_unlock(&pl->lock);
+        alloc_stats.peak_bytes = alloc_stats.live_bytes;
+        AllocStats before = alloc_stats;
+        uint64_t start = TraceStart();
+        for (size_t i = 0; i < b->count; ++i) {
+            PipelineLine *l = &b->lines[i];
+            if (l->kind == LINE_POLY) {
+                l->err = false;
+                l->p = PolyParse(b->base + l->off, l->len, &l->err);
+            }
+        }
+        TracePhase("parse batch", start, 2, (TraceArg[]) {{"lines", (long) b->count}, {"bytes", (long) b->bytes}});
+        b->stats = AllocStatsDelta(&before, &alloc_stats);
+        pthread_mutex_lock(&pl->lock);
+        b->parsed = true;
+        pthread_cond_signal(&pl->parsed);
+    }
+    pthread_mutex_unlock(&pl->lock);
+    return NULL;
+}
+
+void PipelineInit(Pipeline *pl, int fd, size_t workers, Writer *out) {
+    assert(workers > 0);
+    *pl = (Pipeline) {.workers_count = workers, .out = out};
+    InputInit(&pl->in, fd);
+    InputSetWaitHook(&pl->in, PipelineReaderWait, pl);
+    pl->slots_count = workers * PIPELINE_SLOTS_PER_WORKER;
+    pl->slots = calloc(pl->slots_count, sizeof(PipelineBatch));
+    CHECK_PTR(pl->slots);
+    for (size_t i = 0; i < pl->slots_count; ++i) {
+        pl->slots[i].lines = malloc(PIPELINE_BATCH_LINES * sizeof(PipelineLine));
+        CHECK_PTR(pl->slots[i].lines);
+    }
+    pthread_mutex_init(&pl->lock, NULL);
+    pthread_cond_init(&pl->freed, NULL);
+    pthread_cond_init(&pl->read, NULL);
+    pthread_cond_init(&pl->parsed, NULL);
+    pl->workers = malloc(workers * sizeof(pthread_t));
+    CHECK_PTR(pl->workers);
+    if (pthread_create(&pl->reader, NULL, PipelineReader, pl) != 0) {
+        exit(1);
+    }
+    for (size_t i = 0; i < workers; ++i) {
+        if (pthread_create(&pl->workers[i], NULL, PipelineWorker, pl) != 0) {
+            exit(1);
+        }
+    }
+}
+
+PipelineBatch *PipelineNext(Pipeline *pl) {
+    pthread_mutex_lock(&pl->lock);
+    if (pl->holding) {
+        ++pl->exec_seq;
+        pl->holding = false;
+        pthread_cond_signal(&pl->freed);
+    }
+    PipelineBatch *b = NULL;
+    bool flushed = false;
+    for (;;) {
+        if (pl->exec_seq < pl->read_seq && pl->slots[pl->exec_seq % pl->slots_count].parsed) {
+            b = &pl->slots[pl->exec_seq % pl->slots_count];
+            pl->holding = true;
+            break;
+        } else if (pl->exec_seq == pl->read_seq && pl->eof) {
+            break;
+        } else if (!flushed) {
+            // Zapis może trwać, więc nie blokujemy w tym czasie pozostałych wątków.
+            pthread_mutex_unlock(&pl->lock);
+            WriterFlush(pl->out);
+            pthread_mutex_lock(&pl->lock);
+            flushed = true;
+        } else {
+            pthread_cond_wait(&pl->parsed, &pl->lock);
+        }
+    }
+    pthread_mutex_unlock(&pl->lock);
+    return b;
+}
+
+void PipelineDestroy(Pipeline *pl) {
+    pthread_join(pl->reader, NULL);
+    for (size_t i = 0; i < pl->workers_count; ++i) {
+        pthread_join(pl->workers[i], NULL);
+    }
+    free(pl->workers);
+    for (size_t i = 0; i < pl->slots_count; ++i) {
+        free(pl->slots[i].lines);
+        free(pl->slots[i].text);
+    }
+    free(pl->slots);
+    InputDestroy(&pl->in);
+    pthread_cond_destroy(&pl->parsed);
+    pthread_cond_destroy(&pl->read);
+    pthread_cond_destroy(&pl->freed);
+    pthread_mutex_destroy(&pl->lock);
+}
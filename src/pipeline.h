@@ -0,0 +1,127 @@
+/** @file
+ * Interfejs potoku wczytującego i parsującego wiersze kalkulatora równolegle
+ * z ich wykonywaniem.
+ *
+ * Wątek czytający dzieli wejście na porcje wierszy, wątki parsujące
+ * zamieniają wiersze z wielomianami na wielomiany – każdy inną porcję,
+ * w dowolnej kolejności – a wątek wykonujący odbiera porcje ściśle
+ * w kolejności wejścia. Porcje krążą w stałym pierścieniu miejsc,
+ * więc szybkie wczytywanie nie wyprzedza wykonywania o więcej niż
+ * kilka porcji.
+ *
+ * @author Mateusz Sulimowicz <ms429603@students.mimuw.edu.pl>
+ * @date 2021
+ */
+
+#ifndef __PIPELINE_H__
+#define __PIPELINE_H__
+
+#include <ctype.h>
+#include <pthread.h>
+#include "alloc.h"
+#include "input.h"
+#include "poly.h"
+#include "writer.h"
+
+/** Największa liczba wierszy w porcji. */
+#define PIPELINE_BATCH_LINES 1024
+
+/** Liczba bajtów tekstu, po której przekroczeniu porcja jest wysyłana do parsowania. */
+#define PIPELINE_BATCH_BYTES (256 << 10)
+
+/** Liczba miejsc na porcje przypadająca na wątek parsujący. */
+#define PIPELINE_SLOTS_PER_WORKER 4
+
+/** To jest typ wyliczeniowy opisujący rodzaj wiersza wejścia. */
+typedef enum LineKind {
+    LINE_SKIP, ///< wiersz pusty lub komentarz
+    LINE_COMMAND, ///< polecenie
+    LINE_POLY ///< wielomian
+} LineKind;
+
+/**
+ * Rozpoznaje rodzaj wiersza. Puste wiersze i wiersze zaczynające się
+ * znakiem `#` są pomijane, a wiersz zaczynający się literą jest poleceniem.
+ * @param[in] str : wiersz
+ * @param[in] len : długość wiersza
+ * @return rodzaj wiersza
+ */
+static inline LineKind LineKindOf(const char *str, size_t len) {
+    if (len == 0 || str[0] == '#') {
+        return LINE_SKIP;
+    }
+    return isalpha(*str) ? LINE_COMMAND : LINE_POLY;
+}
+
+/** To jest struktura przechowująca wiersz porcji. */
+typedef struct PipelineLine {
+    size_t off; ///< początek wiersza względem tekstu porcji
+    size_t len; ///< długość wiersza
+    size_t line; ///< numer wiersza
+    LineKind kind; ///< rodzaj wiersza
+    bool err; ///< czy wiersz z wielomianem był niepoprawny
+    Poly p; ///< sparsowany wielomian, przejmowany przez wykonującego
+} PipelineLine;
+
+/** To jest struktura przechowująca porcję wierszy. */
+typedef struct PipelineBatch {
+    PipelineLine *lines; ///< wiersze porcji, bez wierszy pomijanych
+    size_t count; ///< liczba wierszy
+    size_t bytes; ///< łączna długość wierszy
+    const char *base; ///< tekst, względem którego podane są wiersze
+    char *text; ///< kopia wierszy z wejścia, które nie jest zmapowane
+    size_t text_len; ///< długość kopii wierszy
+    size_t text_cap; ///< rozmiar bufora kopii wierszy
+    bool parsed; ///< czy wiersze z wielomianami zostały sparsowane
+    AllocStats stats; ///< przyrost liczników alokacji wątku parsującego porcję
+} PipelineBatch;
+
+/** To jest struktura przechowująca stan potoku. */
+typedef struct Pipeline {
+    Input in; ///< źródło wierszy
+    size_t line; ///< numer ostatnio wczytanego wiersza
+    PipelineBatch *slots; ///< pierścień miejsc na porcje; porcja numer k zajmuje miejsce k mod @p slots_count
+    size_t slots_count; ///< liczba miejsc
+    PipelineBatch *filling; ///< porcja wypełniana przez wątek czytający
+    size_t read_seq; ///< numer kolejnej porcji do wysłania
+    size_t parse_seq; ///< numer kolejnej porcji do sparsowania
+    size_t exec_seq; ///< numer kolejnej porcji do wykonania
+    bool holding; ///< czy wykonujący trzyma porcję numer @p exec_seq
+    bool eof; ///< czy wątek czytający osiągnął koniec wejścia
+    pthread_mutex_t lock; ///< blokada chroniąca liczniki porcji
+    pthread_cond_t freed; ///< sygnalizowany, gdy zwalnia się miejsce
+    pthread_cond_t read; ///< sygnalizowany, gdy pojawia się porcja do sparsowania
+    pthread_cond_t parsed; ///< sygnalizowany, gdy porcja zostaje sparsowana
+    pthread_t reader; ///< wątek czytający
+    pthread_t *workers; ///< wątki parsujące
+    size_t workers_count; ///< liczba wątków parsujących
+    Writer *out; ///< wyjście opróżniane przed czekaniem na porcję
+} Pipeline;
+
+/**
+ * Uruchamia potok czytający wiersze z deskryptora @p fd.
+ * @param[out] pl : potok
+ * @param[in] fd : deskryptor wejścia
+ * @param[in] workers : liczba wątków parsujących, dodatnia
+ * @param[in] out : wyjście, które należy opróżnić, zanim wykonujący
+ * zaczeka na kolejną porcję
+ */
+void PipelineInit(Pipeline *pl, int fd, size_t workers, Writer *out);
+
+/**
+ * Oddaje poprzednio pobraną porcję i daje kolejną porcję w kolejności
+ * wejścia, czekając na jej sparsowanie. Wielomiany porcji należy przejąć
+ * przed kolejnym wywołaniem. Tekst wierszy pozostaje ważny do tego czasu.
+ * @param[in,out] pl : potok
+ * @return porcja lub NULL, jeśli wejście się skończyło
+ */
+PipelineBatch *PipelineNext(Pipeline *pl);
+
+/**
+ * Czeka na zakończenie wątków potoku i zwalnia jego zasoby.
+ * Wolno ją wywołać dopiero, gdy PipelineNext() zwróci NULL.
+ * @param[in,out] pl : potok
+ */
+void PipelineDestroy(Pipeline *pl);
+
+#endif //__PIPELINE_H__
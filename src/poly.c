@@ -12,8 +12,51 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
+#include "alloc.h"
+#include "frames.h"
+#include "number.h"
 #include "poly.h"
-#include "stdio.h"
+#include "trace.h"
+#include "writer.h"
+
+/** Mnożnik rozmiaru tablicy do realokacji. */
+#define MULTIPLIER 2
+
+/** Początkowy rozmiar alokowanej tablicy */
+#define INIT_SIZE 4
+
+/**
+ * Przydziela tablicę jednomianów tworzonego wielomianu, doliczając
+ * je do licznika jednomianów – patrz alloc.h.
+ * @param[in] count : liczba jednomianów
+ * @return wskaźnik na tablicę lub NULL
+ */
+static inline Mono *MonosAlloc(size_t count) {
+    alloc_stats.terms += count;
+    return PolyMalloc(count * sizeof(Mono));
+}
+
+/**
+ * Tworzy wielomian z tablicy jednomianów o niezerowych współczynnikach,
+ * posortowanej ściśle rosnąco po wykładnikach. Pustą tablicę i jedyny
+ * jednomian postaci @f$c x^0@f$ zamienia na stałą, zwalniając tablicę.
+ * Przejmuje na własność tablicę @p monos i jej zawartość.
+ * @param[in] count : liczba jednomianów
+ * @param[in] monos : tablica jednomianów
+ * @return wielomian będący sumą jednomianów
+ */
+static Poly PolyFromSortedMonos(size_t count, Mono *monos) {
+    if (count == 0) {
+        PolyFree(monos);
+        return PolyZero();
+    } else if (count == 1 && monos[0].exp == 0 && PolyIsCoeff(&monos[0].p)) {
+        poly_coeff_t c = monos[0].p.coeff;
+        PolyFree(monos);
+        return PolyFromCoeff(c);
+    }
+    return (Poly) {.size = count, .arr = monos};
+}
 
 /**
  * Sprawdza, czy jednomiany wielomianu
@@ -50,18 +93,30 @@ static bool PolyIsSimple(const Poly *p) __attribute__((unused));
  */
 static bool PolyIsSimple(const Poly *p) {
     assert(p != NULL);
-    bool res = PolyIsSorted(p);
-    if (res && p->arr != NULL) {
-        size_t i = 0;
-        int exp_0 = 0;
-        while (res && i < p->size) {
-            exp_0 += (MonoGetExp(&p->arr[i]) == 0) && PolyIsCoeff(&p->arr[i].p);
-            res = PolyIsSimple(&p->arr[i].p) &&
-                  !PolyIsZero(&p->arr[i].p) &&
-                  (exp_0 == 0 || (exp_0 == 1 && p->size > 1));
-            ++i;
+    bool res = true;
+    PolyFrames fs;
+    FramesInit(&fs);
+    FramesPush(&fs, (PolyFrame) {.p = p});
+    PolyFrame *f;
+    while (res && (f = FramesTop(&fs)) != NULL) {
+        const Poly *q = f->p;
+        FramesPop(&fs);
+        res = PolyIsSorted(q);
+        if (res && q->arr != NULL) {
+            size_t i = 0;
+            int exp_0 = 0;
+            while (res && i < q->size) {
+                exp_0 += (MonoGetExp(&q->arr[i]) == 0) && PolyIsCoeff(&q->arr[i].p);
+                res = !PolyIsZero(&q->arr[i].p) &&
+                      (exp_0 == 0 || (exp_0 == 1 && q->size > 1));
+                if (!PolyIsCoeff(&q->arr[i].p)) {
+                    FramesPush(&fs, (PolyFrame) {.p = &q->arr[i].p});
+                }
+                ++i;
+            }
         }
     }
+    FramesDestroy(&fs);
     return res;
 }
 
@@ -85,28 +140,77 @@ static int MonoCmp(const void *m, const void *n) {
     }
 }
 
+bool PolyFindExp(const Poly *p, poly_exp_t e, size_t *idx) {
+    assert(p != NULL && idx != NULL);
+    size_t lo = 0;
+    size_t hi = PolyIsCoeff(p) ? 0 : p->size;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (MonoGetExp(&p->arr[mid]) < e) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *idx = lo;
+    return !PolyIsCoeff(p) && lo < p->size && MonoGetExp(&p->arr[lo]) == e;
+}
+
 void PolyDestroy(Poly *p) {
-    if (p != NULL && p->arr != NULL) {
-        for (size_t i = 0; i < p->size; ++i) {
-            MonoDestroy(&p->arr[i]);
+    if (p == NULL || PolyIsCoeff(p)) {
+        return;
+    }
+    PolyFrames fs;
+    FramesInit(&fs);
+    FramesPush(&fs, (PolyFrame) {.p = p});
+    PolyFrame *f;
+    while ((f = FramesTop(&fs)) != NULL) {
+        if (f->i < f->p->size) {
+            const Poly *c = &f->p->arr[f->i].p;
+            ++f->i;
+            if (!PolyIsCoeff(c)) {
+                FramesPush(&fs, (PolyFrame) {.p = c});
+            }
+        } else {
+            // Wszystkie współczynniki zostały już usunięte.
+            PolyFree(f->p->arr);
+            FramesPop(&fs);
         }
-        free(p->arr);
     }
+    FramesDestroy(&fs);
 }
 
 Poly PolyClone(const Poly *p) {
     assert(p != NULL);
     if (p->arr == NULL) {
         return (Poly) {.coeff = p->coeff, .arr = NULL};
-    } else {
-        Poly p1 = (Poly) {.size = p->size, .arr = NULL};
-        p1.arr = malloc(p->size * sizeof(Mono));
-        CHECK_PTR(p1.arr);
-        for (size_t i = 0; i < p1.size; ++i) {
-            p1.arr[i] = MonoClone(&p->arr[i]);
+    }
+    Poly p1 = (Poly) {.size = p->size, .arr = MonosAlloc(p->size)};
+    CHECK_PTR(p1.arr);
+    PolyFrames fs;
+    FramesInit(&fs);
+    FramesPush(&fs, (PolyFrame) {.p = p, .r = &p1});
+    PolyFrame *f;
+    while ((f = FramesTop(&fs)) != NULL) {
+        if (f->i < f->p->size) {
+            const Mono *m = &f->p->arr[f->i];
+            Mono *m1 = &f->r->arr[f->i];
+            ++f->i;
+            m1->exp = m->exp;
+            if (PolyIsCoeff(&m->p)) {
+                m1->p = m->p;
+            } else {
+                // Kopiujemy współczynnik w kolejnej ramce.
+                m1->p = (Poly) {.size = m->p.size, .arr = MonosAlloc(m->p.size)};
+                CHECK_PTR(m1->p.arr);
+                FramesPush(&fs, (PolyFrame) {.p = &m->p, .r = &m1->p});
+            }
+        } else {
+            FramesPop(&fs);
         }
-        return p1;
     }
+    FramesDestroy(&fs);
+    return p1;
 }
 
 /**
@@ -181,15 +285,19 @@ static Poly PolyAddCoeff(const Poly *p, const Poly *c) {
     if (PolyIsCoeff(p)) {
         return PolyFromCoeff(p->coeff + c->coeff);
     } else if (MonoGetExp(&p->arr[0]) == 0) {
-        r = PolyClone(p);
-        Mono temp = r.arr[0];
-        r.arr[0] = MonoAddCoeff(&temp, c);
-        MonoDestroy(&temp);
+        // Jednomian o wykładniku 0 od razu zastępujemy sumą, zamiast go kopiować.
+        r.size = p->size;
+        r.arr = MonosAlloc(r.size);
+        CHECK_PTR(r.arr);
+        r.arr[0] = MonoAddCoeff(&p->arr[0], c);
+        for (size_t i = 1; i < r.size; ++i) {
+            r.arr[i] = MonoClone(&p->arr[i]);
+        }
     } else {
         // Jeśli p nie zawiera jednomianu o wykładniku 0, wstawiamy na początek tablicy jednomianów
         // jednomian postaci c * x^0, a pozostałe jednomiany zostają przesunięte o 1 indeks w górę.
         r.size = p->size + 1;
-        r.arr = malloc(r.size * sizeof(Mono));
+        r.arr = MonosAlloc(r.size);
         CHECK_PTR(r.arr);
         Poly new = PolyClone(c);
         (r.arr)[0] = (Mono) {.p = new, .exp = 0};
@@ -210,54 +318,54 @@ Poly PolyAdd(const Poly *p, const Poly *q) {
         return PolyAddCoeff(q, p);
     } else if (PolyIsCoeff(q)) {
         return PolyAddCoeff(p, q);
-    } else {
-        // Suma dwóch wielomianów p, q,
-        // składa się z co najwyżej p->size + q->size jednomianów.
-        Poly r = (Poly) {.size = p->size + q->size, .arr = NULL};
-        r.arr = malloc(r.size * sizeof(Mono));
-        CHECK_PTR(r.arr);
-        size_t p_i = 0;
-        size_t q_i = 0;
-        size_t r_i = 0;
-        Mono temp;
-        while (r_i < r.size && (p_i < p->size || q_i < q->size)) {
-            // Wpisujemy do tablicy jednomianów wielomianu r jednomiany tak, aby
-            // wynikowy wielomian miał wykładniki jednomianów posortowane rosnąco.
-            if (p_i < p->size && q_i < q->size) {
-                poly_exp_t p_exp = MonoGetExp(&p->arr[p_i]);
-                poly_exp_t q_exp = MonoGetExp(&q->arr[q_i]);
-                if (p_exp < q_exp) {
-                    r.arr[r_i] = MonoClone(&p->arr[p_i]);
-                    ++p_i;
-                } else if (p_exp > q_exp) {
-                    r.arr[r_i] = MonoClone(&q->arr[q_i]);
-                    ++q_i;
-                } else {
-                    temp = MonoAdd(&p->arr[p_i], &q->arr[q_i]);
-                    r.arr[r_i] = temp;
-                    ++p_i;
-                    ++q_i;
-                }
-            } else if (p_i < p->size) {
-                r.arr[r_i] = MonoClone(&p->arr[p_i]);
-                ++p_i;
-            } else if (q_i < q->size) {
-                r.arr[r_i] = MonoClone(&q->arr[q_i]);
-                ++q_i;
+    }
+    // Suma dwóch wielomianów p, q,
+    // składa się z co najwyżej p->size + q->size jednomianów.
+    Mono *arr = MonosAlloc(p->size + q->size);
+    CHECK_PTR(arr);
+    size_t p_i = 0;
+    size_t q_i = 0;
+    size_t k = 0;
+    // Wpisujemy do tablicy jednomianów wyniku jednomiany tak, aby
+    // wynikowy wielomian miał wykładniki jednomianów posortowane rosnąco.
+    while (p_i < p->size && q_i < q->size) {
+        const Mono *m = &p->arr[p_i];
+        const Mono *n = &q->arr[q_i];
+        if (m->exp < n->exp) {
+            arr[k++] = MonoClone(m);
+            ++p_i;
+        } else if (m->exp > n->exp) {
+            arr[k++] = MonoClone(n);
+            ++q_i;
+        } else {
+            // Stałe współczynniki sumujemy w miejscu, bez wywołania rekurencyjnego,
+            // a jednomiany o zerowej sumie pomijamy.
+            if (PolyIsCoeff(&m->p) && PolyIsCoeff(&n->p)) {
+                poly_coeff_t c = m->p.coeff + n->p.coeff;
+                arr[k] = (Mono) {.p = PolyFromCoeff(c), .exp = m->exp};
+                k += c != 0;
+            } else {
+                arr[k] = MonoAdd(m, n);
+                k += !PolyIsZero(&arr[k].p);
             }
-            ++r_i;
+            ++p_i;
+            ++q_i;
         }
-        r.size = r_i;
-        PolySimplify(&r);
-        return r;
     }
+    while (p_i < p->size) {
+        arr[k++] = MonoClone(&p->arr[p_i++]);
+    }
+    while (q_i < q->size) {
+        arr[k++] = MonoClone(&q->arr[q_i++]);
+    }
+    return PolyFromSortedMonos(k, arr);
 }
 
 Poly PolyAddMonos(size_t count, const Mono monos[]) { //TODO: przetestować!
     if (count == 0 || monos == NULL) {
         return PolyZero();
     } else {
-        Mono *arr = malloc(count * sizeof(Mono));
+        Mono *arr = MonosAlloc(count);
         CHECK_PTR(arr);
         for (size_t i = 0; i < count; ++i) {
             arr[i] = monos[i];
@@ -272,7 +380,9 @@ Poly PolyOwnMonos(size_t count, Mono *monos) { //TODO: przetestować!
     } else {
         Poly p = (Poly) {.size = count, .arr  = monos};
         if (!PolyIsSorted(&p)) {
+            uint64_t start = TraceStart();
             qsort(p.arr, p.size, sizeof(Mono), MonoCmp);
+            TracePhase("PolyOwnMonos sort", start, 1, (TraceArg[]) {{"monos", (long) count}});
         }
         size_t last_exp_i = 0;
         size_t new_size = 1;
@@ -308,11 +418,18 @@ Poly PolyOwnMonos(size_t count, Mono *monos) { //TODO: przetestować!
     }
 }
 
+Poly PolyOwnSimpleMonos(size_t count, Mono *monos) {
+    assert(count > 0 && monos != NULL);
+    Poly p = (Poly) {.size = count, .arr = monos};
+    assert(PolyIsSimple(&p));
+    return p;
+}
+
 Poly PolyCloneMonos(size_t count, const Mono monos[]) { //TODO: przetestować!
     if (count == 0 || monos == NULL) {
         return PolyZero();
     } else {
-        Mono *arr = malloc(count * sizeof(Mono));
+        Mono *arr = MonosAlloc(count);
         CHECK_PTR(arr);
         for (size_t i = 0; i < count; ++i) {
             arr[i] = MonoClone(&monos[i]);
@@ -344,18 +461,31 @@ static Poly PolyMulByCoeff(const Poly *p, const Poly *c) {
     assert(PolyIsSimple(p));
     if (PolyIsCoeff(p)) {
         return PolyFromCoeff(p->coeff * c->coeff);
-    } else {
-        Poly r = (Poly) {.size = p->size, .arr = NULL};
-        r.arr = malloc(r.size * sizeof(Mono));
-        CHECK_PTR(r.arr);
-        for (size_t i = 0; i < r.size; ++i) {
-            r.arr[i] = MonoMulByCoeff(&p->arr[i], c);
+    }
+    // Iloczyn niezerowych współczynników może się wyzerować po przepełnieniu,
+    // więc jednomiany o zerowym iloczynie pomijamy. Stałe współczynniki
+    // mnożymy w miejscu, bez wywołania rekurencyjnego.
+    Mono *arr = MonosAlloc(p->size);
+    CHECK_PTR(arr);
+    size_t k = 0;
+    for (size_t i = 0; i < p->size; ++i) {
+        const Mono *m = &p->arr[i];
+        if (PolyIsCoeff(&m->p)) {
+            poly_coeff_t v = m->p.coeff * c->coeff;
+            arr[k] = (Mono) {.p = PolyFromCoeff(v), .exp = m->exp};
+            k += v != 0;
+        } else {
+            arr[k] = MonoMulByCoeff(m, c);
+            k += !PolyIsZero(&arr[k].p);
         }
-        PolySimplify(&r);
-        return r;
     }
+    return PolyFromSortedMonos(k, arr);
 }
 
+static Poly PolyMulHelper(const Poly *p, const Poly *q);
+
+static Poly PolyMergeMonos(size_t count, Mono *monos);
+
 /**
  * Mnoży dwa jednomiany.
  * @param[in] m : jednomian @f$m@f$
@@ -363,11 +493,18 @@ static Poly PolyMulByCoeff(const Poly *p, const Poly *c) {
  * @return @f$m \cdot n@f$
  */
 static Mono MonoMul(const Mono *m, const Mono *n) {
-    return (Mono) {.p = PolyMul(&m->p, &n->p),
+    return (Mono) {.p = PolyMulHelper(&m->p, &n->p),
             .exp = MonoGetExp(m) + MonoGetExp(n)};
 }
 
-Poly PolyMul(const Poly *p, const Poly *q) {
+/**
+ * Mnoży dwa wielomiany. Wywołania rekurencyjne nie są zapisywane
+ * w przebiegu obliczeń, w przeciwieństwie do wywołań PolyMul().
+ * @param[in] p : wielomian @f$p@f$
+ * @param[in] q : wielomian @f$q@f$
+ * @return @f$p * q@f$
+ */
+static Poly PolyMulHelper(const Poly *p, const Poly *q) {
     assert(p != NULL && q != NULL);
     if (PolyIsCoeff(p) && PolyIsCoeff(q)) {
         return PolyFromCoeff(p->coeff * q->coeff);
@@ -375,24 +512,48 @@ Poly PolyMul(const Poly *p, const Poly *q) {
         return PolyMulByCoeff(p, q);
     } else if (PolyIsCoeff(p)) {
         return PolyMulByCoeff(q, p);
-    } else {
-        // W wyniku mnożenia dwóch wielomianów,
-        // otrzymujemy wielomian o ilości jednomianów nie większej
-        // niż p->size * q->size.
-        Mono *monos = malloc(p->size * q->size * sizeof(Mono));
-        CHECK_PTR(monos);
-        for (size_t i = 0; i < p->size; ++i) {
-            for (size_t j = 0; j < q->size; ++j) {
-                // Przypisujemy jednomiany do monos jak
-                // wartości do "dwuwymiarowej" tablicy.
-                monos[i * (q->size) + j] = MonoMul(&p->arr[i], &q->arr[j]);
+    }
+    // W wyniku mnożenia dwóch wielomianów,
+    // otrzymujemy wielomian o ilości jednomianów nie większej
+    // niż p->size * q->size. Tablica iloczynów staje się tablicą wyniku.
+    // Iloczyny stałych współczynników liczymy w miejscu, a jeśli wszystkie
+    // współczynniki są stałe, sortujemy iloczyny, scalając ich serie.
+    size_t count = p->size * q->size;
+    Mono *monos = MonosAlloc(count);
+    CHECK_PTR(monos);
+    bool consts = true;
+    for (size_t i = 0; i < p->size; ++i) {
+        const Mono *m = &p->arr[i];
+        for (size_t j = 0; j < q->size; ++j) {
+            // Przypisujemy jednomiany do monos jak
+            // wartości do "dwuwymiarowej" tablicy.
+            const Mono *n = &q->arr[j];
+            if (PolyIsCoeff(&m->p) && PolyIsCoeff(&n->p)) {
+                monos[i * q->size + j] = (Mono) {.p = PolyFromCoeff(m->p.coeff * n->p.coeff), .exp = m->exp + n->exp};
+            } else {
+                monos[i * q->size + j] = MonoMul(m, n);
+                consts = false;
             }
+            AllocGuardPoll();
         }
-        Poly r = PolyAddMonos(p->size * q->size, monos);
-        PolySimplify(&r);
-        free(monos);
-        return r;
     }
+    if (consts) {
+        return PolyMergeMonos(count, monos);
+    }
+    Poly r = PolyOwnMonos(count, monos);
+    PolySimplify(&r);
+    return r;
+}
+
+Poly PolyMul(const Poly *p, const Poly *q) {
+    // Mnożenia współczynników przez stałe są zbyt częste i krótkie, by je zapisywać.
+    if (!trace_on || PolyIsCoeff(p) || PolyIsCoeff(q)) {
+        return PolyMulHelper(p, q);
+    }
+    uint64_t start = TraceStart();
+    Poly r = PolyMulHelper(p, q);
+    TracePhase("PolyMul", start, 2, (TraceArg[]) {{"p_monos", (long) p->size}, {"q_monos", (long) q->size}});
+    return r;
 }
 
 /**
@@ -410,10 +571,13 @@ Poly PolyNeg(const Poly *p) {
         return (Poly) {.coeff = (-1) * (p->coeff), .arr = NULL};
     } else {
         Poly r = (Poly) {.size = p->size, .arr = NULL};
-        r.arr = malloc(p->size * sizeof(Mono));
+        r.arr = MonosAlloc(p->size);
         CHECK_PTR(r.arr);
+        // Współczynniki stałe negujemy w miejscu, bez wywołania rekurencyjnego.
         for (size_t i = 0; i < p->size; ++i) {
-            r.arr[i] = MonoNeg(&p->arr[i]);
+            const Mono *m = &p->arr[i];
+            r.arr[i] = PolyIsCoeff(&m->p) ? (Mono) {.p = PolyFromCoeff((-1) * m->p.coeff), .exp = m->exp}
+                                          : MonoNeg(m);
         }
         return r;
     }
@@ -427,33 +591,352 @@ Poly PolySub(const Poly *p, const Poly *q) {
     return r;
 }
 
+/**
+ * Neguje wielomian w miejscu, bez alokowania nowych tablic jednomianów.
+ * @param[in,out] p : wielomian @f$p@f$, zastępowany przez @f$-p@f$
+ */
+static void PolyNegInPlace(Poly *p) {
+    if (PolyIsCoeff(p)) {
+        p->coeff = (-1) * p->coeff;
+        return;
+    }
+    PolyFrames fs;
+    FramesInit(&fs);
+    FramesPush(&fs, (PolyFrame) {.r = p});
+    PolyFrame *f;
+    while ((f = FramesTop(&fs)) != NULL) {
+        if (f->i < f->r->size) {
+            Poly *c = &f->r->arr[f->i].p;
+            ++f->i;
+            if (PolyIsCoeff(c)) {
+                c->coeff = (-1) * c->coeff;
+            } else {
+                FramesPush(&fs, (PolyFrame) {.r = c});
+            }
+        } else {
+            FramesPop(&fs);
+        }
+    }
+    FramesDestroy(&fs);
+}
+
+/**
+ * Sortuje jednomiany po wykładnikach, scalając posortowane serie
+ * jednomianów. Jednomiany sumy pochodzą z posortowanych tablic
+ * jednomianów, więc serii jest niewiele, a tablica złożona z jednej
+ * serii nie jest przepisywana.
+ * @param[in] count : liczba jednomianów
+ * @param[in,out] monos : tablica jednomianów
+ */
+static void MonosSort(size_t count, Mono *monos) {
+    size_t *bounds = PolyMalloc((count + 1) * sizeof(size_t));
+    CHECK_PTR(bounds);
+    size_t runs = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (i == 0 || monos[i].exp < monos[i - 1].exp) {
+            bounds[runs++] = i;
+        }
+    }
+    bounds[runs] = count;
+    if (runs > 1) {
+        Mono *src = monos;
+        Mono *dst = PolyMalloc(count * sizeof(Mono));
+        CHECK_PTR(dst);
+        Mono *buf = dst;
+        while (runs > 1) {
+            size_t merged = 0;
+            for (size_t r = 0; r < runs; r += 2) {
+                size_t i = bounds[r];
+                size_t mid = bounds[r + 1];
+                size_t j = mid;
+                size_t hi = r + 2 <= runs ? bounds[r + 2] : mid;
+                size_t k = i;
+                while (i < mid && j < hi) {
+                    dst[k++] = src[j].exp < src[i].exp ? src[j++] : src[i++];
+                }
+                memcpy(dst + k, src + i, (mid - i) * sizeof(Mono));
+                k += mid - i;
+                memcpy(dst + k, src + j, (hi - j) * sizeof(Mono));
+                bounds[merged++] = bounds[r];
+            }
+            bounds[merged] = count;
+            runs = merged;
+            Mono *temp = src;
+            src = dst;
+            dst = temp;
+        }
+        if (src != monos) {
+            memcpy(monos, src, count * sizeof(Mono));
+        }
+        PolyFree(buf);
+    }
+    PolyFree(bounds);
+}
+
+/**
+ * Dodaje do wielomianu niestałego stałą, przejmując go na własność.
+ * @param[in] p : wielomian niestały @f$p@f$
+ * @param[in] c : stała @f$c@f$
+ * @return @f$p + c@f$
+ */
+static Poly PolyAddCoeffOwn(Poly *p, poly_coeff_t c) {
+    Poly r = *p;
+    *p = PolyZero();
+    if (c == 0) {
+        return r;
+    }
+    Poly k = PolyFromCoeff(c);
+    if (r.arr[0].exp == 0) {
+        r.arr[0].p = PolyAddOwn(&r.arr[0].p, &k);
+        if (PolyIsZero(&r.arr[0].p)) {
+            --r.size;
+            memmove(r.arr, r.arr + 1, r.size * sizeof(Mono));
+        }
+    } else {
+        r.arr = PolyRealloc(r.arr, (r.size + 1) * sizeof(Mono));
+        CHECK_PTR(r.arr);
+        ++alloc_stats.terms;
+        memmove(r.arr + 1, r.arr, r.size * sizeof(Mono));
+        r.arr[0] = (Mono) {.p = k, .exp = 0};
+        ++r.size;
+    }
+    // Po dodaniu stałej wielomian mógł stać się stałą.
+    if (r.size == 1 && r.arr[0].exp == 0 && PolyIsCoeff(&r.arr[0].p)) {
+        c = r.arr[0].p.coeff;
+        PolyFree(r.arr);
+        return PolyFromCoeff(c);
+    }
+    return r;
+}
+
+Poly PolyAddOwn(Poly *p, Poly *q) {
+    assert(p != NULL && q != NULL);
+    assert(PolyIsSimple(p) && PolyIsSimple(q));
+    if (PolyIsCoeff(p) && PolyIsCoeff(q)) {
+        Poly r = PolyFromCoeff(p->coeff + q->coeff);
+        *p = *q = PolyZero();
+        return r;
+    } else if (PolyIsCoeff(p)) {
+        poly_coeff_t c = p->coeff;
+        *p = PolyZero();
+        return PolyAddCoeffOwn(q, c);
+    } else if (PolyIsCoeff(q)) {
+        poly_coeff_t c = q->coeff;
+        *q = PolyZero();
+        return PolyAddCoeffOwn(p, c);
+    }
+    Mono *arr = MonosAlloc((p->size + q->size));
+    CHECK_PTR(arr);
+    size_t p_i = 0;
+    size_t q_i = 0;
+    size_t k = 0;
+    while (p_i < p->size && q_i < q->size) {
+        Mono *m = &p->arr[p_i];
+        Mono *n = &q->arr[q_i];
+        if (m->exp < n->exp) {
+            arr[k++] = *m;
+            ++p_i;
+        } else if (m->exp > n->exp) {
+            arr[k++] = *n;
+            ++q_i;
+        } else {
+            // Stałe współczynniki sumujemy w miejscu, bez wywołania rekurencyjnego.
+            Poly sum = PolyIsCoeff(&m->p) && PolyIsCoeff(&n->p) ? PolyFromCoeff(m->p.coeff + n->p.coeff)
+                                                                : PolyAddOwn(&m->p, &n->p);
+            arr[k] = (Mono) {.p = sum, .exp = m->exp};
+            k += !PolyIsZero(&sum);
+            ++p_i;
+            ++q_i;
+        }
+    }
+    memcpy(arr + k, p->arr + p_i, (p->size - p_i) * sizeof(Mono));
+    k += p->size - p_i;
+    memcpy(arr + k, q->arr + q_i, (q->size - q_i) * sizeof(Mono));
+    k += q->size - q_i;
+    PolyFree(p->arr);
+    PolyFree(q->arr);
+    *p = *q = PolyZero();
+    return PolyFromSortedMonos(k, arr);
+}
+
+/**
+ * Sumuje wielomiany, przejmując je na własność. Wielomiany dodawane są
+ * parami, jak w drzewie turniejowym, dzięki czemu każdy jednomian jest
+ * przenoszony tylko logarytmicznie wiele razy.
+ * @param[in] count : liczba wielomianów
+ * @param[in,out] polys : tablica wielomianów, po wywołaniu nieokreślona
+ * @return suma wielomianów
+ */
+static Poly PolysReduce(size_t count, Poly polys[]) {
+    if (count == 0) {
+        return PolyZero();
+    }
+    while (count > 1) {
+        size_t half = 0;
+        for (size_t i = 0; i + 1 < count; i += 2) {
+            polys[half++] = PolyAddOwn(&polys[i], &polys[i + 1]);
+        }
+        if (count % 2 == 1) {
+            polys[half++] = polys[count - 1];
+        }
+        count = half;
+    }
+    return polys[0];
+}
+
+/** Liczba sumowanych współczynników, dla których nie alokujemy pamięci. */
+#define GROUP_BUFFER_SIZE 8
+
+/**
+ * Sortuje jednomiany, scala te o jednakowych wykładnikach
+ * i tworzy z nich wielomian. Przejmuje na własność tablicę
+ * @p monos i jej zawartość.
+ * @param[in] count : liczba jednomianów
+ * @param[in] monos : tablica jednomianów
+ * @return wielomian będący sumą jednomianów
+ */
+static Poly PolyMergeMonos(size_t count, Mono *monos) {
+    uint64_t start = TraceStart();
+    MonosSort(count, monos);
+    TracePhase("MonosSort", start, 1, (TraceArg[]) {{"monos", (long) count}});
+    Poly buf[GROUP_BUFFER_SIZE];
+    size_t k = 0;
+    size_t i = 0;
+    while (i < count) {
+        size_t j = i + 1;
+        poly_coeff_t c = PolyIsCoeff(&monos[i].p) ? monos[i].p.coeff : 0;
+        bool coeffs = PolyIsCoeff(&monos[i].p);
+        while (j < count && monos[j].exp == monos[i].exp) {
+            coeffs = coeffs && PolyIsCoeff(&monos[j].p);
+            c += PolyIsCoeff(&monos[j].p) ? monos[j].p.coeff : 0;
+            ++j;
+        }
+        Mono m = monos[i];
+        if (j - i > 1 && coeffs) {
+            m.p = PolyFromCoeff(c);
+        } else if (j - i > 1) {
+            Poly *group = j - i <= GROUP_BUFFER_SIZE ? buf : PolyMalloc((j - i) * sizeof(Poly));
+            CHECK_PTR(group);
+            for (size_t l = i; l < j; ++l) {
+                group[l - i] = monos[l].p;
+            }
+            m.p = PolysReduce(j - i, group);
+            if (group != buf) {
+                PolyFree(group);
+            }
+        }
+        if (!PolyIsZero(&m.p)) {
+            monos[k++] = m;
+        }
+        i = j;
+    }
+    Poly r = PolyFromSortedMonos(k, monos);
+    assert(PolyIsSimple(&r));
+    return r;
+}
+
+/**
+ * Oblicza wartość składnika sumy jako wielomian na własność.
+ * Iloczyn wielomianów niestałych tworzony jest bezpośrednio z iloczynów
+ * jednomianów, bez pośrednich kopii tablicy jednomianów.
+ * @param[in,out] t : składnik
+ * @return wartość składnika
+ */
+static Poly PolyTermValue(PolyTerm *t) {
+    const Poly *p = t->p;
+    const Poly *q = t->q;
+    if (q == NULL && t->own) {
+        Poly r = *t->p;
+        *t->p = PolyZero();
+        if (t->neg) {
+            PolyNegInPlace(&r);
+        }
+        return r;
+    } else if (q == NULL) {
+        return t->neg ? PolyNeg(p) : PolyClone(p);
+    }
+    if (PolyIsCoeff(p)) {
+        const Poly *temp = p;
+        p = q;
+        q = temp;
+    }
+    if (PolyIsCoeff(q)) {
+        Poly k = PolyFromCoeff(t->neg ? (-1) * q->coeff : q->coeff);
+        return PolyMulByCoeff(p, &k);
+    }
+    Mono *monos = MonosAlloc(p->size * q->size);
+    CHECK_PTR(monos);
+    size_t n = 0;
+    for (size_t i = 0; i < p->size; ++i) {
+        for (size_t j = 0; j < q->size; ++j) {
+            Mono m = MonoMul(&p->arr[i], &q->arr[j]);
+            if (t->neg) {
+                PolyNegInPlace(&m.p);
+            }
+            monos[n++] = m;
+            AllocGuardPoll();
+        }
+    }
+    return PolyMergeMonos(n, monos);
+}
+
+Poly PolySumTerms(size_t count, PolyTerm terms[]) {
+    assert(count == 0 || terms != NULL);
+    if (count == 1) {
+        return PolyTermValue(&terms[0]);
+    }
+    Poly *polys = PolyMalloc(count * sizeof(Poly));
+    CHECK_PTR(polys);
+    for (size_t i = 0; i < count; ++i) {
+        polys[i] = PolyTermValue(&terms[i]);
+    }
+    Poly r = PolysReduce(count, polys);
+    PolyFree(polys);
+    return r;
+}
+
 poly_exp_t PolyDegBy(const Poly *p, size_t var_idx) {
     assert(p != NULL);
     assert(PolyIsSimple(p));
-    if (var_idx == 0 || PolyIsCoeff(p)) {
-        // Wielomian stały jest stały bez względu na indeks zmiennej.
-        if (PolyIsZero(p)) {
-            return -1;
-        } else if (!PolyIsCoeff(p)) {
+    // Wielomian stały jest stały bez względu na indeks zmiennej.
+    if (PolyIsZero(p)) {
+        return -1;
+    } else if (PolyIsCoeff(p)) {
+        return 0;
+    }
+    poly_exp_t exp_max = -1;
+    PolyFrames fs;
+    FramesInit(&fs);
+    FramesPush(&fs, (PolyFrame) {.p = p, .level = 0});
+    PolyFrame *f;
+    while ((f = FramesTop(&fs)) != NULL) {
+        if (f->level == var_idx) {
             // W posortowanej tablicy jednomianów,
             // jednomian o najwyższym wykładniku
             // znajduje się na jej końcu.
-            return p->arr[p->size - 1].exp;
-        } else {
-            return 0;
-        }
-    } else if (var_idx > 0) {
-        poly_exp_t exp_max = -1;
-        for (size_t i = 0; i < p->size; ++i) {
-            poly_exp_t exp_temp = PolyDegBy(&p->arr[i].p, var_idx - 1);
+            poly_exp_t exp_temp = f->p->arr[f->p->size - 1].exp;
             if (exp_max < exp_temp) {
                 exp_max = exp_temp;
             }
+            FramesPop(&fs);
+        } else if (f->i < f->p->size) {
+            const Poly *c = &f->p->arr[f->i].p;
+            size_t level = f->level + 1;
+            ++f->i;
+            if (PolyIsCoeff(c)) {
+                // Niezerowy współczynnik ma stopień 0 względem każdej zmiennej.
+                if (exp_max < 0) {
+                    exp_max = 0;
+                }
+            } else {
+                FramesPush(&fs, (PolyFrame) {.p = c, .level = level});
+            }
+        } else {
+            FramesPop(&fs);
         }
-        return exp_max;
-    } else {
-        return 0;
     }
+    FramesDestroy(&fs);
+    return exp_max;
 }
 
 poly_exp_t PolyDeg(const Poly *p) {
@@ -463,53 +946,152 @@ poly_exp_t PolyDeg(const Poly *p) {
         return -1;
     } else if (PolyIsCoeff(p)) {
         return 0;
-    } else {
-        poly_exp_t exp_max = -1;
-        for (size_t i = 0; i < p->size; ++i) {
-            poly_exp_t exp_temp;
-            if (PolyIsCoeff(&p->arr[i].p)) {
-                exp_temp = MonoGetExp(&p->arr[i]);
+    }
+    // Ogólny stopień jednomianu jest sumą jego wykładnika i stopnia
+    // współczynnika, więc stopień wielomianu jest największą sumą
+    // wykładników na ścieżce od korzenia do współczynnika stałego.
+    poly_exp_t exp_max = -1;
+    PolyFrames fs;
+    FramesInit(&fs);
+    FramesPush(&fs, (PolyFrame) {.p = p, .e = 0});
+    PolyFrame *f;
+    while ((f = FramesTop(&fs)) != NULL) {
+        if (f->i < f->p->size) {
+            const Mono *m = &f->p->arr[f->i];
+            poly_exp_t exp_temp = f->e + MonoGetExp(m);
+            ++f->i;
+            if (PolyIsCoeff(&m->p)) {
+                if (exp_max < exp_temp) {
+                    exp_max = exp_temp;
+                }
             } else {
-                // Ogólny stopień jednomianu jest sumą
-                // jego wykładnika i stopnia współczynnika.
-                exp_temp = MonoGetExp(&p->arr[i]) + PolyDeg(&p->arr[i].p);
-            }
-            if (exp_max < exp_temp) {
-                exp_max = exp_temp;
+                FramesPush(&fs, (PolyFrame) {.p = &m->p, .e = exp_temp});
             }
+        } else {
+            FramesPop(&fs);
         }
-        return exp_max;
     }
+    FramesDestroy(&fs);
+    return exp_max;
 }
 
 /**
- * Sprawdza równość dwóch jednomianów.
- * @param[in] m : jednomian @f$m@f$
- * @param[in] n : jednomian @f$n@f$
- * @return @f$m = n@f$
+ * Dolicza do opisu wielomianu wielomian @p q niebędący współczynnikiem,
+ * leżący na poziomie @p level.
+ * @param[in,out] s : opis wielomianu
+ * @param[in,out] cap : rozmiar tablicy poziomów
+ * @param[in] q : wielomian
+ * @param[in] level : poziom wielomianu @p q
  */
-static inline bool MonoIsEq(const Mono *m, const Mono *n) {
-    return (m->exp == n->exp && PolyIsEq(&m->p, &n->p));
+static void PolyStatsAddNode(PolyStats *s, size_t *cap, const Poly *q, size_t level) {
+    if (level == s->depth) {
+        if (level == *cap) {
+            *cap = *cap == 0 ? INIT_SIZE : MULTIPLIER * *cap;
+            s->levels = PolyRealloc(s->levels, *cap * sizeof(PolyLevelStats));
+            CHECK_PTR(s->levels);
+        }
+        s->levels[level] = (PolyLevelStats) {.deg = 0};
+        ++s->depth;
+    }
+    PolyLevelStats *l = &s->levels[level];
+    poly_exp_t deg = MonoGetExp(&q->arr[q->size - 1]);
+    ++l->nodes;
+    l->monos += q->size;
+    l->slots += (size_t) deg + 1;
+    if (l->deg < deg) {
+        l->deg = deg;
+    }
+    ++s->nodes;
+    s->bytes += malloc_usable_size(q->arr);
+}
+
+/**
+ * Dolicza do opisu wielomianu niezerowy współczynnik stały.
+ * @param[in,out] s : opis wielomianu
+ * @param[in] c : współczynnik
+ */
+static inline void PolyStatsAddCoeff(PolyStats *s, poly_coeff_t c) {
+    // Wartość bezwzględną liczymy bez znaku, bo -LONG_MIN nie mieści się w long.
+    unsigned long abs = c < 0 ? -(unsigned long) c : (unsigned long) c;
+    if (s->max_coeff < abs) {
+        s->max_coeff = abs;
+    }
+    ++s->terms;
+}
+
+PolyStats PolyGetStats(const Poly *p) {
+    assert(p != NULL);
+    assert(PolyIsSimple(p));
+    PolyStats s = {.levels = NULL};
+    if (PolyIsCoeff(p)) {
+        if (!PolyIsZero(p)) {
+            PolyStatsAddCoeff(&s, p->coeff);
+        }
+        return s;
+    }
+    size_t cap = 0;
+    PolyFrames fs;
+    FramesInit(&fs);
+    PolyStatsAddNode(&s, &cap, p, 0);
+    FramesPush(&fs, (PolyFrame) {.p = p, .level = 0});
+    PolyFrame *f;
+    while ((f = FramesTop(&fs)) != NULL) {
+        if (f->i < f->p->size) {
+            const Poly *c = &f->p->arr[f->i].p;
+            size_t level = f->level + 1;
+            ++f->i;
+            if (PolyIsCoeff(c)) {
+                PolyStatsAddCoeff(&s, c->coeff);
+            } else {
+                PolyStatsAddNode(&s, &cap, c, level);
+                FramesPush(&fs, (PolyFrame) {.p = c, .level = level});
+            }
+        } else {
+            FramesPop(&fs);
+        }
+    }
+    FramesDestroy(&fs);
+    return s;
+}
+
+void PolyStatsDestroy(PolyStats *s) {
+    PolyFree(s->levels);
 }
 
 bool PolyIsEq(const Poly *p, const Poly *q) {
     assert(p != NULL && q != NULL);
     assert(PolyIsSimple(p) && PolyIsSimple(q));
-    bool r;
     /// Wielomiany @f$ p @f$ i @f$ q @f$ są w najprostszej postaci,
     /// więc mają jednoznaczną reprezentacje.
-    if (PolyIsCoeff(p) && PolyIsCoeff(q)) {
-        r = (p->coeff == q->coeff);
-    } else if (!PolyIsCoeff(p) && !PolyIsCoeff(q)) {
-        r = (p->size == q->size);
-        size_t i = 0;
-        while (r && i < p->size) {
-            r = MonoIsEq(&p->arr[i], &q->arr[i]);
-            ++i;
+    if (PolyIsCoeff(p) || PolyIsCoeff(q)) {
+        return PolyIsCoeff(p) && PolyIsCoeff(q) && p->coeff == q->coeff;
+    } else if (p->size != q->size) {
+        return false;
+    }
+    bool r = true;
+    PolyFrames fs;
+    FramesInit(&fs);
+    FramesPush(&fs, (PolyFrame) {.p = p, .q = q});
+    PolyFrame *f;
+    while (r && (f = FramesTop(&fs)) != NULL) {
+        if (f->i < f->p->size) {
+            const Mono *m = &f->p->arr[f->i];
+            const Mono *n = &f->q->arr[f->i];
+            ++f->i;
+            if (m->exp != n->exp || PolyIsCoeff(&m->p) != PolyIsCoeff(&n->p)) {
+                r = false;
+            } else if (PolyIsCoeff(&m->p)) {
+                r = m->p.coeff == n->p.coeff;
+            } else if (m->p.size != n->p.size) {
+                r = false;
+            } else {
+                FramesPush(&fs, (PolyFrame) {.p = &m->p, .q = &n->p});
+            }
+        } else {
+            FramesPop(&fs);
         }
-    } else {
-        r = false;
     }
+    FramesDestroy(&fs);
     return r;
 }
 
@@ -532,87 +1114,127 @@ static poly_coeff_t Power(poly_coeff_t c, poly_exp_t e) {
     return res;
 }
 
-/**
- * Zwraca wielomian będący sumą wielu wielomianów.
- * @param[in] p_arr : tablica wielomianów @f$p\_arr@f$
- * @param[in] n : liczba dodawanych wielomianów @f$n@f$
- * @return @f$ p\_arr[0] + p\_arr[1]  + ... + p\_arr[n-1]@f$
- */
-static Poly PolyAddMult(const Poly *p_arr, size_t n) {
-    if (n > 0) {
-        Poly r = PolyClone(&p_arr[0]);
-        for (size_t i = 1; i < n; ++i) {
-            Poly temp = r;
-            r = PolyAdd(&temp, &p_arr[i]);
-            PolyDestroy(&temp);
-        }
-        return r;
-    } else {
-        return PolyZero();
-    }
-}
-
 Poly PolyAt(const Poly *p, poly_coeff_t x) {
     assert(p != NULL);
     assert(PolyIsSimple(p));
     if (PolyIsCoeff(p)) {
         return PolyFromCoeff(p->coeff);
-    } else {
-        Poly *temp = malloc(p->size * sizeof(Poly));
-        CHECK_PTR(temp);
-        poly_exp_t prev_e = 0;
-        for (size_t i = 0; i < p->size; ++i) {
-            Mono m = p->arr[i];
-            Poly c = PolyFromCoeff(Power(x, MonoGetExp(&m) - prev_e));
-            temp[i] = PolyMulByCoeff(&m.p, &c);
-        }
-        Poly r = PolyAddMult(temp, p->size);
-        for (size_t i = 0; i < p->size; ++i) {
-            PolyDestroy(&temp[i]);
+    }
+    // Składniki o stałych współczynnikach sumujemy od razu, a wielomiany
+    // pośrednie tworzymy tylko dla współczynników niestałych.
+    Poly *temp = NULL;
+    size_t n = 0;
+    poly_coeff_t sum = 0;
+    poly_coeff_t power = 1;
+    poly_exp_t prev_e = 0;
+    for (size_t i = 0; i < p->size; ++i) {
+        const Mono *m = &p->arr[i];
+        power *= Power(x, MonoGetExp(m) - prev_e);
+        prev_e = MonoGetExp(m);
+        if (PolyIsCoeff(&m->p)) {
+            sum += m->p.coeff * power;
+        } else {
+            if (temp == NULL) {
+                temp = PolyMalloc((p->size + 1) * sizeof(Poly));
+                CHECK_PTR(temp);
+            }
+            Poly c = PolyFromCoeff(power);
+            temp[n++] = PolyMulByCoeff(&m->p, &c);
+            AllocGuardPoll();
         }
-        free(temp);
-        PolySimplify(&r);
-        return r;
     }
+    if (temp == NULL) {
+        return PolyFromCoeff(sum);
+    }
+    if (sum != 0) {
+        temp[n++] = PolyFromCoeff(sum);
+    }
+    // Składniki sumujemy parami, przenosząc ich jednomiany zamiast kopiować.
+    Poly r = PolysReduce(n, temp);
+    PolyFree(temp);
+    return r;
 }
 
-static void PolyPrintHelper(const Poly *p);
+/** Rozmiar bufora na zapis jednego jednomianu o stałym współczynniku. */
+#define MONO_TEXT_SIZE (2 * NUMBER_MAX_LENGTH + 4)
 
-/**
- * Wypisuje na standardowe wyjście
- * jednomian w najprostszej postaci.
- * @param[in] m : jednomian @f$ m @f$
- */
-static void MonoPrint(const Mono *m) {
-    assert(m != NULL);
-    printf("(");
-    PolyPrintHelper(&m->p);
-    printf(",%d", MonoGetExp(m));
-    printf(")");
-}
+/** Rozmiar bufora na stosie wywołań przy wypisywaniu do strumienia. */
+#define PRINT_BUFFER_SIZE 4096
 
-/**
- * Umożliwia poprawne wypisywanie
- * znaku końca wiersza itp., po wielomianie.
- * @param[in] p : wielomian @f$ p @f$
- */
-static void PolyPrintHelper(const Poly *p) {
-    assert(p != NULL);
+void PolyWrite(const Poly *p, Writer *w) {
+    assert(p != NULL && w != NULL);
+    char buf[MONO_TEXT_SIZE];
+    char *end;
     if (PolyIsCoeff(p)) {
-        printf("%ld", p->coeff);
-    } else {
-        for (size_t i = 0; i < p->size - 1; ++i) {
-            MonoPrint(&p->arr[i]);
-            printf("+");
+        WriterLong(w, p->coeff);
+        return;
+    }
+    // Jednomian ma postać `(współczynnik,wykładnik)`. Po wypisaniu
+    // współczynnika niestałego jego ramka jest zdejmowana, a ramka rodzica
+    // domyka rozpoczęty jednomian. Każdy fragment jest najpierw składany
+    // w małym buforze, a potem przekazywany do zapisu w całości.
+    PolyFrames fs;
+    FramesInit(&fs);
+    FramesPush(&fs, (PolyFrame) {.p = p});
+    PolyFrame *f;
+    while ((f = FramesTop(&fs)) != NULL) {
+        if (f->i < f->p->size) {
+            const Mono *m = &f->p->arr[f->i];
+            end = buf;
+            if (f->i > 0) {
+                *end++ = '+';
+            }
+            *end++ = '(';
+            if (PolyIsCoeff(&m->p)) {
+                end = NumberFormatLong(m->p.coeff, end);
+                *end++ = ',';
+                end = NumberFormatLong(MonoGetExp(m), end);
+                *end++ = ')';
+                ++f->i;
+            } else {
+                FramesPush(&fs, (PolyFrame) {.p = &m->p});
+            }
+            WriterWrite(w, buf, (size_t) (end - buf));
+        } else {
+            FramesPop(&fs);
+            if ((f = FramesTop(&fs)) != NULL) {
+                // Domykamy jednomian, którego współczynnik został wypisany.
+                end = buf;
+                *end++ = ',';
+                end = NumberFormatLong(MonoGetExp(&f->p->arr[f->i]), end);
+                *end++ = ')';
+                WriterWrite(w, buf, (size_t) (end - buf));
+                ++f->i;
+            }
         }
-        MonoPrint(&p->arr[p->size - 1]);
     }
+    FramesDestroy(&fs);
+}
+
+void PolyPrintTo(const Poly *p, FILE *file) {
+    assert(p != NULL && file != NULL);
+    char buf[PRINT_BUFFER_SIZE];
+    Writer w;
+    WriterInitFile(&w, file, buf, sizeof(buf));
+    PolyWrite(p, &w);
+    WriterChar(&w, '\n');
+    WriterDestroy(&w);
 }
 
 void PolyPrint(const Poly *p) {
-    assert(p != NULL);
-    PolyPrintHelper(p);
-    printf("\n");
+    PolyPrintTo(p, stdout);
+}
+
+size_t PolyFormat(const Poly *p, char *buf, size_t cap) {
+    assert(p != NULL && (buf != NULL || cap == 0));
+    Writer w;
+    // Ostatni bajt bufora rezerwujemy na znak '\0'.
+    WriterInitMem(&w, buf, cap > 0 ? cap - 1 : 0);
+    PolyWrite(p, &w);
+    if (cap > 0) {
+        buf[w.len] = '\0';
+    }
+    return w.total;
 }
 
 /**
@@ -629,6 +1251,7 @@ static Poly PolyPower(const Poly *p, poly_exp_t e) {
         Poly base = PolyClone(p);
         Poly temp;
         while (e > 0) {
+            AllocGuardPoll();
             if (e & 1) {
                 temp = res;
                 res = PolyMul(&res, &base);
@@ -675,7 +1298,11 @@ Poly PolyCompose(const Poly *p, size_t k, const Poly q[]) {
             Poly temp;
             Poly composed;
             for (size_t i = 0; i < p->size; ++i) {
+                AllocGuardPoll();
+                uint64_t start = TraceStart();
                 temp = PolyPower(q, MonoGetExp(&p->arr[i]) - prev_exp);
+                TracePhase("PolyCompose power", start, 1,
+                           (TraceArg[]) {{"exp", (long) (MonoGetExp(&p->arr[i]) - prev_exp)}});
                 new_inner = PolyMul(&temp, &prev_inner);
                 PolyDestroy(&prev_inner);
                 PolyDestroy(&temp);
@@ -683,10 +1310,7 @@ Poly PolyCompose(const Poly *p, size_t k, const Poly q[]) {
                 prev_inner = new_inner;
 
                 composed = MonoCompose(&p->arr[i], k, q, &new_inner);
-                temp = r;
-                r = PolyAdd(&r, &composed);
-                PolyDestroy(&temp);
-                PolyDestroy(&composed);
+                r = PolyAddOwn(&r, &composed);
             }
             PolyDestroy(&new_inner);
         }
@@ -12,6 +12,7 @@
 #include <assert.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 
 /** To jest typ reprezentujący współczynniki. */
 typedef long poly_coeff_t;
@@ -21,6 +22,8 @@ typedef int poly_exp_t;
 
 struct Mono;
 
+struct Writer;
+
 /**
  * To jest struktura przechowująca wielomian.
  * Wielomian jest albo liczbą całkowitą, czyli wielomianem stałym
@@ -64,6 +67,16 @@ typedef struct Mono {
     }                 \
   } while (0)
 
+/**
+ * Największa głębokość zagnieżdżenia wielomianów przyjmowanych przez parser
+ * i odczyt z formatu binarnego. Limit jest wyższy niż głębokość, którą
+ * mieścił na domyślnym stosie 8 MiB dawny rekurencyjny parser (około 75000),
+ * więc nie odrzuca wcześniej przyjmowanych wielomianów. Działania
+ * arytmetyczne i wyliczanie wartości nadal przechodzą wielomian rekurencyjnie
+ * i na takim stosie obsługują około 60000 poziomów, tak jak dotąd.
+ */
+#define POLY_MAX_DEPTH 100000
+
 
 /**
  * Daje wartość wykładnika jednomianu.
@@ -193,6 +206,20 @@ Poly PolyAddMonos(size_t count, const Mono monos[]);
  */
 Poly PolyOwnMonos(size_t count, Mono *monos);
 
+/**
+ * Tworzy wielomian z tablicy jednomianów, która jest już w najprostszej
+ * postaci: jest niepusta, wykładniki są posortowane ściśle rosnąco,
+ * współczynniki są niezerowe i w najprostszej postaci, a jedyny jednomian
+ * nie jest stałą postaci @f$c x^0@f$. Nie sortuje ani nie scala jednomianów.
+ * Przejmuje na własność pamięć wskazywaną przez @p monos i jej zawartość.
+ * Zakładamy, że pamięć wskazywana przez @p monos została zaalokowana na
+ * stercie i ma rozmiar dokładnie @p count jednomianów.
+ * @param[in] count : liczba jednomianów
+ * @param[in] monos : tablica jednomianów
+ * @return wielomian będący sumą jednomianów
+ */
+Poly PolyOwnSimpleMonos(size_t count, Mono *monos);
+
 /**
  * Sumuje listę jednomianów i tworzy z nich wielomian. Nie modyfikuje zawartości
  * tablicy @p monos. Jeśli jest to wymagane, to wykonuje pełne kopie jednomianów
@@ -227,6 +254,38 @@ Poly PolyNeg(const Poly *p);
  */
 Poly PolySub(const Poly *p, const Poly *q);
 
+/**
+ * Dodaje dwa wielomiany, przejmując je na własność. Jednomiany są
+ * przenoszone do wyniku zamiast kopiowania, a oba wielomiany zostają
+ * zastąpione wielomianem zerowym.
+ * @param[in,out] p : wielomian @f$p@f$
+ * @param[in,out] q : wielomian @f$q@f$
+ * @return @f$p + q@f$
+ */
+Poly PolyAddOwn(Poly *p, Poly *q);
+
+/**
+ * To jest struktura opisująca składnik sumy obliczanej funkcją PolySumTerms:
+ * wielomian @f$p@f$ albo iloczyn @f$p \cdot q@f$, być może ze znakiem minus.
+ */
+typedef struct PolyTerm {
+  Poly *p; ///< wielomian lub pierwszy czynnik iloczynu
+  const Poly *q; ///< drugi czynnik iloczynu albo NULL
+  bool neg; ///< czy składnik jest zanegowany
+  bool own; ///< czy suma przejmuje wielomian @p p na własność (tylko gdy `q == NULL`)
+} PolyTerm;
+
+/**
+ * Sumuje składniki, dodając je parami bez kopiowania sum częściowych.
+ * Jednomiany wielomianów przejmowanych na własność są przenoszone do wyniku
+ * zamiast kopiowania, a wielomiany te zostają zastąpione wielomianem
+ * zerowym. Pozostałe wielomiany nie są modyfikowane.
+ * @param[in] count : liczba składników
+ * @param[in,out] terms : tablica składników
+ * @return suma składników
+ */
+Poly PolySumTerms(size_t count, PolyTerm terms[]);
+
 /**
  * Zwraca stopień wielomianu ze względu na zadaną zmienną (-1 dla wielomianu
  * tożsamościowo równego zeru). Zmienne indeksowane są od 0.
@@ -246,6 +305,54 @@ poly_exp_t PolyDegBy(const Poly *p, size_t var_idx);
  */
 poly_exp_t PolyDeg(const Poly *p);
 
+/**
+ * To jest struktura opisująca jeden poziom zagnieżdżenia wielomianu,
+ * czyli wielomiany nad jedną zmienną.
+ */
+typedef struct PolyLevelStats {
+    size_t nodes; ///< liczba wielomianów na tym poziomie niebędących współczynnikami
+    size_t monos; ///< liczba ich jednomianów
+    size_t slots; ///< suma ich stopni powiększonych o 1 (mianownik gęstości)
+    poly_exp_t deg; ///< stopień wielomianu ze względu na zmienną tego poziomu
+} PolyLevelStats;
+
+/** To jest struktura opisująca kształt wielomianu i zajmowaną przez niego pamięć. */
+typedef struct PolyStats {
+    size_t depth; ///< liczba poziomów zagnieżdżenia (0 dla współczynnika)
+    size_t nodes; ///< liczba wielomianów niebędących współczynnikami
+    size_t terms; ///< liczba jednomianów po rozwinięciu, czyli niezerowych współczynników stałych
+    unsigned long max_coeff; ///< największa wartość bezwzględna współczynnika
+    size_t bytes; ///< liczba bajtów zajmowanych na stercie przez tablice jednomianów
+    PolyLevelStats *levels; ///< tablica `depth` opisów kolejnych poziomów
+} PolyStats;
+
+/**
+ * Wylicza w jednym przejściu kształt wielomianu: głębokość, liczby wielomianów
+ * i jednomianów na każdym poziomie, stopnie ze względu na wszystkie zmienne
+ * (`levels[i].deg` jest równe `PolyDegBy(p, i)`), największy współczynnik
+ * i rozmiar bloków pamięci. Wynik należy zwolnić funkcją PolyStatsDestroy().
+ * @param[in] p : wielomian
+ * @return opis wielomianu @p p
+ */
+PolyStats PolyGetStats(const Poly *p);
+
+/**
+ * Zwalnia pamięć opisu wielomianu.
+ * @param[in] s : opis wielomianu
+ */
+void PolyStatsDestroy(PolyStats *s);
+
+/**
+ * Wyszukuje binarnie jednomian wielomianu o zadanym wykładniku.
+ * Wielomian stały nie ma jednomianów.
+ * @param[in] p : wielomian
+ * @param[in] e : wykładnik
+ * @param[out] idx : indeks jednomianu o wykładniku @p e, a jeśli go nie ma,
+ * indeks, pod którym należałoby go wstawić
+ * @return Czy wielomian ma jednomian o wykładniku @p e?
+ */
+bool PolyFindExp(const Poly *p, poly_exp_t e, size_t *idx);
+
 /**
  * Sprawdza równość dwóch wielomianów.
  * @param[in] p : wielomian @f$p@f$
@@ -274,6 +381,35 @@ Poly PolyAt(const Poly *p, poly_coeff_t x);
  */
 void PolyPrint(const Poly *p);
 
+/**
+ * Wypisuje do strumienia @p file najprostszą reprezentację wielomianu
+ * zakończoną znakiem końca wiersza.
+ * @param[in] p : wielomian @f$ p @f$
+ * @param[in] file : strumień
+ */
+void PolyPrintTo(const Poly *p, FILE *file);
+
+/**
+ * Zapisuje do bufora @p buf najprostszą reprezentację wielomianu
+ * zakończoną znakiem `\0`. Tak jak `snprintf`, zapisuje co najwyżej
+ * `cap - 1` znaków i zwraca długość całej reprezentacji, więc wynik
+ * nie mniejszy niż @p cap oznacza, że bufor był za mały.
+ * @param[in] p : wielomian @f$ p @f$
+ * @param[out] buf : bufor
+ * @param[in] cap : rozmiar bufora
+ * @return długość reprezentacji wielomianu bez znaku `\0`
+ */
+size_t PolyFormat(const Poly *p, char *buf, size_t cap);
+
+/**
+ * Zapisuje najprostszą reprezentację wielomianu do buforowanego zapisu
+ * (bez znaku końca wiersza). Nie korzysta ze stanu globalnego, więc różne
+ * wątki mogą jednocześnie wypisywać wielomiany do różnych zapisów.
+ * @param[in] p : wielomian @f$ p @f$
+ * @param[in,out] w : zapis
+ */
+void PolyWrite(const Poly *p, struct Writer *w);
+
 /**
  * Wykonuje operację składania wielomianów.
  * @param[in] p : wielomian @f$ p @f$
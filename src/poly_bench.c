@@ -0,0 +1,425 @@
+/** @file
+ * Mikrobenchmarki operacji biblioteki wielomianów.
+ *
+ * Program generuje z zadanego ziarna pseudolosowe wielomiany o zadanym
+ * kształcie i mierzy czas operacji biblioteki na nich. Dla każdej operacji
+ * i kształtu wypisuje czas na operację, liczbę przetworzonych jednomianów
+ * na sekundę oraz liczbę alokacji na operację; z opcją `--json` wyniki
+ * wypisywane są w formacie JSON, by można je było porównywać między wersjami.
+ *
+ * Alokacje liczone są przez opakowanie funkcji `malloc`, `calloc`
+ * i `realloc` opcją konsolidatora `--wrap` (patrz CMakeLists.txt).
+ *
+ * @author Mateusz Sulimowicz <ms429603@students.mimuw.edu.pl>
+ * @date 2021
+ */
+
+/** Makro potrzebne do korzystania z GNU C Library. */
+#define _GNU_SOURCE
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "poly.h"
+#include "prob.h"
+
+/** Domyślne ziarno generatora wielomianów. */
+#define BENCH_SEED 2021
+
+/** Domyślny najkrótszy czas pomiaru jednej operacji w milisekundach. */
+#define BENCH_MIN_TIME_MS 200
+
+/** Największa liczba kształtów podanych opcjami `--shape`. */
+#define BENCH_MAX_SHAPES 64
+
+/** Największy moduł losowanego współczynnika. */
+#define BENCH_MAX_COEFF 100
+
+/** Liczba nanosekund w sekundzie. */
+#define NS_PER_S 1000000000.0
+
+/** Liczba alokacji wykonanych od początku programu. */
+static uint64_t bench_allocs;
+
+/** Oryginalna funkcja `malloc`. */
+void *__real_malloc(size_t size);
+
+/** Oryginalna funkcja `calloc`. */
+void *__real_calloc(size_t count, size_t size);
+
+/** Oryginalna funkcja `realloc`. */
+void *__real_realloc(void *ptr, size_t size);
+
+/**
+ * Alokuje pamięć, zliczając alokację.
+ * @param[in] size : rozmiar
+ * @return wskaźnik na pamięć
+ */
+void *__wrap_malloc(size_t size) {
+    ++bench_allocs;
+    return __real_malloc(size);
+}
+
+/**
+ * Alokuje wyzerowaną pamięć, zliczając alokację.
+ * @param[in] count : liczba elementów
+ * @param[in] size : rozmiar elementu
+ * @return wskaźnik na pamięć
+ */
+void *__wrap_calloc(size_t count, size_t size) {
+    ++bench_allocs;
+    return __real_calloc(count, size);
+}
+
+/**
+ * Zmienia rozmiar pamięci, zliczając to jako alokację.
+ * @param[in] ptr : wskaźnik na pamięć
+ * @param[in] size : nowy rozmiar
+ * @return wskaźnik na pamięć
+ */
+void *__wrap_realloc(void *ptr, size_t size) {
+    ++bench_allocs;
+    return __real_realloc(ptr, size);
+}
+
+/** To jest typ wyliczeniowy opisujący rozkład wykładników wielomianu. */
+typedef enum BenchKind {
+    BENCH_SPARSE, ///< wykładniki losowe z przedziału @f$ [0, max\_exp] @f$
+    BENCH_DENSE ///< kolejne wykładniki od zera
+} BenchKind;
+
+/** To jest struktura opisująca kształt generowanych wielomianów. */
+typedef struct BenchShape {
+    BenchKind kind; ///< rozkład wykładników
+    unsigned vars; ///< liczba zmiennych, czyli głębokość wielomianu
+    size_t terms; ///< liczba jednomianów na każdym poziomie
+    poly_exp_t max_exp; ///< największy wykładnik wielomianu rzadkiego
+} BenchShape;
+
+/** To jest typ wyliczeniowy opisujący mierzoną operację. */
+typedef enum BenchOp {
+    OP_ADD, ///< PolyAdd()
+    OP_MUL, ///< PolyMul()
+    OP_AT, ///< PolyAt()
+    OP_COMPOSE, ///< PolyCompose()
+    OP_CLONE, ///< PolyClone()
+    OP_IS_EQ, ///< PolyIsEq() dla równych wielomianów – najgorszy przypadek
+    OP_DEG, ///< PolyDeg()
+    OP_COUNT ///< liczba operacji
+} BenchOp;
+
+/** Nazwy mierzonych operacji. */
+static const char *const bench_op_names[OP_COUNT] = {
+    [OP_ADD] = "PolyAdd", [OP_MUL] = "PolyMul", [OP_AT] = "PolyAt", [OP_COMPOSE] = "PolyCompose",
+    [OP_CLONE] = "PolyClone", [OP_IS_EQ] = "PolyIsEq", [OP_DEG] = "PolyDeg",
+};
+
+/** Domyślne kształty wielomianów: rzadkie i gęste o rosnących rozmiarach. */
+static const BenchShape bench_default_shapes[] = {
+    {BENCH_SPARSE, 3, 2, 64}, {BENCH_SPARSE, 3, 4, 64}, {BENCH_SPARSE, 3, 8, 64}, {BENCH_SPARSE, 3, 12, 64},
+    {BENCH_DENSE, 2, 4, 0}, {BENCH_DENSE, 2, 16, 0}, {BENCH_DENSE, 2, 32, 0},
+};
+
+/** To jest struktura przechowująca wynik pomiaru. */
+typedef struct BenchResult {
+    uint64_t iters; ///< liczba wykonań operacji
+    double ns_per_op; ///< średni czas operacji w nanosekundach
+    double terms_per_s; ///< liczba jednomianów argumentów przetworzonych na sekundę
+    double allocs_per_op; ///< średnia liczba alokacji na operację
+    size_t terms; ///< łączna liczba jednomianów argumentów operacji
+} BenchResult;
+
+/** Zapobiega usunięciu przez kompilator obliczeń, których wynik jest nieużywany. */
+static volatile long bench_sink;
+
+/**
+ * Zwraca bieżący czas monotoniczny.
+ * @return czas w nanosekundach
+ */
+static uint64_t BenchNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+/**
+ * Losuje niezerowy współczynnik.
+ * @param[in,out] rng : stan generatora
+ * @return współczynnik z przedziału @f$ [-100, 100] \setminus \{0\} @f$
+ */
+static poly_coeff_t BenchCoeff(uint64_t *rng) {
+    poly_coeff_t c = (poly_coeff_t) (ProbNext(rng) % (2 * BENCH_MAX_COEFF)) - BENCH_MAX_COEFF;
+    return c >= 0 ? c + 1 : c;
+}
+
+/**
+ * Generuje wielomian o zadanym kształcie.
+ * @param[in,out] rng : stan generatora
+ * @param[in] shape : kształt
+ * @param[in] depth : numer zmiennej generowanego poziomu
+ * @return wielomian
+ */
+static Poly BenchPoly(uint64_t *rng, const BenchShape *shape, unsigned depth) {
+    if (depth == shape->vars) {
+        return PolyFromCoeff(BenchCoeff(rng));
+    }
+    Mono *monos = malloc(shape->terms * sizeof(Mono));
+    CHECK_PTR(monos);
+    for (size_t i = 0; i < shape->terms; ++i) {
+        poly_exp_t exp = shape->kind == BENCH_DENSE
+                         ? (poly_exp_t) i
+                         : (poly_exp_t) (ProbNext(rng) % ((uint64_t) shape->max_exp + 1));
+        Poly p = BenchPoly(rng, shape, depth + 1);
+        monos[i] = MonoFromPoly(&p, exp);
+    }
+    return PolyOwnMonos(shape->terms, monos);
+}
+
+/**
+ * Liczy jednomiany wielomianu na wszystkich poziomach.
+ * @param[in] p : wielomian
+ * @return liczba jednomianów
+ */
+static size_t BenchTerms(const Poly *p) {
+    if (PolyIsCoeff(p)) {
+        return 0;
+    }
+    size_t n = p->size;
+    for (size_t i = 0; i < p->size; ++i) {
+        n += BenchTerms(&p->arr[i].p);
+    }
+    return n;
+}
+
+/** To jest struktura przechowująca argumenty mierzonych operacji. */
+typedef struct BenchArgs {
+    Poly p; ///< pierwszy argument
+    Poly q; ///< drugi argument: niezależny wielomian tego samego kształtu
+    Poly p_copy; ///< kopia pierwszego argumentu
+    Poly *compose; ///< wielomiany podstawiane w PolyCompose(), po jednym na zmienną
+    size_t compose_count; ///< liczba podstawianych wielomianów
+} BenchArgs;
+
+/**
+ * Wykonuje operację @p iters razy.
+ * @param[in] op : operacja
+ * @param[in] a : argumenty
+ * @param[in] iters : liczba wykonań
+ */
+static void BenchRun(BenchOp op, const BenchArgs *a, uint64_t iters) {
+    for (uint64_t i = 0; i < iters; ++i) {
+        Poly r;
+        switch (op) {
+            case OP_ADD:
+                r = PolyAdd(&a->p, &a->q);
+                break;
+            case OP_MUL:
+                r = PolyMul(&a->p, &a->q);
+                break;
+            case OP_AT:
+                r = PolyAt(&a->p, 3);
+                break;
+            case OP_COMPOSE:
+                r = PolyCompose(&a->p, a->compose_count, a->compose);
+                break;
+            case OP_CLONE:
+                r = PolyClone(&a->p);
+                break;
+            case OP_IS_EQ:
+                bench_sink += PolyIsEq(&a->p, &a->p_copy);
+                continue;
+            case OP_DEG:
+                bench_sink += PolyDeg(&a->p);
+                continue;
+            default:
+                return;
+        }
+        PolyDestroy(&r);
+    }
+}
+
+/**
+ * Mierzy operację: podwaja liczbę wykonań, aż pomiar potrwa co najmniej
+ * @p min_ns nanosekund. Czas obejmuje zwolnienie wyniku operacji.
+ * @param[in] op : operacja
+ * @param[in] a : argumenty
+ * @param[in] min_ns : najkrótszy czas pomiaru
+ * @return wynik pomiaru
+ */
+static BenchResult BenchMeasure(BenchOp op, const BenchArgs *a, uint64_t min_ns) {
+    BenchResult res = {.terms = BenchTerms(&a->p)};
+    if (op == OP_ADD || op == OP_MUL || op == OP_IS_EQ) {
+        res.terms += op == OP_IS_EQ ? BenchTerms(&a->p_copy) : BenchTerms(&a->q);
+    }
+    BenchRun(op, a, 1); // Rozgrzewka.
+    uint64_t iters = 1;
+    for (;;) {
+        uint64_t allocs = bench_allocs;
+        uint64_t start = BenchNow();
+        BenchRun(op, a, iters);
+        uint64_t elapsed = BenchNow() - start;
+        if (elapsed >= min_ns || iters >= UINT64_MAX / 2) {
+            res.iters = iters;
+            res.ns_per_op = (double) elapsed / (double) iters;
+            res.terms_per_s = (double) res.terms * NS_PER_S / res.ns_per_op;
+            res.allocs_per_op = (double) (bench_allocs - allocs) / (double) iters;
+            return res;
+        }
+        iters *= 2;
+    }
+}
+
+/**
+ * Przygotowuje argumenty operacji o zadanym kształcie.
+ * @param[out] a : argumenty
+ * @param[in] shape : kształt
+ * @param[in,out] rng : stan generatora
+ */
+static void BenchArgsInit(BenchArgs *a, const BenchShape *shape, uint64_t *rng) {
+    a->p = BenchPoly(rng, shape, 0);
+    a->q = BenchPoly(rng, shape, 0);
+    a->p_copy = PolyClone(&a->p);
+    // Podstawiamy wielomiany liniowe jednej zmiennej, by rozmiar wyniku
+    // złożenia zależał od stopnia, a nie rósł wykładniczo z liczbą zmiennych.
+    BenchShape linear = {.kind = BENCH_DENSE, .vars = 1, .terms = 2};
+    a->compose_count = shape->vars;
+    a->compose = malloc(shape->vars * sizeof(Poly));
+    CHECK_PTR(a->compose);
+    for (size_t i = 0; i < a->compose_count; ++i) {
+        a->compose[i] = BenchPoly(rng, &linear, 0);
+    }
+}
+
+/**
+ * Zwalnia argumenty operacji.
+ * @param[in,out] a : argumenty
+ */
+static void BenchArgsDestroy(BenchArgs *a) {
+    PolyDestroy(&a->p);
+    PolyDestroy(&a->q);
+    PolyDestroy(&a->p_copy);
+    for (size_t i = 0; i < a->compose_count; ++i) {
+        PolyDestroy(&a->compose[i]);
+    }
+    free(a->compose);
+}
+
+/**
+ * Parsuje kształt zapisany jako `sparse:VARS:TERMS:MAX_EXP` lub `dense:VARS:TERMS`.
+ * @param[in] str : napis
+ * @param[out] shape : kształt
+ * @return Czy napis jest poprawny?
+ */
+static bool BenchParseShape(const char *str, BenchShape *shape) {
+    unsigned vars;
+    size_t terms;
+    int max_exp;
+    int n = 0;
+    if (sscanf(str, "sparse:%u:%zu:%d%n", &vars, &terms, &max_exp, &n) == 3 && str[n] == '\0') {
+        *shape = (BenchShape) {.kind = BENCH_SPARSE, .vars = vars, .terms = terms, .max_exp = max_exp};
+    } else if (sscanf(str, "dense:%u:%zu%n", &vars, &terms, &n) == 2 && str[n] == '\0') {
+        *shape = (BenchShape) {.kind = BENCH_DENSE, .vars = vars, .terms = terms};
+    } else {
+        return false;
+    }
+    return shape->vars > 0 && shape->terms > 0 && (shape->kind == BENCH_DENSE || shape->max_exp >= 0);
+}
+
+/**
+ * Wypisuje wynik pomiaru.
+ * @param[in] op : operacja
+ * @param[in] shape : kształt
+ * @param[in] res : wynik
+ * @param[in] json : czy w formacie JSON
+ * @param[in] first : czy to pierwszy wypisywany wynik
+ */
+static void BenchReport(BenchOp op, const BenchShape *shape, const BenchResult *res, bool json, bool first) {
+    const char *kind = shape->kind == BENCH_DENSE ? "dense" : "sparse";
+    if (json) {
+        printf("%s\n    {\"op\": \"%s\", \"kind\": \"%s\", \"vars\": %u, \"terms\": %zu, \"max_exp\": %d, "
+               "\"input_terms\": %zu, \"iters\": %" PRIu64 ", \"ns_per_op\": %.1f, \"terms_per_s\": %.0f, "
+               "\"allocs_per_op\": %.2f}",
+               first ? "" : ",", bench_op_names[op], kind, shape->vars, shape->terms, shape->max_exp,
+               res->terms, res->iters, res->ns_per_op, res->terms_per_s, res->allocs_per_op);
+    } else {
+        printf("%-12s %-6s %4u %6zu %10zu %12.1f %12.2f %10.2f\n", bench_op_names[op], kind, shape->vars,
+               shape->terms, res->terms, res->ns_per_op, res->terms_per_s / 1e6, res->allocs_per_op);
+    }
+}
+
+/**
+ * Uruchamia benchmarki. Opcje:
+ *   - `--seed N` – ziarno generatora wielomianów;
+ *   - `--min-time MS` – najkrótszy czas pomiaru jednej operacji;
+ *   - `--op NAZWA` – mierzy tylko operację o podanej nazwie, np. `PolyMul`;
+ *   - `--shape KSZTAŁT` – mierzy podany kształt zamiast domyślnego zestawu,
+ *     można podać wiele razy (patrz BenchParseShape());
+ *   - `--json` – wypisuje wyniki w formacie JSON.
+ * @param[in] argc : liczba argumentów programu
+ * @param[in] argv : argumenty programu
+ * @return kod zakończenia programu
+ */
+int main(int argc, char *argv[]) {
+    uint64_t seed = BENCH_SEED;
+    uint64_t min_ns = (uint64_t) BENCH_MIN_TIME_MS * 1000000u;
+    const char *only = NULL;
+    bool json = false;
+    BenchShape shapes[BENCH_MAX_SHAPES];
+    size_t shapes_count = 0;
+    bool ok = true;
+    for (int i = 1; i < argc && ok; ++i) {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+            min_ns = strtoull(argv[++i], NULL, 10) * 1000000u;
+        } else if (strcmp(argv[i], "--op") == 0 && i + 1 < argc) {
+            only = argv[++i];
+        } else if (strcmp(argv[i], "--shape") == 0 && i + 1 < argc && shapes_count < BENCH_MAX_SHAPES) {
+            ok = BenchParseShape(argv[++i], &shapes[shapes_count++]);
+        } else if (strcmp(argv[i], "--json") == 0) {
+            json = true;
+        } else {
+            ok = false;
+        }
+    }
+    if (!ok) {
+        fprintf(stderr, "Usage: %s [--seed N] [--min-time MS] [--op NAME] [--json]"
+                        " [--shape sparse:VARS:TERMS:MAX_EXP | dense:VARS:TERMS]...\n", argv[0]);
+        return 1;
+    }
+    if (shapes_count == 0) {
+        shapes_count = sizeof(bench_default_shapes) / sizeof(bench_default_shapes[0]);
+        memcpy(shapes, bench_default_shapes, sizeof(bench_default_shapes));
+    }
+
+    if (json) {
+        printf("{\"seed\": %" PRIu64 ", \"min_time_ms\": %" PRIu64 ", \"results\": [", seed, min_ns / 1000000u);
+    } else {
+        printf("%-12s %-6s %4s %6s %10s %12s %12s %10s\n",
+               "op", "kind", "vars", "terms", "in_terms", "ns/op", "Mterms/s", "allocs/op");
+    }
+    bool first = true;
+    for (size_t s = 0; s < shapes_count; ++s) {
+        // Każdy kształt ma własny ciąg liczb, więc wybór kształtów i operacji
+        // nie zmienia mierzonych wielomianów.
+        uint64_t rng = seed ^ (uint64_t) s;
+        BenchArgs a;
+        BenchArgsInit(&a, &shapes[s], &rng);
+        for (BenchOp op = 0; op < OP_COUNT; ++op) {
+            if (only != NULL && strcmp(only, bench_op_names[op]) != 0) {
+                continue;
+            }
+            BenchResult res = BenchMeasure(op, &a, min_ns);
+            BenchReport(op, &shapes[s], &res, json, first);
+            first = false;
+            fflush(stdout);
+        }
+        BenchArgsDestroy(&a);
+    }
+    if (json) {
+        printf("\n]}\n");
+    }
+    return 0;
+}
@@ -0,0 +1,355 @@
+/** @file
+ * Odtwarzanie skryptów obciążenia kalkulatora.
+ *
+ * Program uruchamia kalkulator na skrypcie (np. wygenerowanym przez
+ * poly_workload), mierzy czas całego przebiegu i wypisuje przepustowość
+ * w poleceniach i wierszach na sekundę. Kalkulator uruchamiany jest
+ * z opcją `--latency`, więc czas wykonania każdego polecenia trafia do
+ * pliku tymczasowego, z którego wyznaczane są percentyle opóźnień dla
+ * każdego polecenia. Z opcją `--json` wyniki wypisywane są w formacie
+ * JSON, by można je było porównywać między wersjami.
+ *
+ * @author Mateusz Sulimowicz <ms429603@students.mimuw.edu.pl>
+ * @date 2021
+ */
+
+/** Makro potrzebne do korzystania z GNU C Library. */
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "pipeline.h"
+
+/** Mnożnik rozmiaru tablicy do realokacji. */
+#define MULTIPLIER 2
+
+/** Początkowy rozmiar alokowanej tablicy */
+#define INIT_SIZE 4
+
+/** Domyślna ścieżka do programu kalkulatora. */
+#define REPLAY_POLY "./poly"
+
+/** Liczba nanosekund w sekundzie. */
+#define NS_PER_S 1000000000.0
+
+/** Wypisywane percentyle opóźnień. */
+static const double replay_percentiles[] = {50, 90, 99, 99.9};
+
+/** Liczba wypisywanych percentyli. */
+#define REPLAY_PERCENTILES (sizeof(replay_percentiles) / sizeof(replay_percentiles[0]))
+
+/** To jest struktura przechowująca zmierzone czasy wykonania jednego polecenia. */
+typedef struct ReplayCommand {
+    char *name; ///< nazwa polecenia
+    uint64_t *samples; ///< czasy wykonania w nanosekundach
+    size_t size; ///< rozmiar tablicy czasów
+    size_t count; ///< liczba czasów
+    uint64_t total; ///< suma czasów
+} ReplayCommand;
+
+/** To jest struktura przechowująca wyniki odtwarzania. */
+typedef struct Replay {
+    ReplayCommand *cmds; ///< polecenia w kolejności pierwszego wystąpienia
+    size_t cmds_size; ///< rozmiar tablicy poleceń
+    size_t cmds_count; ///< liczba poleceń
+    size_t lines; ///< liczba niepomijanych wierszy skryptu
+    size_t commands; ///< liczba wierszy skryptu z poleceniami
+    uint64_t best_ns; ///< najkrótszy czas przebiegu
+    uint64_t total_ns; ///< łączny czas przebiegów
+} Replay;
+
+/**
+ * Sprawdza, czy udało się zaalokować pamięć. Jeśli nie, kończy program.
+ * @param[in] p : wskaźnik na zaalokowaną pamięć
+ */
+static void ReplayCheck(const void *p) {
+    if (p == NULL) {
+        exit(1);
+    }
+}
+
+/**
+ * Zwraca bieżący czas monotoniczny.
+ * @return czas w nanosekundach
+ */
+static uint64_t ReplayNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+/**
+ * Liczy niepomijane wiersze i wiersze z poleceniami w skrypcie.
+ * Wiersze wewnątrz bloków liczone są raz, niezależnie od liczby wykonań.
+ * @param[in,out] r : wyniki
+ * @param[in] path : ścieżka do skryptu
+ * @return Czy udało się odczytać skrypt?
+ */
+static bool ReplayCount(Replay *r, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return false;
+    }
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    while ((len = getline(&line, &cap, f)) > 0) {
+        if (line[len - 1] == '\n') {
+            --len;
+        }
+        LineKind kind = LineKindOf(line, (size_t) len);
+        r->lines += kind != LINE_SKIP;
+        r->commands += kind == LINE_COMMAND;
+    }
+    free(line);
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+/**
+ * Dopisuje czas wykonania polecenia.
+ * @param[in,out] r : wyniki
+ * @param[in] name : nazwa polecenia
+ * @param[in] ns : czas wykonania
+ */
+static void ReplayAdd(Replay *r, const char *name, uint64_t ns) {
+    size_t i = 0;
+    while (i < r->cmds_count && strcmp(r->cmds[i].name, name) != 0) {
+        ++i;
+    }
+    if (i == r->cmds_count) {
+        if (r->cmds_count == r->cmds_size) {
+            r->cmds_size = r->cmds_size == 0 ? INIT_SIZE : MULTIPLIER * r->cmds_size;
+            r->cmds = realloc(r->cmds, r->cmds_size * sizeof(ReplayCommand));
+            ReplayCheck(r->cmds);
+        }
+        r->cmds[r->cmds_count++] = (ReplayCommand) {.name = strdup(name)};
+        ReplayCheck(r->cmds[i].name);
+    }
+    ReplayCommand *cmd = &r->cmds[i];
+    if (cmd->count == cmd->size) {
+        cmd->size = cmd->size == 0 ? INIT_SIZE : MULTIPLIER * cmd->size;
+        cmd->samples = realloc(cmd->samples, cmd->size * sizeof(uint64_t));
+        ReplayCheck(cmd->samples);
+    }
+    cmd->samples[cmd->count++] = ns;
+    cmd->total += ns;
+}
+
+/**
+ * Wczytuje czasy wykonania poleceń zapisane przez kalkulator.
+ * @param[in,out] r : wyniki
+ * @param[in] fd : deskryptor pliku z czasami
+ * @return Czy udało się odczytać plik?
+ */
+static bool ReplayReadLatency(Replay *r, int fd) {
+    FILE *f = fdopen(fd, "r");
+    if (f == NULL) {
+        return false;
+    }
+    char name[64];
+    uint64_t ns;
+    int res;
+    while ((res = fscanf(f, "%63s %" SCNu64, name, &ns)) == 2) {
+        ReplayAdd(r, name, ns);
+    }
+    bool ok = res == EOF && !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+/**
+ * Uruchamia kalkulator na skrypcie i zlicza czasy przebiegu oraz poleceń.
+ * Wyjście kalkulatora jest pomijane.
+ * @param[in,out] r : wyniki
+ * @param[in] poly : ścieżka do programu kalkulatora
+ * @param[in] script : ścieżka do skryptu
+ * @param[in] args : dodatkowe argumenty kalkulatora, zakończone NULL
+ * @return Czy przebieg zakończył się powodzeniem?
+ */
+static bool ReplayRun(Replay *r, const char *poly, const char *script, char *const args[]) {
+    const char *dir = getenv("TMPDIR");
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s/poly_replay_XXXXXX", dir != NULL && *dir != '\0' ? dir : "/tmp");
+    int lat = mkostemp(tmp, O_CLOEXEC);
+    if (lat < 0) {
+        return false;
+    }
+    size_t argc = 0;
+    while (args[argc] != NULL) {
+        ++argc;
+    }
+    const char **argv = malloc((argc + 4) * sizeof(char *));
+    ReplayCheck(argv);
+    argv[0] = poly;
+    memcpy(argv + 1, args, argc * sizeof(char *));
+    argv[argc + 1] = "--latency";
+    argv[argc + 2] = tmp;
+    argv[argc + 3] = NULL;
+
+    uint64_t start = ReplayNow();
+    pid_t pid = fork();
+    if (pid == 0) {
+        int in = open(script, O_RDONLY);
+        int out = open("/dev/null", O_WRONLY);
+        if (in < 0 || out < 0 || dup2(in, STDIN_FILENO) < 0 || dup2(out, STDOUT_FILENO) < 0
+            || dup2(out, STDERR_FILENO) < 0) {
+            _exit(127);
+        }
+        execv(poly, (char *const *) argv);
+        _exit(127);
+    }
+    int status = 0;
+    bool ok = pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    uint64_t elapsed = ReplayNow() - start;
+    free(argv);
+    unlink(tmp);
+    if (ok) {
+        r->best_ns = r->best_ns == 0 || elapsed < r->best_ns ? elapsed : r->best_ns;
+        r->total_ns += elapsed;
+        return ReplayReadLatency(r, lat);
+    }
+    close(lat);
+    return false;
+}
+
+/**
+ * Porównuje czasy na potrzeby sortowania.
+ * @param[in] a : wskaźnik na pierwszy czas
+ * @param[in] b : wskaźnik na drugi czas
+ * @return wynik porównania
+ */
+static int ReplayCompare(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Zwraca percentyl posortowanych czasów (metoda najbliższej rangi).
+ * @param[in] cmd : polecenie
+ * @param[in] pct : percentyl
+ * @return czas w nanosekundach
+ */
+static uint64_t ReplayPercentile(const ReplayCommand *cmd, double pct) {
+    size_t rank = (size_t) (pct / 100 * (double) cmd->count + 0.999999);
+    return cmd->samples[rank == 0 ? 0 : rank - 1];
+}
+
+/**
+ * Wypisuje wyniki odtwarzania.
+ * @param[in,out] r : wyniki; czasy poleceń są sortowane
+ * @param[in] script : ścieżka do skryptu
+ * @param[in] repeat : liczba przebiegów
+ * @param[in] json : czy w formacie JSON
+ */
+static void ReplayReport(Replay *r, const char *script, size_t repeat, bool json) {
+    double sec = (double) r->best_ns / NS_PER_S;
+    if (json) {
+        printf("{\"script\": \"%s\", \"repeat\": %zu, \"lines\": %zu, \"commands\": %zu, \"best_s\": %.6f, "
+               "\"mean_s\": %.6f, \"lines_per_s\": %.0f, \"commands_per_s\": %.0f, \"latency_ns\": [",
+               script, repeat, r->lines, r->commands, sec, (double) r->total_ns / NS_PER_S / (double) repeat,
+               (double) r->lines / sec, (double) r->commands / sec);
+    } else {
+        printf("%s: %zu lines, %zu commands, best of %zu: %.3f s, %.0f lines/s, %.0f commands/s\n\n",
+               script, r->lines, r->commands, repeat, sec, (double) r->lines / sec, (double) r->commands / sec);
+        printf("%-10s %10s %12s", "command", "count", "mean");
+        for (size_t j = 0; j < REPLAY_PERCENTILES; ++j) {
+            char head[16];
+            snprintf(head, sizeof(head), "p%g", replay_percentiles[j]);
+            printf(" %10s", head);
+        }
+        printf(" %12s\n", "max");
+    }
+    for (size_t i = 0; i < r->cmds_count; ++i) {
+        ReplayCommand *cmd = &r->cmds[i];
+        qsort(cmd->samples, cmd->count, sizeof(uint64_t), ReplayCompare);
+        double mean = (double) cmd->total / (double) cmd->count;
+        if (json) {
+            printf("%s\n    {\"command\": \"%s\", \"count\": %zu, \"mean\": %.1f", i == 0 ? "" : ",",
+                   cmd->name, cmd->count, mean);
+            for (size_t j = 0; j < REPLAY_PERCENTILES; ++j) {
+                printf(", \"p%g\": %" PRIu64, replay_percentiles[j], ReplayPercentile(cmd, replay_percentiles[j]));
+            }
+            printf(", \"max\": %" PRIu64 "}", cmd->samples[cmd->count - 1]);
+        } else {
+            printf("%-10s %10zu %12.1f", cmd->name, cmd->count, mean);
+            for (size_t j = 0; j < REPLAY_PERCENTILES; ++j) {
+                printf(" %10" PRIu64, ReplayPercentile(cmd, replay_percentiles[j]));
+            }
+            printf(" %12" PRIu64 "\n", cmd->samples[cmd->count - 1]);
+        }
+    }
+    if (json) {
+        printf("\n]}\n");
+    }
+}
+
+/**
+ * Odtwarza skrypt. Opcje:
+ *   - `--poly PATH` – program kalkulatora, domyślnie `./poly`;
+ *   - `--repeat N` – liczba przebiegów; przepustowość liczona jest dla
+ *     najszybszego, a percentyle ze wszystkich;
+ *   - `--json` – wypisuje wyniki w formacie JSON.
+ *
+ * Argumenty po `--` przekazywane są kalkulatorowi, np. `-- --lazy`.
+ * Czasy poleceń podawane są w nanosekundach.
+ * @param[in] argc : liczba argumentów programu
+ * @param[in] argv : argumenty programu
+ * @return kod zakończenia programu
+ */
+int main(int argc, char *argv[]) {
+    const char *poly = REPLAY_POLY;
+    const char *script = NULL;
+    size_t repeat = 1;
+    bool json = false;
+    char *const *args = &argv[argc];
+    bool ok = true;
+    for (int i = 1; i < argc && ok; ++i) {
+        if (strcmp(argv[i], "--poly") == 0 && i + 1 < argc) {
+            poly = argv[++i];
+        } else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            char *end;
+            repeat = strtoul(argv[++i], &end, 10);
+            ok = *end == '\0' && repeat > 0;
+        } else if (strcmp(argv[i], "--json") == 0) {
+            json = true;
+        } else if (strcmp(argv[i], "--") == 0) {
+            args = &argv[i + 1];
+            break;
+        } else if (script == NULL && argv[i][0] != '-') {
+            script = argv[i];
+        } else {
+            ok = false;
+        }
+    }
+    if (!ok || script == NULL) {
+        fprintf(stderr, "Usage: %s [--poly PATH] [--repeat N] [--json] SCRIPT [-- POLY_ARGS...]\n", argv[0]);
+        return 1;
+    }
+
+    Replay r = {0};
+    if (!ReplayCount(&r, script)) {
+        perror(script);
+        return 1;
+    }
+    for (size_t i = 0; i < repeat; ++i) {
+        if (!ReplayRun(&r, poly, script, args)) {
+            fprintf(stderr, "%s: run %zu of %s on %s failed\n", argv[0], i + 1, poly, script);
+            return 1;
+        }
+    }
+    ReplayReport(&r, script, repeat, json);
+    for (size_t i = 0; i < r.cmds_count; ++i) {
+        free(r.cmds[i].name);
+        free(r.cmds[i].samples);
+    }
+    free(r.cmds);
+    return 0;
+}
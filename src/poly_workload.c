@@ -0,0 +1,423 @@
+/** @file
+ * Generator skryptów obciążenia kalkulatora.
+ *
+ * Program wypisuje na standardowe wyjście skrypt kalkulatora o zadanej
+ * liczbie wierszy, proporcjach poleceń, rozmiarze i zagnieżdżeniu
+ * wielomianów oraz głębokości stosu. Skrypt jest w pełni wyznaczony przez
+ * ziarno, więc ten sam zestaw opcji daje zawsze to samo obciążenie.
+ *
+ * Generator śledzi szacunkowy rozmiar i stopień każdego wielomianu na
+ * stosie. Działanie, którego wynik przekroczyłby limit rozmiaru lub stopnia,
+ * zastępowane jest usunięciem wielomianu z wierzchołka, by wielokrotne
+ * mnożenie i składanie nie prowadziły do wykładniczego wzrostu wyników.
+ *
+ * @author Mateusz Sulimowicz <ms429603@students.mimuw.edu.pl>
+ * @date 2021
+ */
+
+#include <inttypes.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "prob.h"
+
+/** Mnożnik rozmiaru tablicy do realokacji. */
+#define MULTIPLIER 2
+
+/** Początkowy rozmiar alokowanej tablicy */
+#define INIT_SIZE 4
+
+/** Największy moduł losowanego współczynnika. */
+#define WORKLOAD_MAX_COEFF 1000
+
+/** Największy moduł punktu polecenia AT. */
+#define WORKLOAD_MAX_POINT 10
+
+/** Największy parametr polecenia COMPOSE. */
+#define WORKLOAD_MAX_COMPOSE 2
+
+/** To jest struktura opisująca polecenie kalkulatora z punktu widzenia generatora. */
+typedef struct WorkloadCommand {
+    const char *name; ///< nazwa polecenia
+    size_t arity; ///< liczba wielomianów potrzebnych do wykonania polecenia
+    unsigned weight; ///< domyślna waga polecenia w losowaniu
+} WorkloadCommand;
+
+/** To jest typ wyliczeniowy identyfikujący polecenie generowane przez generator. */
+typedef enum WorkloadCommandId {
+    W_ZERO, ///< polecenie ZERO
+    W_IS_COEFF, ///< polecenie IS_COEFF
+    W_IS_ZERO, ///< polecenie IS_ZERO
+    W_CLONE, ///< polecenie CLONE
+    W_ADD, ///< polecenie ADD
+    W_MUL, ///< polecenie MUL
+    W_NEG, ///< polecenie NEG
+    W_SUB, ///< polecenie SUB
+    W_IS_EQ, ///< polecenie IS_EQ
+    W_DEG, ///< polecenie DEG
+    W_DEG_BY, ///< polecenie DEG_BY
+    W_AT, ///< polecenie AT
+    W_PRINT, ///< polecenie PRINT
+    W_POP, ///< polecenie POP
+    W_COMPOSE, ///< polecenie COMPOSE
+    W_COUNT ///< liczba poleceń
+} WorkloadCommandId;
+
+/** Polecenia generatora według identyfikatorów. */
+static const WorkloadCommand workload_commands[W_COUNT] = {
+    [W_ZERO] = {"ZERO", 0, 1}, [W_IS_COEFF] = {"IS_COEFF", 1, 1}, [W_IS_ZERO] = {"IS_ZERO", 1, 1},
+    [W_CLONE] = {"CLONE", 1, 2}, [W_ADD] = {"ADD", 2, 4}, [W_MUL] = {"MUL", 2, 2},
+    [W_NEG] = {"NEG", 1, 1}, [W_SUB] = {"SUB", 2, 2}, [W_IS_EQ] = {"IS_EQ", 2, 1},
+    [W_DEG] = {"DEG", 1, 1}, [W_DEG_BY] = {"DEG_BY", 1, 1}, [W_AT] = {"AT", 1, 1},
+    [W_PRINT] = {"PRINT", 1, 2}, [W_POP] = {"POP", 1, 2}, [W_COMPOSE] = {"COMPOSE", 1, 1},
+};
+
+/** To jest struktura opisująca szacunkowy kształt wielomianu na stosie. */
+typedef struct WorkloadEntry {
+    double terms; ///< górne oszacowanie liczby jednomianów
+    double deg; ///< górne oszacowanie stopnia
+} WorkloadEntry;
+
+/** To jest struktura przechowująca parametry i stan generatora. */
+typedef struct Workload {
+    uint64_t rng; ///< stan generatora liczb pseudolosowych
+    size_t lines; ///< liczba wierszy do wygenerowania
+    unsigned weights[W_COUNT]; ///< wagi poleceń
+    unsigned weights_sum; ///< suma wag poleceń
+    size_t terms; ///< liczba jednomianów na każdym poziomie wstawianego wielomianu
+    unsigned depth; ///< zagnieżdżenie wstawianych wielomianów, czyli liczba ich zmiennych
+    int max_exp; ///< największy wykładnik wstawianego wielomianu
+    size_t stack; ///< docelowa głębokość stosu
+    double max_terms; ///< limit oszacowania liczby jednomianów wyniku
+    WorkloadEntry *entries; ///< szacunkowe kształty wielomianów na stosie
+    size_t entries_size; ///< rozmiar tablicy kształtów
+    size_t entries_count; ///< liczba wielomianów na stosie
+    size_t emitted; ///< liczba wygenerowanych wierszy
+} Workload;
+
+/**
+ * Losuje liczbę z przedziału @f$ [0, n) @f$.
+ * @param[in,out] w : generator
+ * @param[in] n : górne ograniczenie, dodatnie
+ * @return liczba pseudolosowa
+ */
+static uint64_t WorkloadRand(Workload *w, uint64_t n) {
+    return ProbNext(&w->rng) % n;
+}
+
+/**
+ * Wstawia szacunkowy kształt wielomianu na stos generatora.
+ * @param[in,out] w : generator
+ * @param[in] e : kształt
+ */
+static void WorkloadPush(Workload *w, WorkloadEntry e) {
+    if (w->entries_count == w->entries_size) {
+        w->entries_size = w->entries_size == 0 ? INIT_SIZE : MULTIPLIER * w->entries_size;
+        w->entries = realloc(w->entries, w->entries_size * sizeof(WorkloadEntry));
+        if (w->entries == NULL) {
+            exit(1);
+        }
+    }
+    w->entries[w->entries_count++] = e;
+}
+
+/**
+ * Zwraca szacunkowy kształt wielomianu leżącego na stosie generatora.
+ * @param[in] w : generator
+ * @param[in] depth : odległość od wierzchołka
+ * @return kształt
+ */
+static WorkloadEntry *WorkloadPeek(Workload *w, size_t depth) {
+    return &w->entries[w->entries_count - 1 - depth];
+}
+
+/**
+ * Wypisuje wielomian zmiennej @p var i dalszych zmiennych.
+ * @param[in,out] w : generator
+ * @param[in] var : numer zmiennej
+ */
+static void WorkloadPoly(Workload *w, unsigned var) {
+    if (var == w->depth) {
+        printf("%" PRId64, (int64_t) WorkloadRand(w, 2 * WORKLOAD_MAX_COEFF + 1) - WORKLOAD_MAX_COEFF);
+        return;
+    }
+    for (size_t i = 0; i < w->terms; ++i) {
+        if (i > 0) {
+            putchar('+');
+        }
+        putchar('(');
+        WorkloadPoly(w, var + 1);
+        printf(",%" PRIu64 ")", WorkloadRand(w, (uint64_t) w->max_exp + 1));
+    }
+}
+
+/**
+ * Wypisuje wiersz z nowym wielomianem i wstawia jego kształt na stos generatora.
+ * @param[in,out] w : generator
+ */
+static void WorkloadEmitPoly(Workload *w) {
+    WorkloadPoly(w, 0);
+    putchar('\n');
+    double terms = 1;
+    for (unsigned i = 0; i < w->depth; ++i) {
+        terms *= (double) w->terms;
+    }
+    WorkloadPush(w, (WorkloadEntry) {.terms = terms, .deg = (double) w->max_exp * w->depth});
+    ++w->emitted;
+}
+
+/**
+ * Szacuje potęgę, przerywając mnożenie po przekroczeniu limitu.
+ * @param[in] base : podstawa
+ * @param[in] exp : wykładnik
+ * @param[in] limit : limit
+ * @return potęga lub liczba większa od limitu
+ */
+static double WorkloadPow(double base, double exp, double limit) {
+    if (base <= 1) {
+        return 1;
+    }
+    double res = 1;
+    for (double i = 0; i < exp && res <= limit; ++i) {
+        res *= base;
+    }
+    return res;
+}
+
+/**
+ * Szacuje kształt wyniku polecenia i sprawdza, czy mieści się w limitach.
+ * Polecenia, które nie zmieniają wielomianów, zawsze się mieszczą.
+ * @param[in,out] w : generator
+ * @param[in] id : polecenie
+ * @param[in] k : parametr polecenia COMPOSE
+ * @param[out] res : kształt wyniku
+ * @return Czy wynik mieści się w limitach?
+ */
+static bool WorkloadEstimate(Workload *w, WorkloadCommandId id, size_t k, WorkloadEntry *res) {
+    WorkloadEntry *p = WorkloadPeek(w, 0);
+    *res = *p;
+    switch (id) {
+        case W_ADD:
+        case W_SUB:
+            res->terms = p->terms + WorkloadPeek(w, 1)->terms;
+            res->deg = p->deg > WorkloadPeek(w, 1)->deg ? p->deg : WorkloadPeek(w, 1)->deg;
+            break;
+        case W_MUL:
+            res->terms = p->terms * WorkloadPeek(w, 1)->terms;
+            res->deg = p->deg + WorkloadPeek(w, 1)->deg;
+            break;
+        case W_COMPOSE: {
+            // Podstawienie wielomianu o t jednomianach za zmienną w potędze d
+            // daje co najwyżej t^d jednomianów.
+            WorkloadEntry q = {.terms = 1, .deg = 0};
+            for (size_t i = 1; i <= k; ++i) {
+                WorkloadEntry *e = WorkloadPeek(w, i);
+                q.terms = e->terms > q.terms ? e->terms : q.terms;
+                q.deg = e->deg > q.deg ? e->deg : q.deg;
+            }
+            res->terms = p->terms * WorkloadPow(q.terms, p->deg, w->max_terms);
+            res->deg = p->deg * q.deg;
+            break;
+        }
+        default:
+            return true;
+    }
+    return res->terms <= w->max_terms && res->deg <= INT_MAX;
+}
+
+/**
+ * Losuje polecenie zgodnie z wagami.
+ * @param[in,out] w : generator
+ * @return polecenie
+ */
+static WorkloadCommandId WorkloadPick(Workload *w) {
+    uint64_t r = WorkloadRand(w, w->weights_sum);
+    WorkloadCommandId id = 0;
+    while (r >= w->weights[id]) {
+        r -= w->weights[id++];
+    }
+    return id;
+}
+
+/**
+ * Wypisuje wiersz z poleceniem POP i usuwa kształt z wierzchołka stosu generatora.
+ * @param[in,out] w : generator
+ */
+static void WorkloadEmitPop(Workload *w) {
+    puts("POP");
+    --w->entries_count;
+    ++w->emitted;
+}
+
+/**
+ * Generuje kolejny wiersz skryptu. Dopóki stos jest płytszy niż docelowa
+ * głębokość lub jest za płytki dla wylosowanego polecenia, wstawiane są nowe
+ * wielomiany; gdy stos jest znacznie głębszy, wielomiany są usuwane.
+ * @param[in,out] w : generator
+ */
+static void WorkloadStep(Workload *w) {
+    if (w->entries_count < w->stack) {
+        WorkloadEmitPoly(w);
+        return;
+    }
+    if (w->entries_count >= MULTIPLIER * w->stack + WORKLOAD_MAX_COMPOSE) {
+        WorkloadEmitPop(w);
+        return;
+    }
+    WorkloadCommandId id = WorkloadPick(w);
+    size_t k = id == W_COMPOSE ? (size_t) WorkloadRand(w, WORKLOAD_MAX_COMPOSE + 1) : 0;
+    if (w->entries_count < workload_commands[id].arity + k) {
+        WorkloadEmitPoly(w);
+        return;
+    }
+    WorkloadEntry res;
+    if (!WorkloadEstimate(w, id, k, &res)) {
+        WorkloadEmitPop(w);
+        return;
+    }
+    fputs(workload_commands[id].name, stdout);
+    switch (id) {
+        case W_ZERO:
+            WorkloadPush(w, (WorkloadEntry) {.terms = 1, .deg = 0});
+            break;
+        case W_CLONE:
+            WorkloadPush(w, res);
+            break;
+        case W_ADD:
+        case W_SUB:
+        case W_MUL:
+            --w->entries_count;
+            *WorkloadPeek(w, 0) = res;
+            break;
+        case W_DEG_BY:
+            printf(" %" PRIu64, WorkloadRand(w, w->depth + 1));
+            break;
+        case W_AT:
+            printf(" %" PRId64, (int64_t) WorkloadRand(w, 2 * WORKLOAD_MAX_POINT + 1) - WORKLOAD_MAX_POINT);
+            break;
+        case W_POP:
+            --w->entries_count;
+            break;
+        case W_COMPOSE:
+            printf(" %zu", k);
+            w->entries_count -= k;
+            *WorkloadPeek(w, 0) = res;
+            break;
+        default:
+            break;
+    }
+    putchar('\n');
+    ++w->emitted;
+}
+
+/**
+ * Parsuje proporcje poleceń zapisane jako `NAZWA=WAGA,NAZWA=WAGA,...`.
+ * Polecenia, których nie wymieniono, nie są generowane.
+ * @param[in,out] w : generator
+ * @param[in] str : napis
+ * @return Czy napis jest poprawny?
+ */
+static bool WorkloadParseMix(Workload *w, const char *str) {
+    memset(w->weights, 0, sizeof(w->weights));
+    while (*str != '\0') {
+        const char *eq = strchr(str, '=');
+        if (eq == NULL) {
+            return false;
+        }
+        WorkloadCommandId id = 0;
+        while (id < W_COUNT && (strlen(workload_commands[id].name) != (size_t) (eq - str)
+                                || strncmp(workload_commands[id].name, str, (size_t) (eq - str)) != 0)) {
+            ++id;
+        }
+        char *end;
+        unsigned long weight = strtoul(eq + 1, &end, 10);
+        if (id == W_COUNT || end == eq + 1 || (*end != ',' && *end != '\0') || weight > UINT_MAX / W_COUNT) {
+            return false;
+        }
+        w->weights[id] = (unsigned) weight;
+        str = *end == ',' ? end + 1 : end;
+    }
+    return true;
+}
+
+/**
+ * Parsuje nieujemną liczbę podaną jako wartość opcji programu.
+ * @param[in] str : napis
+ * @param[in] max : największa dozwolona wartość
+ * @param[out] res : wynik
+ * @return Czy napis jest poprawną liczbą nie większą niż @p max?
+ */
+static bool WorkloadParseNumber(const char *str, unsigned long long max, unsigned long long *res) {
+    char *end;
+    *res = strtoull(str, &end, 10);
+    return *str >= '0' && *str <= '9' && *end == '\0' && *res <= max;
+}
+
+/**
+ * Generuje skrypt obciążenia. Opcje:
+ *   - `--seed N` – ziarno generatora;
+ *   - `--lines N` – liczba wierszy skryptu;
+ *   - `--mix NAZWA=WAGA,...` – proporcje poleceń, np. `ADD=4,MUL=1,PRINT=1`;
+ *   - `--terms N` – liczba jednomianów na każdym poziomie wstawianego wielomianu;
+ *   - `--depth N` – zagnieżdżenie wstawianych wielomianów;
+ *   - `--max-exp N` – największy wykładnik wstawianego wielomianu;
+ *   - `--stack N` – docelowa głębokość stosu;
+ *   - `--max-terms N` – limit oszacowania liczby jednomianów wyniku działania.
+ * @param[in] argc : liczba argumentów programu
+ * @param[in] argv : argumenty programu
+ * @return kod zakończenia programu
+ */
+int main(int argc, char *argv[]) {
+    Workload w = {.rng = 2021, .lines = 100000, .terms = 3, .depth = 2, .max_exp = 10,
+                  .stack = 4, .max_terms = 10000};
+    for (WorkloadCommandId id = 0; id < W_COUNT; ++id) {
+        w.weights[id] = workload_commands[id].weight;
+    }
+    bool ok = true;
+    for (int i = 1; i < argc && ok; ++i) {
+        unsigned long long n = 0;
+        if (i + 1 == argc) {
+            ok = false;
+        } else if (strcmp(argv[i], "--mix") == 0) {
+            ok = WorkloadParseMix(&w, argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            ok = WorkloadParseNumber(argv[++i], UINT64_MAX, &n);
+            w.rng = n;
+        } else if (strcmp(argv[i], "--lines") == 0) {
+            ok = WorkloadParseNumber(argv[++i], SIZE_MAX, &n);
+            w.lines = n;
+        } else if (strcmp(argv[i], "--terms") == 0) {
+            ok = WorkloadParseNumber(argv[++i], SIZE_MAX, &n) && n > 0;
+            w.terms = n;
+        } else if (strcmp(argv[i], "--depth") == 0) {
+            ok = WorkloadParseNumber(argv[++i], UINT_MAX, &n);
+            w.depth = (unsigned) n;
+        } else if (strcmp(argv[i], "--max-exp") == 0) {
+            ok = WorkloadParseNumber(argv[++i], INT_MAX, &n);
+            w.max_exp = (int) n;
+        } else if (strcmp(argv[i], "--stack") == 0) {
+            ok = WorkloadParseNumber(argv[++i], SIZE_MAX / MULTIPLIER - WORKLOAD_MAX_COMPOSE, &n) && n > 0;
+            w.stack = n;
+        } else if (strcmp(argv[i], "--max-terms") == 0) {
+            ok = WorkloadParseNumber(argv[++i], UINT64_MAX, &n) && n > 0;
+            w.max_terms = (double) n;
+        } else {
+            ok = false;
+        }
+    }
+    for (WorkloadCommandId id = 0; id < W_COUNT; ++id) {
+        w.weights_sum += w.weights[id];
+    }
+    if (!ok || w.weights_sum == 0) {
+        fprintf(stderr, "Usage: %s [--seed N] [--lines N] [--mix NAME=WEIGHT,...] [--terms N] [--depth N]"
+                        " [--max-exp N] [--stack N] [--max-terms N]\n", argv[0]);
+        return 1;
+    }
+    while (w.emitted < w.lines) {
+        WorkloadStep(&w);
+    }
+    free(w.entries);
+    return fflush(stdout) == 0 ? 0 : 1;
+}
@@ -0,0 +1,258 @@
+/** @file
+ * Implementacja probabilistycznego porównywania wielomianów.
+ *
+ * @author Mateusz Sulimowicz <ms429603@students.mimuw.edu.pl>
+ * @date 2021
+ */
+
+#include "frames.h"
+#include "prob.h"
+
+/** Przyrost stanu generatora splitmix64. */
+#define SPLITMIX_GAMMA 0x9e3779b97f4a7c15ull
+
+/** Pierwszy mnożnik mieszający generatora splitmix64. */
+#define SPLITMIX_MUL1 0xbf58476d1ce4e5b9ull
+
+/** Drugi mnożnik mieszający generatora splitmix64. */
+#define SPLITMIX_MUL2 0x94d049bb133111ebull
+
+/** Reszta z dzielenia @f$ 2^{64} @f$ przez #PROB_PRIME_64. */
+#define PROB_PRIME_64_REM 59
+
+/**
+ * Liczba bitów, którą ogranicza z dołu #PROB_PRIME_61:
+ * @f$ d / P < 2^{b - 60} @f$ dla @f$ d < 2^b @f$.
+ */
+#define PROB_PRIME_BITS 60
+
+/** To jest typ liczb 128-bitowych, w których mieszczą się iloczyny reszt. */
+typedef unsigned __int128 ProbWide;
+
+/**
+ * To jest struktura przechowująca ramkę obliczania wartości wielomianu.
+ * Jednomiany przeglądamy w kolejności rosnących wykładników, więc potęgę
+ * zmiennej wyznaczamy z poprzedniej, podnosząc ją do różnicy wykładników.
+ */
+typedef struct ProbFrame {
+    const Poly *p; ///< wielomian
+    size_t i; ///< indeks kolejnego jednomianu
+    poly_exp_t e; ///< wykładnik poprzedniego jednomianu
+    ProbValue x; ///< wartość zmiennej wielomianu
+    ProbValue pw; ///< zmienna podniesiona do wykładnika @p e
+    ProbValue acc; ///< suma wartości przejrzanych jednomianów
+} ProbFrame;
+
+uint64_t ProbNext(uint64_t *state) {
+    uint64_t z = (*state += SPLITMIX_GAMMA);
+    z = (z ^ (z >> 30)) * SPLITMIX_MUL1;
+    z = (z ^ (z >> 27)) * SPLITMIX_MUL2;
+    return z ^ (z >> 31);
+}
+
+/**
+ * Dodaje dwie reszty modulo liczby pierwszej.
+ * Suma może przekroczyć zakres, ale wtedy odjęcie @p m daje poprawny wynik.
+ * @param[in] a : reszta @f$ a < m @f$
+ * @param[in] b : reszta @f$ b < m @f$
+ * @param[in] m : liczba pierwsza
+ * @return @f$ (a + b) \bmod m @f$
+ */
+static inline uint64_t ModAdd(uint64_t a, uint64_t b, uint64_t m) {
+    uint64_t s = a + b;
+    return s < a || s >= m ? s - m : s;
+}
+
+/**
+ * Mnoży dwie reszty modulo #PROB_PRIME_61, korzystając z tego,
+ * że @f$ 2^{61} \equiv 1 @f$.
+ * @param[in] a : reszta @f$ a @f$
+ * @param[in] b : reszta @f$ b @f$
+ * @return @f$ a b \bmod (2^{61} - 1) @f$
+ */
+static inline uint64_t ModMul61(uint64_t a, uint64_t b) {
+    ProbWide x = (ProbWide) a * b;
+    uint64_t r = ((uint64_t) x & PROB_PRIME_61) + (uint64_t) (x >> 61);
+    while (r >= PROB_PRIME_61) {
+        r -= PROB_PRIME_61;
+    }
+    return r;
+}
+
+/**
+ * Mnoży dwie reszty modulo #PROB_PRIME_64, korzystając z tego,
+ * że @f$ 2^{64} \equiv 59 @f$.
+ * @param[in] a : reszta @f$ a @f$
+ * @param[in] b : reszta @f$ b @f$
+ * @return @f$ a b \bmod (2^{64} - 59) @f$
+ */
+static inline uint64_t ModMul64(uint64_t a, uint64_t b) {
+    ProbWide x = (ProbWide) a * b;
+    x = (x >> 64) * PROB_PRIME_64_REM + (uint64_t) x;
+    x = (x >> 64) * PROB_PRIME_64_REM + (uint64_t) x;
+    while (x >= PROB_PRIME_64) {
+        x -= PROB_PRIME_64;
+    }
+    return (uint64_t) x;
+}
+
+/**
+ * Zwraca resztę liczby całkowitej modulo liczby pierwszej.
+ * @param[in] c : liczba
+ * @param[in] m : liczba pierwsza
+ * @return @f$ c \bmod m @f$
+ */
+static inline uint64_t ModFromCoeff(poly_coeff_t c, uint64_t m) {
+    if (c >= 0) {
+        return (uint64_t) c % m;
+    }
+    // Liczymy -(c + 1) zamiast -c, bo -c może nie mieścić się w zakresie.
+    return m - 1 - (uint64_t) (-(c + 1)) % m;
+}
+
+ProbValue ProbFromCoeff(poly_coeff_t c) {
+    return (ProbValue) {.v61 = ModFromCoeff(c, PROB_PRIME_61), .v64 = ModFromCoeff(c, PROB_PRIME_64)};
+}
+
+ProbValue ProbAdd(ProbValue a, ProbValue b) {
+    return (ProbValue) {.v61 = ModAdd(a.v61, b.v61, PROB_PRIME_61), .v64 = ModAdd(a.v64, b.v64, PROB_PRIME_64)};
+}
+
+ProbValue ProbMul(ProbValue a, ProbValue b) {
+    return (ProbValue) {.v61 = ModMul61(a.v61, b.v61), .v64 = ModMul64(a.v64, b.v64)};
+}
+
+ProbValue ProbNeg(ProbValue a) {
+    return (ProbValue) {.v61 = a.v61 == 0 ? 0 : PROB_PRIME_61 - a.v61,
+                        .v64 = a.v64 == 0 ? 0 : PROB_PRIME_64 - a.v64};
+}
+
+/**
+ * Podnosi wartość do potęgi przez podnoszenie do kwadratu.
+ * @param[in] x : wartość
+ * @param[in] n : wykładnik
+ * @return @f$ x^n @f$
+ */
+static ProbValue ProbPow(ProbValue x, poly_exp_t n) {
+    ProbValue r = ProbFromCoeff(1);
+    while (n > 0) {
+        if (n & 1) {
+            r = ProbMul(r, x);
+        }
+        x = ProbMul(x, x);
+        n >>= 1;
+    }
+    return r;
+}
+
+/**
+ * Zwraca wartość zmiennej w punkcie o zadanym ziarnie.
+ * @param[in] point : ziarno punktu
+ * @param[in] var_idx : indeks zmiennej
+ * @return wartość zmiennej @f$ x_{var\_idx} @f$
+ */
+static ProbValue ProbVar(uint64_t point, size_t var_idx) {
+    uint64_t state = point ^ ((uint64_t) var_idx * SPLITMIX_MUL2);
+    uint64_t a = ProbNext(&state);
+    uint64_t b = ProbNext(&state);
+    return (ProbValue) {.v61 = a % PROB_PRIME_61, .v64 = b % PROB_PRIME_64};
+}
+
+/**
+ * Wstawia ramkę wielomianu na stos ramek, w razie potrzeby powiększając
+ * tablicę. Płytkie wielomiany obsługiwane są bez alokacji na stercie.
+ * @param[in,out] arr : wskaźnik na tablicę ramek
+ * @param[in,out] size : rozmiar tablicy ramek
+ * @param[in] buf : początkowa tablica ramek
+ * @param[in] top : liczba ramek na stosie
+ * @param[in] p : wielomian
+ * @param[in] point : ziarno punktu
+ */
+static void ProbFramePush(ProbFrame **arr, size_t *size, ProbFrame *buf, size_t top, const Poly *p, uint64_t point) {
+    if (top == *size) {
+        *size *= FRAMES_MULTIPLIER;
+        if (*arr == buf) {
+            *arr = malloc(*size * sizeof(ProbFrame));
+            CHECK_PTR(*arr);
+            memcpy(*arr, buf, top * sizeof(ProbFrame));
+        } else {
+            *arr = realloc(*arr, *size * sizeof(ProbFrame));
+            CHECK_PTR(*arr);
+        }
+    }
+    (*arr)[top] = (ProbFrame) {.p = p, .x = ProbVar(point, top), .pw = ProbFromCoeff(1),
+                               .acc = ProbFromCoeff(0)};
+}
+
+ProbValue PolyEvalMod(const Poly *p, uint64_t point) {
+    assert(p != NULL);
+    if (PolyIsCoeff(p)) {
+        return ProbFromCoeff(p->coeff);
+    }
+    ProbFrame buf[FRAMES_INIT_SIZE];
+    ProbFrame *fs = buf;
+    size_t size = FRAMES_INIT_SIZE;
+    size_t top = 0;
+    ProbFramePush(&fs, &size, buf, top++, p, point);
+    ProbValue r;
+    for (;;) {
+        ProbFrame *f = &fs[top - 1];
+        if (f->i == f->p->size) {
+            r = f->acc;
+            if (--top == 0) {
+                break;
+            }
+            // Wartość współczynnika jednomianu wraca do ramki wyżej.
+            f = &fs[top - 1];
+            f->acc = ProbAdd(f->acc, ProbMul(r, f->pw));
+            ++f->i;
+            continue;
+        }
+        const Mono *m = &f->p->arr[f->i];
+        f->pw = ProbMul(f->pw, ProbPow(f->x, MonoGetExp(m) - f->e));
+        f->e = MonoGetExp(m);
+        if (PolyIsCoeff(&m->p)) {
+            f->acc = ProbAdd(f->acc, ProbMul(ProbFromCoeff(m->p.coeff), f->pw));
+            ++f->i;
+        } else {
+            ProbFramePush(&fs, &size, buf, top++, &m->p, point);
+        }
+    }
+    if (fs != buf) {
+        free(fs);
+    }
+    return r;
+}
+
+unsigned long ProbErrorBits(unsigned long deg, size_t rounds) {
+    if (rounds == 0) {
+        return 0;
+    } else if (deg == 0) {
+        return PROB_EXACT;
+    }
+    unsigned long bits = 0;
+    while (bits < PROB_PRIME_BITS && (deg >> bits) != 0) {
+        ++bits;
+    }
+    if (bits >= PROB_PRIME_BITS) {
+        return 0;
+    }
+    unsigned long per_round = PROB_PRIME_BITS - bits;
+    return rounds > LONG_MAX / per_round ? LONG_MAX : rounds * per_round;
+}
+
+bool PolyProbablyEq(const Poly *p, const Poly *q, size_t rounds, uint64_t *seed, unsigned long *bits) {
+    assert(p != NULL && q != NULL);
+    for (size_t i = 0; i < rounds; ++i) {
+        uint64_t point = ProbNext(seed);
+        if (!ProbIsEq(PolyEvalMod(p, point), PolyEvalMod(q, point))) {
+            *bits = PROB_EXACT;
+            return false;
+        }
+    }
+    poly_exp_t p_deg = PolyDeg(p);
+    poly_exp_t q_deg = PolyDeg(q);
+    poly_exp_t deg = p_deg > q_deg ? p_deg : q_deg;
+    *bits = ProbErrorBits(deg > 0 ? (unsigned long) deg : 0, rounds);
+    return true;
+}
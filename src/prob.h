@@ -0,0 +1,123 @@
+/** @file
+ * Interfejs probabilistycznego porównywania wielomianów.
+ *
+ * Porównanie korzysta z lematu Schwartza–Zippela: jeśli wielomiany
+ * @f$ p \neq q @f$ mają stopień (ogólny) co najwyżej @f$ d @f$, to
+ * w punkcie wylosowanym z ciała @f$ \mathbb{Z}_P @f$ mają równe wartości
+ * z prawdopodobieństwem co najwyżej @f$ d / P @f$. Wartości liczone są
+ * jednocześnie modulo dwóch liczb pierwszych #PROB_PRIME_61 i #PROB_PRIME_64.
+ * Różnica dwóch współczynników typu `poly_coeff_t` nie może dzielić się przez
+ * obie, więc różne wielomiany pozostają różne modulo którejś z nich.
+ *
+ * Punkt, w którym obliczamy wartość, wyznacza jego ziarno: wartości
+ * kolejnych zmiennych są pseudolosowe i zależą od ziarna oraz numeru
+ * zmiennej. Dzięki temu punkt ma nieograniczenie wiele współrzędnych.
+ *
+ * @author Mateusz Sulimowicz <ms429603@students.mimuw.edu.pl>
+ * @date 2021
+ */
+
+#ifndef __PROB_H__
+#define __PROB_H__
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "poly.h"
+
+/** Liczba pierwsza @f$ 2^{61} - 1 @f$. */
+#define PROB_PRIME_61 2305843009213693951ull
+
+/** Liczba pierwsza @f$ 2^{64} - 59 @f$. */
+#define PROB_PRIME_64 18446744073709551557ull
+
+/** Oznaczenie odpowiedzi pewnej – bez prawdopodobieństwa błędu. */
+#define PROB_EXACT ULONG_MAX
+
+/** To jest struktura przechowująca wartość modulo obu liczb pierwszych. */
+typedef struct ProbValue {
+    uint64_t v61; ///< wartość modulo #PROB_PRIME_61
+    uint64_t v64; ///< wartość modulo #PROB_PRIME_64
+} ProbValue;
+
+/**
+ * Zwraca kolejną liczbę pseudolosową generatora splitmix64.
+ * @param[in,out] state : stan generatora
+ * @return liczba pseudolosowa
+ */
+uint64_t ProbNext(uint64_t *state);
+
+/**
+ * Zwraca wartość współczynnika modulo obu liczb pierwszych.
+ * @param[in] c : współczynnik
+ * @return wartość współczynnika
+ */
+ProbValue ProbFromCoeff(poly_coeff_t c);
+
+/**
+ * Dodaje dwie wartości.
+ * @param[in] a : wartość @f$ a @f$
+ * @param[in] b : wartość @f$ b @f$
+ * @return @f$ a + b @f$
+ */
+ProbValue ProbAdd(ProbValue a, ProbValue b);
+
+/**
+ * Mnoży dwie wartości.
+ * @param[in] a : wartość @f$ a @f$
+ * @param[in] b : wartość @f$ b @f$
+ * @return @f$ a \cdot b @f$
+ */
+ProbValue ProbMul(ProbValue a, ProbValue b);
+
+/**
+ * Zwraca wartość przeciwną.
+ * @param[in] a : wartość @f$ a @f$
+ * @return @f$ -a @f$
+ */
+ProbValue ProbNeg(ProbValue a);
+
+/**
+ * Sprawdza równość dwóch wartości.
+ * @param[in] a : wartość @f$ a @f$
+ * @param[in] b : wartość @f$ b @f$
+ * @return @f$ a = b @f$
+ */
+static inline bool ProbIsEq(ProbValue a, ProbValue b) {
+    return a.v61 == b.v61 && a.v64 == b.v64;
+}
+
+/**
+ * Oblicza wartość wielomianu w punkcie o zadanym ziarnie.
+ * @param[in] p : wielomian
+ * @param[in] point : ziarno punktu
+ * @return wartość wielomianu
+ */
+ProbValue PolyEvalMod(const Poly *p, uint64_t point);
+
+/**
+ * Wyznacza ograniczenie prawdopodobieństwa błędu porównania, które
+ * w każdej z @p rounds rund uznało wielomiany stopnia co najwyżej @p deg
+ * za równe.
+ * @param[in] deg : ograniczenie stopnia porównywanych wielomianów
+ * @param[in] rounds : liczba rund
+ * @return wykładnik @f$ k @f$ ograniczenia @f$ 2^{-k} @f$ lub #PROB_EXACT,
+ * jeśli wielomiany są stałe i porównano je choć raz
+ */
+unsigned long ProbErrorBits(unsigned long deg, size_t rounds);
+
+/**
+ * Sprawdza probabilistycznie, czy dwa wielomiany są równe, porównując
+ * ich wartości w @p rounds pseudolosowych punktach. Odpowiedź „nie” jest
+ * zawsze pewna, a odpowiedź „tak” może być błędna z prawdopodobieństwem
+ * co najwyżej @f$ 2^{-k} @f$, gdzie @f$ k @f$ jest zwracane przez @p bits.
+ * @param[in] p : wielomian @f$ p @f$
+ * @param[in] q : wielomian @f$ q @f$
+ * @param[in] rounds : liczba rund
+ * @param[in,out] seed : stan generatora, z którego losowane są punkty
+ * @param[out] bits : wykładnik ograniczenia prawdopodobieństwa błędu lub #PROB_EXACT
+ * @return Czy wielomiany są (prawdopodobnie) równe?
+ */
+bool PolyProbablyEq(const Poly *p, const Poly *q, size_t rounds, uint64_t *seed, unsigned long *bits);
+
+#endif //__PROB_H__
@@ -0,0 +1,495 @@
+/** @file
+ * Implementacja binarnego zapisu i odczytu wielomianów.
+ *
+ * @author Mateusz Sulimowicz <ms429603@students.mimuw.edu.pl>
+ * @date 2021
+ */
+
+/** Makro potrzebne do korzystania z GNU C Library. */
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "alloc.h"
+#include "frames.h"
+#include "serial.h"
+
+/** Maksymalna długość liczby 64-bitowej zapisanej jako varint. */
+#define VARINT_MAX_LENGTH 10
+
+/** Przyrostek nazwy pliku tymczasowego, zastępowany przez mkostemp. */
+#define TEMP_SUFFIX ".XXXXXX"
+
+/**
+ * Zapisuje liczbę 64-bitową jako varint.
+ * @param[in,out] w : zapis
+ * @param[in] x : liczba
+ */
+static void VarintWrite(Writer *w, uint64_t x) {
+    char buf[VARINT_MAX_LENGTH];
+    size_t n = 0;
+    while (x >= 0x80) {
+        buf[n++] = (char) (x | 0x80);
+        x >>= 7;
+    }
+    buf[n++] = (char) x;
+    WriterWrite(w, buf, n);
+}
+
+/**
+ * Odczytuje liczbę 64-bitową zapisaną jako varint.
+ * @param[in,out] data : wskaźnik na początek danych, przesuwany za liczbę
+ * @param[in] end : koniec danych
+ * @param[out] x : odczytana liczba
+ * @return Czy liczba jest poprawna?
+ */
+static bool VarintRead(const unsigned char **data, const unsigned char *end, uint64_t *x) {
+    const unsigned char *s = *data;
+    uint64_t res = 0;
+    for (unsigned shift = 0; s < end && shift < 7 * VARINT_MAX_LENGTH; shift += 7) {
+        uint64_t b = *s++;
+        if (shift == 7 * (VARINT_MAX_LENGTH - 1) && b > 1) {
+            return false; // Liczba nie mieści się na 64 bitach.
+        }
+        res |= (b & 0x7f) << shift;
+        if (b < 0x80) {
+            *data = s;
+            *x = res;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Koduje liczbę całkowitą tak, by liczby o małej wartości
+ * bezwzględnej miały krótki zapis.
+ * @param[in] c : liczba
+ * @return kod zigzag liczby
+ */
+static inline uint64_t ZigzagEncode(poly_coeff_t c) {
+    return ((uint64_t) c << 1) ^ (uint64_t) -(c < 0);
+}
+
+/**
+ * Dekoduje liczbę zakodowaną funkcją ZigzagEncode.
+ * @param[in] z : kod zigzag liczby
+ * @return liczba
+ */
+static inline poly_coeff_t ZigzagDecode(uint64_t z) {
+    return (poly_coeff_t) ((z >> 1) ^ -(z & 1));
+}
+
+/**
+ * Zapisuje nagłówek węzła wielomianu.
+ * @param[in,out] w : zapis
+ * @param[in] p : wielomian
+ */
+static void NodeWrite(Writer *w, const Poly *p) {
+    if (PolyIsCoeff(p)) {
+        uint64_t z = ZigzagEncode(p->coeff);
+        if (z < (UINT64_C(1) << 63)) {
+            VarintWrite(w, z << 1 | 1);
+        } else {
+            VarintWrite(w, 0);
+            VarintWrite(w, z);
+        }
+    } else {
+        VarintWrite(w, (uint64_t) p->size << 1);
+    }
+}
+
+/**
+ * Odczytuje nagłówek węzła wielomianu. Dla wielomianu niestałego
+ * alokuje pustą tablicę jednomianów o docelowym rozmiarze @p size.
+ * @param[in,out] data : wskaźnik na początek danych, przesuwany za nagłówek
+ * @param[in] end : koniec danych
+ * @param[out] p : wielomian
+ * @param[out] size : liczba jednomianów (0 dla współczynnika)
+ * @return Czy nagłówek jest poprawny?
+ */
+static bool NodeRead(const unsigned char **data, const unsigned char *end, Poly *p, size_t *size) {
+    uint64_t h;
+    if (!VarintRead(data, end, &h)) {
+        return false;
+    }
+    if (h == 0 || (h & 1) == 1) {
+        uint64_t z = h >> 1;
+        if (h == 0 && (!VarintRead(data, end, &z) || z < (UINT64_C(1) << 63))) {
+            return false;
+        }
+        *p = PolyFromCoeff(ZigzagDecode(z));
+        *size = 0;
+        return true;
+    }
+    // Każdy jednomian zajmuje co najmniej dwa bajty, więc zbyt duży
+    // rozmiar odrzucamy przed alokacją pamięci.
+    if ((h >> 1) > (uint64_t) (end - *data) / 2) {
+        return false;
+    }
+    *size = (size_t) (h >> 1);
+    p->size = 0;
+    p->arr = PolyMalloc(*size * sizeof(Mono));
+    CHECK_PTR(p->arr);
+    return true;
+}
+
+void SerialWriteHeader(Writer *w, char kind) {
+    char header[SERIAL_HEADER_LENGTH] = SERIAL_MAGIC;
+    header[SERIAL_MAGIC_LENGTH] = SERIAL_VERSION;
+    header[SERIAL_MAGIC_LENGTH + 1] = kind;
+    WriterWrite(w, header, SERIAL_HEADER_LENGTH);
+}
+
+bool SerialReadHeader(const unsigned char **data, const unsigned char *end, char kind) {
+    const unsigned char *s = *data;
+    if (end - s < SERIAL_HEADER_LENGTH
+        || memcmp(s, SERIAL_MAGIC, SERIAL_MAGIC_LENGTH) != 0
+        || s[SERIAL_MAGIC_LENGTH] != SERIAL_VERSION
+        || s[SERIAL_MAGIC_LENGTH + 1] != (unsigned char) kind) {
+        return false;
+    }
+    *data = s + SERIAL_HEADER_LENGTH;
+    return true;
+}
+
+void SerialWriteSize(Writer *w, size_t x) {
+    VarintWrite(w, x);
+}
+
+bool SerialReadSize(const unsigned char **data, const unsigned char *end, size_t *x) {
+    uint64_t res;
+    if (!VarintRead(data, end, &res) || res > SIZE_MAX) {
+        return false;
+    }
+    *x = (size_t) res;
+    return true;
+}
+
+void PolySerialize(const Poly *p, Writer *w) {
+    assert(p != NULL);
+    NodeWrite(w, p);
+    if (PolyIsCoeff(p)) {
+        return;
+    }
+    PolyFrames fs;
+    FramesInit(&fs);
+    FramesPush(&fs, (PolyFrame) {.p = p});
+    PolyFrame *f;
+    while ((f = FramesTop(&fs)) != NULL) {
+        if (f->i < f->p->size) {
+            const Mono *m = &f->p->arr[f->i];
+            poly_exp_t prev = f->i == 0 ? 0 : f->p->arr[f->i - 1].exp;
+            ++f->i;
+            // Różnica liczona jest modulo 2^32, by zapisać bez strat także
+            // wielomiany, w których wykładniki przekroczyły zakres przy mnożeniu.
+            VarintWrite(w, (uint32_t) ((uint32_t) m->exp - (uint32_t) prev));
+            NodeWrite(w, &m->p);
+            if (!PolyIsCoeff(&m->p)) {
+                FramesPush(&fs, (PolyFrame) {.p = &m->p});
+            }
+        } else {
+            FramesPop(&fs);
+        }
+    }
+    FramesDestroy(&fs);
+}
+
+/**
+ * Odczytuje wielomian zapisany w formacie binarnym (bez nagłówka pliku).
+ * @param[in,out] data : wskaźnik na początek danych, przesuwany za wielomian
+ * @param[in] end : koniec danych
+ * @param[out] p : odczytany wielomian
+ * @param[in] check : czy sprawdzać, że wielomian jest w najprostszej postaci
+ * @return Czy dane są poprawne?
+ */
+static bool PolyDeserializeHelper(const unsigned char **data, const unsigned char *end, Poly *p, bool check) {
+    assert(data != NULL && p != NULL);
+    size_t size;
+    if (!NodeRead(data, end, p, &size)) {
+        return false;
+    }
+    if (size == 0) {
+        return true;
+    }
+    // Rozmiar tablicy budowanego wielomianu jest liczbą jednomianów
+    // odczytanych do tej pory, dlatego w razie błędu wystarczy usunąć
+    // wielomian funkcją PolyDestroy. Docelowy rozmiar trzymamy w polu `i`.
+    PolyFrames fs;
+    FramesInit(&fs);
+    FramesPush(&fs, (PolyFrame) {.r = p, .i = size});
+    bool ok = true;
+    PolyFrame *f;
+    while (ok && (f = FramesTop(&fs)) != NULL) {
+        Poly *r = f->r;
+        size_t target = f->i;
+        if (r->size == target) {
+            FramesPop(&fs);
+            continue;
+        }
+        uint64_t delta;
+        poly_exp_t prev = r->size == 0 ? 0 : r->arr[r->size - 1].exp;
+        Mono *m = &r->arr[r->size];
+        ok = VarintRead(data, end, &delta)
+             && (!check || ((r->size == 0 || delta > 0) && delta <= (uint64_t) (INT_MAX - prev)))
+             && delta <= UINT32_MAX
+             && NodeRead(data, end, &m->p, &size);
+        if (ok) {
+            m->exp = (poly_exp_t) ((uint32_t) prev + (uint32_t) delta);
+            ++r->size;
+            if (size > 0) {
+                // Odłożone na dysk wielomiany stosu mają już dopuszczalną głębokość.
+                ok = !check || fs.top < POLY_MAX_DEPTH;
+                FramesPush(&fs, (PolyFrame) {.r = &m->p, .i = size});
+            } else if (check) {
+                // Wielomian musi być w najprostszej postaci.
+                ok = !PolyIsZero(&m->p) && !(target == 1 && m->exp == 0);
+            }
+        }
+    }
+    FramesDestroy(&fs);
+    if (!ok) {
+        PolyDestroy(p);
+    }
+    return ok;
+}
+
+bool PolyDeserialize(const unsigned char **data, const unsigned char *end, Poly *p) {
+    return PolyDeserializeHelper(data, end, p, true);
+}
+
+bool PolyDeserializeUnchecked(const unsigned char **data, const unsigned char *end, Poly *p) {
+    return PolyDeserializeHelper(data, end, p, false);
+}
+
+/**
+ * Wczytuje plik do bufora przydzielonego funkcją PolyMalloc(). W przeciwieństwie
+ * do odwzorowania bufor liczy się do limitu pamięci i zwalnia go przerwanie
+ * operacji pod strażnikiem. Dlatego bufor jest przydzielany przed otwarciem
+ * pliku – przerwanie nie może zostawić otwartego deskryptora.
+ * @param[in] path : ścieżka do pliku
+ * @param[out] data : początek bufora
+ * @param[out] size : rozmiar pliku
+ * @return Czy udało się wczytać plik?
+ */
+static bool SerialRead(const char *path, const unsigned char **data, size_t *size) {
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+        return false;
+    }
+    *size = (size_t) st.st_size;
+    unsigned char *buf = PolyMalloc(*size);
+    CHECK_PTR(buf);
+    int fd = open(path, O_RDONLY);
+    bool ok = fd >= 0;
+    for (size_t done = 0; ok && done < *size;) {
+        ssize_t n = read(fd, buf + done, *size - done);
+        ok = n > 0;
+        done += ok ? (size_t) n : 0;
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (!ok) {
+        PolyFree(buf);
+        return false;
+    }
+    *data = buf;
+    return true;
+}
+
+bool SerialMap(const char *path, const unsigned char **data, size_t *size) {
+    if (alloc_limit != 0) {
+        return SerialRead(path, data, size);
+    }
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0;
+    if (ok) {
+        *size = (size_t) st.st_size;
+        void *map = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ok = map != MAP_FAILED;
+        if (ok) {
+            madvise(map, *size, MADV_SEQUENTIAL);
+            *data = map;
+        }
+    }
+    close(fd);
+    return ok;
+}
+
+void SerialUnmap(const unsigned char *data, size_t size) {
+    if (alloc_limit != 0) {
+        PolyFree((void *) data);
+    } else {
+        munmap((void *) data, size);
+    }
+}
+
+/**
+ * Tworzy wzorzec nazwy pliku tymczasowego dla pliku @p path, w tym samym
+ * katalogu, by plik dało się podmienić funkcją `rename`.
+ * @param[in] path : ścieżka do pliku docelowego
+ * @return wzorzec nazwy dla `mkostemp`
+ */
+static char *SerialTempPath(const char *path) {
+    size_t len = strlen(path);
+    char *tmp = malloc(len + sizeof(TEMP_SUFFIX));
+    CHECK_PTR(tmp);
+    memcpy(tmp, path, len);
+    memcpy(tmp + len, TEMP_SUFFIX, sizeof(TEMP_SUFFIX));
+    return tmp;
+}
+
+/**
+ * Utrwala na dysku wpis katalogu zawierającego plik @p path,
+ * np. po podmianie pliku funkcją `rename`.
+ * @param[in] path : ścieżka do pliku
+ * @return Czy się udało?
+ */
+static bool SerialSyncDir(const char *path) {
+    const char *slash = strrchr(path, '/');
+    int fd;
+    if (slash == NULL) {
+        fd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    } else {
+        size_t len = slash == path ? 1 : (size_t) (slash - path);
+        char *dir = malloc(len + 1);
+        CHECK_PTR(dir);
+        memcpy(dir, path, len);
+        dir[len] = '\0';
+        fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        free(dir);
+    }
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+}
+
+bool SerialCreate(SerialFile *f, const char *path) {
+    f->tmp = SerialTempPath(path);
+    int fd = mkostemp(f->tmp, O_CLOEXEC);
+    // mkostemp tworzy plik dostępny tylko dla właściciela.
+    if (fd >= 0 && fchmod(fd, 0644) != 0) {
+        close(fd);
+        unlink(f->tmp);
+        fd = -1;
+    }
+    if (fd < 0) {
+        free(f->tmp);
+        return false;
+    }
+    WriterInitFd(&f->w, fd);
+    f->w.line_flush = false;
+    return true;
+}
+
+bool SerialCommit(SerialFile *f, const char *path) {
+    Writer *w = &f->w;
+    WriterDestroy(w);
+    // Dane muszą trafić na dysk przed podmianą, inaczej awaria tuż po niej
+    // mogłaby zostawić pod ścieżką @p path pusty lub niepełny plik.
+    bool ok = !w->err && fsync(w->fd) == 0;
+    ok &= close(w->fd) == 0;
+    if (ok) {
+        ok = rename(f->tmp, path) == 0;
+        if (ok) {
+            ok = SerialSyncDir(path);
+        } else {
+            unlink(f->tmp);
+        }
+    } else {
+        unlink(f->tmp);
+    }
+    free(f->tmp);
+    return ok;
+}
+
+bool PolySave(const Poly *p, const char *path) {
+    SerialFile f;
+    if (!SerialCreate(&f, path)) {
+        return false;
+    }
+    SerialWriteHeader(&f.w, SERIAL_KIND_POLY);
+    PolySerialize(p, &f.w);
+    return SerialCommit(&f, path);
+}
+
+bool PolyLoad(const char *path, Poly *p) {
+    const unsigned char *data;
+    size_t size;
+    if (!SerialMap(path, &data, &size)) {
+        return false;
+    }
+    const unsigned char *s = data;
+    const unsigned char *end = data + size;
+    bool ok = SerialReadHeader(&s, end, SERIAL_KIND_POLY) && PolyDeserialize(&s, end, p);
+    if (ok && s != end) {
+        // Za wielomianem nie może być innych danych.
+        PolyDestroy(p);
+        ok = false;
+    }
+    SerialUnmap(data, size);
+    return ok;
+}
+
+bool PolyArraySave(const Poly *const *arr, size_t count, const char *path) {
+    SerialFile f;
+    if (!SerialCreate(&f, path)) {
+        return false;
+    }
+    SerialWriteHeader(&f.w, SERIAL_KIND_ARRAY);
+    SerialWriteSize(&f.w, count);
+    for (size_t i = 0; i < count; ++i) {
+        PolySerialize(arr[i], &f.w);
+    }
+    return SerialCommit(&f, path);
+}
+
+bool PolyArrayLoad(const char *path, Poly **arr, size_t *count) {
+    const unsigned char *data;
+    size_t size;
+    if (!SerialMap(path, &data, &size)) {
+        return false;
+    }
+    const unsigned char *s = data;
+    const unsigned char *end = data + size;
+    // Każdy wielomian zajmuje co najmniej bajt, więc liczba wielomianów
+    // większa niż reszta pliku świadczy o uszkodzonych danych.
+    bool ok = SerialReadHeader(&s, end, SERIAL_KIND_ARRAY) && SerialReadSize(&s, end, count)
+              && *count <= (size_t) (end - s);
+    *arr = NULL;
+    size_t read = 0;
+    if (ok && *count > 0) {
+        *arr = PolyMalloc(*count * sizeof(Poly));
+        CHECK_PTR(*arr);
+        while (read < *count && PolyDeserialize(&s, end, &(*arr)[read])) {
+            ++read;
+        }
+    }
+    if (ok && (read < *count || s != end)) {
+        ok = false;
+    }
+    if (!ok) {
+        for (size_t i = 0; i < read; ++i) {
+            PolyDestroy(&(*arr)[i]);
+        }
+        PolyFree(*arr);
+        *arr = NULL;
+    }
+    SerialUnmap(data, size);
+    return ok;
+}
@@ -0,0 +1,201 @@
+/** @file
+ * Interfejs binarnego zapisu i odczytu wielomianów.
+ *
+ * Plik zaczyna się nagłówkiem: czterobajtowym napisem #SERIAL_MAGIC,
+ * bajtem wersji formatu #SERIAL_VERSION i bajtem rodzaju zawartości.
+ * Wielomian zapisywany jest w porządku preorder. Każdy węzeł zaczyna
+ * się liczbą @f$ h @f$ zakodowaną jako varint (LEB128):
+ *   - nieparzyste @f$ h @f$ oznacza współczynnik
+ *   o kodzie zigzag równym @f$ h / 2 @f$;
+ *   - @f$ h = 0 @f$ oznacza współczynnik, którego kod zigzag nie mieści
+ *   się na 63 bitach – kod zapisany jest jako kolejny varint;
+ *   - parzyste @f$ h > 0 @f$ oznacza wielomian niestały o @f$ h / 2 @f$
+ *   jednomianach; każdy jednomian to varint z różnicą wykładnika względem
+ *   poprzedniego jednomianu (dla pierwszego – sam wykładnik), po którym
+ *   następuje węzeł współczynnika jednomianu.
+ *
+ * Odczytywane dane są w pełni sprawdzane: wynikiem odczytu jest zawsze
+ * wielomian w najprostszej postaci albo błąd.
+ *
+ * @author Mateusz Sulimowicz <ms429603@students.mimuw.edu.pl>
+ * @date 2021
+ */
+
+#ifndef __SERIAL_H__
+#define __SERIAL_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "poly.h"
+#include "writer.h"
+
+/** Napis rozpoczynający plik w formacie binarnym. */
+#define SERIAL_MAGIC "PLYB"
+
+/** Długość napisu #SERIAL_MAGIC. */
+#define SERIAL_MAGIC_LENGTH 4
+
+/** Wersja formatu binarnego. */
+#define SERIAL_VERSION 1
+
+/** Rodzaj zawartości pliku: pojedynczy wielomian. */
+#define SERIAL_KIND_POLY 'P'
+
+/**
+ * Rodzaj zawartości pliku: ciąg wielomianów poprzedzony ich liczbą
+ * zapisaną jako varint, np. zawartość stosu od dna do wierzchołka.
+ */
+#define SERIAL_KIND_ARRAY 'A'
+
+/** Długość nagłówka pliku. */
+#define SERIAL_HEADER_LENGTH (SERIAL_MAGIC_LENGTH + 2)
+
+/**
+ * Zapisuje nagłówek pliku w formacie binarnym.
+ * @param[in,out] w : zapis
+ * @param[in] kind : rodzaj zawartości pliku
+ */
+void SerialWriteHeader(Writer *w, char kind);
+
+/**
+ * Odczytuje i sprawdza nagłówek pliku w formacie binarnym.
+ * @param[in,out] data : wskaźnik na początek danych, przesuwany za nagłówek
+ * @param[in] end : koniec danych
+ * @param[in] kind : oczekiwany rodzaj zawartości pliku
+ * @return Czy nagłówek jest poprawny?
+ */
+bool SerialReadHeader(const unsigned char **data, const unsigned char *end, char kind);
+
+/**
+ * Zapisuje liczbę nieujemną jako varint.
+ * @param[in,out] w : zapis
+ * @param[in] x : liczba
+ */
+void SerialWriteSize(Writer *w, size_t x);
+
+/**
+ * Odczytuje liczbę nieujemną zapisaną jako varint.
+ * @param[in,out] data : wskaźnik na początek danych, przesuwany za liczbę
+ * @param[in] end : koniec danych
+ * @param[out] x : odczytana liczba
+ * @return Czy liczba jest poprawna?
+ */
+bool SerialReadSize(const unsigned char **data, const unsigned char *end, size_t *x);
+
+/**
+ * Zapisuje wielomian w formacie binarnym (bez nagłówka pliku).
+ * @param[in] p : wielomian
+ * @param[in,out] w : zapis
+ */
+void PolySerialize(const Poly *p, Writer *w);
+
+/**
+ * Odczytuje wielomian zapisany w formacie binarnym (bez nagłówka pliku).
+ * Każda tablica jednomianów alokowana jest dokładnie raz, z docelowym
+ * rozmiarem. Jeśli dane są niepoprawne, w tym gdy wielomian jest zagnieżdżony
+ * głębiej niż #POLY_MAX_DEPTH poziomów, zwalnia częściowo zbudowany
+ * wielomian i zwraca `false`.
+ * @param[in,out] data : wskaźnik na początek danych, przesuwany za wielomian
+ * @param[in] end : koniec danych
+ * @param[out] p : odczytany wielomian
+ * @return Czy dane są poprawne?
+ */
+bool PolyDeserialize(const unsigned char **data, const unsigned char *end, Poly *p);
+
+/**
+ * Odczytuje wielomian tak jak PolyDeserialize(), ale nie sprawdza,
+ * czy jest on w najprostszej postaci. Odtwarza bez strat każdy wielomian
+ * zapisany funkcją PolySerialize(), także taki, w którym wykładniki
+ * przekroczyły zakres. Służy do odczytu danych zapisanych przez sam
+ * program, np. wielomianów odłożonych na dysk przez stos.
+ * @param[in,out] data : wskaźnik na początek danych, przesuwany za wielomian
+ * @param[in] end : koniec danych
+ * @param[out] p : odczytany wielomian
+ * @return Czy dane są poprawne?
+ */
+bool PolyDeserializeUnchecked(const unsigned char **data, const unsigned char *end, Poly *p);
+
+/**
+ * Odwzorowuje plik w pamięci do odczytu sekwencyjnego. Przy limicie pamięci
+ * plik jest zamiast tego wczytywany do bufora liczonego względem limitu,
+ * który zwolni przerwanie operacji pod strażnikiem – patrz alloc.h.
+ * @param[in] path : ścieżka do pliku
+ * @param[out] data : początek odwzorowania
+ * @param[out] size : rozmiar pliku
+ * @return Czy udało się odwzorować plik?
+ */
+bool SerialMap(const char *path, const unsigned char **data, size_t *size);
+
+/**
+ * Usuwa odwzorowanie pliku lub bufor utworzone funkcją SerialMap.
+ * @param[in] data : początek odwzorowania
+ * @param[in] size : rozmiar pliku
+ */
+void SerialUnmap(const unsigned char *data, size_t size);
+
+/** To jest struktura zapisu do pliku tymczasowego, który zastąpi plik docelowy. */
+typedef struct SerialFile {
+    Writer w; ///< zapis do pliku tymczasowego
+    char *tmp; ///< ścieżka pliku tymczasowego
+} SerialFile;
+
+/**
+ * Otwiera plik tymczasowy o unikalnej nazwie w katalogu pliku @p path,
+ * który po zapisaniu zastąpi ten plik. Dzięki temu przerwany zapis nie
+ * niszczy poprzedniej zawartości pliku, a równoczesne zapisy do tego
+ * samego pliku nie piszą do wspólnego pliku tymczasowego.
+ * @param[out] f : zapis do pliku tymczasowego
+ * @param[in] path : ścieżka do pliku docelowego
+ * @return Czy udało się otworzyć plik?
+ */
+bool SerialCreate(SerialFile *f, const char *path);
+
+/**
+ * Kończy zapis rozpoczęty funkcją SerialCreate: opróżnia bufor, utrwala
+ * plik tymczasowy na dysku, zamyka go i, jeśli zapis się powiódł, podmienia
+ * nim plik @p path, po czym utrwala wpis w katalogu. Gdy zapis lub podmiana
+ * się nie powiodły, usuwa plik tymczasowy.
+ * @param[in,out] f : zapis do pliku tymczasowego
+ * @param[in] path : ścieżka do pliku docelowego
+ * @return Czy zapis się powiódł i został utrwalony?
+ */
+bool SerialCommit(SerialFile *f, const char *path);
+
+/**
+ * Zapisuje wielomian do pliku w formacie binarnym.
+ * @param[in] p : wielomian
+ * @param[in] path : ścieżka do pliku
+ * @return Czy zapis się powiódł?
+ */
+bool PolySave(const Poly *p, const char *path);
+
+/**
+ * Odczytuje wielomian z pliku w formacie binarnym.
+ * Plik jest odwzorowywany w pamięci i odczytywany w jednym przebiegu.
+ * @param[in] path : ścieżka do pliku
+ * @param[out] p : odczytany wielomian
+ * @return Czy odczyt się powiódł?
+ */
+bool PolyLoad(const char *path, Poly *p);
+
+/**
+ * Zapisuje do pliku ciąg wielomianów w formacie binarnym.
+ * @param[in] arr : tablica wskaźników na wielomiany
+ * @param[in] count : liczba wielomianów
+ * @param[in] path : ścieżka do pliku
+ * @return Czy zapis się powiódł?
+ */
+bool PolyArraySave(const Poly *const *arr, size_t count, const char *path);
+
+/**
+ * Odczytuje z pliku ciąg wielomianów zapisany funkcją PolyArraySave().
+ * Plik jest odwzorowywany w pamięci i odczytywany w jednym przebiegu,
+ * więc czas odczytu zależy tylko od rozmiaru pliku.
+ * @param[in] path : ścieżka do pliku
+ * @param[out] arr : tablica odczytanych wielomianów, do zwolnienia przez wywołującego funkcją PolyFree()
+ * @param[out] count : liczba wielomianów
+ * @return Czy odczyt się powiódł?
+ */
+bool PolyArrayLoad(const char *path, Poly **arr, size_t *count);
+
+#endif //__SERIAL_H__
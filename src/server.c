@@ -0,0 +1,196 @@
+/** @file
+ * Implementacja serwera obsługującego połączenia przez gniazdo uniksowe.
+ *
+ * @author Mateusz Sulimowicz <ms429603@students.mimuw.edu.pl>
+ * @date 2021
+ */
+
+/** Makro potrzebne do korzystania z GNU C Library. */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "poly.h"
+#include "server.h"
+
+/** Liczba oczekujących połączeń w kolejce przypadająca na wątek roboczy. */
+#define SERVER_QUEUE_PER_THREAD 16
+
+/**
+ * To jest struktura przechowująca stan serwera: kolejkę przyjętych
+ * połączeń, czekających na wolny wątek roboczy.
+ */
+typedef struct Server {
+    int *queue; ///< cykliczna kolejka deskryptorów połączeń
+    size_t cap; ///< pojemność kolejki
+    size_t head; ///< indeks pierwszego połączenia w kolejce
+    size_t count; ///< liczba połączeń w kolejce
+    bool closed; ///< czy serwer kończy pracę i nie przyjmie już połączeń
+    pthread_mutex_t lock; ///< blokada chroniąca kolejkę
+    pthread_cond_t nonempty; ///< sygnalizowany, gdy w kolejce pojawia się połączenie
+    pthread_cond_t nonfull; ///< sygnalizowany, gdy w kolejce zwalnia się miejsce
+    ServerSession session; ///< funkcja obsługująca połączenie
+    void *arg; ///< argument funkcji obsługującej połączenie
+} Server;
+
+/** Czy otrzymano sygnał zakończenia pracy serwera? */
+static volatile sig_atomic_t server_stop;
+
+/**
+ * Obsługuje sygnał zakończenia pracy serwera.
+ * @param[in] sig : numer sygnału
+ */
+static void ServerSignal(int sig) {
+    (void) sig;
+    server_stop = 1;
+}
+
+/**
+ * Wstawia połączenie do kolejki, czekając na wolne miejsce.
+ * @param[in,out] s : serwer
+ * @param[in] fd : deskryptor połączenia
+ */
+static void ServerPush(Server *s, int fd) {
+    pthread_mutex_lock(&s->lock);
+    while (s->count == s->cap) {
+        pthread_cond_wait(&s->nonfull, &s->lock);
+    }
+    s->queue[(s->head + s->count) % s->cap] = fd;
+    ++s->count;
+    pthread_cond_signal(&s->nonempty);
+    pthread_mutex_unlock(&s->lock);
+}
+
+/**
+ * Wyjmuje połączenie z kolejki, czekając na jego pojawienie się.
+ * @param[in,out] s : serwer
+ * @return deskryptor połączenia lub -1, jeśli serwer kończy pracę,
+ * a kolejka jest pusta
+ */
+static int ServerPop(Server *s) {
+    pthread_mutex_lock(&s->lock);
+    while (s->count == 0 && !s->closed) {
+        pthread_cond_wait(&s->nonempty, &s->lock);
+    }
+    int fd = -1;
+    if (s->count > 0) {
+        fd = s->queue[s->head];
+        s->head = (s->head + 1) % s->cap;
+        --s->count;
+        pthread_cond_signal(&s->nonfull);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return fd;
+}
+
+/**
+ * Pętla wątku roboczego: obsługuje kolejne połączenia z kolejki.
+ * @param[in] arg : serwer
+ * @return NULL
+ */
+static void *ServerWorker(void *arg) {
+    Server *s = arg;
+    int fd;
+    while ((fd = ServerPop(s)) >= 0) {
+        s->session(fd, s->arg);
+        close(fd);
+    }
+    return NULL;
+}
+
+/**
+ * Tworzy gniazdo nasłuchujące pod podaną ścieżką. Zastępuje istniejące
+ * gniazdo, ale nie plik innego rodzaju.
+ * @param[in] path : ścieżka gniazda
+ * @return deskryptor gniazda lub -1 w razie błędu, opisanego przez `errno`
+ */
+static int ServerListen(const char *path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    size_t len = strlen(path);
+    if (len == 0 || len >= sizeof(addr.sun_path)) {
+        errno = len == 0 ? ENOENT : ENAMETOOLONG;
+        return -1;
+    }
+    memcpy(addr.sun_path, path, len + 1);
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(path);
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool ServerRun(const char *path, size_t threads, ServerSession session, void *arg) {
+    assert(threads > 0);
+    int listen_fd = ServerListen(path);
+    if (listen_fd < 0) {
+        return false;
+    }
+    Server s = {.cap = threads * SERVER_QUEUE_PER_THREAD, .session = session, .arg = arg};
+    s.queue = malloc(s.cap * sizeof(int));
+    CHECK_PTR(s.queue);
+    pthread_mutex_init(&s.lock, NULL);
+    pthread_cond_init(&s.nonempty, NULL);
+    pthread_cond_init(&s.nonfull, NULL);
+
+    // Klient, który rozłączy się przed odebraniem wyników, nie może
+    // zakończyć całego serwera – zapis do jego gniazda po prostu się nie uda.
+    signal(SIGPIPE, SIG_IGN);
+    // Sygnały zakończenia odbiera tylko wątek główny, przerywając `accept`.
+    struct sigaction sa = {.sa_handler = ServerSignal};
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigset_t stop_signals, old_mask;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, &old_mask);
+    pthread_t *workers = malloc(threads * sizeof(pthread_t));
+    CHECK_PTR(workers);
+    for (size_t i = 0; i < threads; ++i) {
+        if (pthread_create(&workers[i], NULL, ServerWorker, &s) != 0) {
+            exit(1);
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+    while (!server_stop) {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd >= 0) {
+            ServerPush(&s, fd);
+        } else if (errno != EINTR && errno != ECONNABORTED) {
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&s.lock);
+    s.closed = true;
+    pthread_cond_broadcast(&s.nonempty);
+    pthread_mutex_unlock(&s.lock);
+    for (size_t i = 0; i < threads; ++i) {
+        pthread_join(workers[i], NULL);
+    }
+    close(listen_fd);
+    unlink(path);
+    free(workers);
+    free(s.queue);
+    pthread_cond_destroy(&s.nonfull);
+    pthread_cond_destroy(&s.nonempty);
+    pthread_mutex_destroy(&s.lock);
+    return true;
+}
@@ -0,0 +1,41 @@
+/** @file
+ * Interfejs serwera obsługującego połączenia przez gniazdo uniksowe.
+ *
+ * Serwer przyjmuje połączenia w wątku głównym i przekazuje je przez
+ * ograniczoną kolejkę stałej puli wątków roboczych. Każde połączenie
+ * obsługiwane jest w całości przez jeden wątek, więc funkcja obsługująca
+ * połączenie musi jedynie nie współdzielić stanu z innymi połączeniami.
+ *
+ * @author Mateusz Sulimowicz <ms429603@students.mimuw.edu.pl>
+ * @date 2021
+ */
+
+#ifndef __SERVER_H__
+#define __SERVER_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * To jest typ funkcji obsługującej jedno połączenie.
+ * Deskryptor połączenia zamyka serwer, po powrocie z funkcji.
+ * @param[in] fd : deskryptor połączenia
+ * @param[in] arg : argument przekazany do ServerRun()
+ */
+typedef void (*ServerSession)(int fd, void *arg);
+
+/**
+ * Nasłuchuje na gnieździe uniksowym pod ścieżką @p path i obsługuje
+ * połączenia w @p threads wątkach, aż do otrzymania sygnału SIGINT
+ * lub SIGTERM. Istniejące gniazdo pod tą ścieżką jest zastępowane,
+ * a po zakończeniu pracy usuwane. Przed zakończeniem serwer czeka
+ * na obsłużenie przyjętych już połączeń.
+ * @param[in] path : ścieżka gniazda
+ * @param[in] threads : liczba wątków roboczych
+ * @param[in] session : funkcja obsługująca połączenie
+ * @param[in] arg : argument funkcji obsługującej połączenie
+ * @return Czy udało się uruchomić serwer?
+ */
+bool ServerRun(const char *path, size_t threads, ServerSession session, void *arg);
+
+#endif //__SERVER_H__
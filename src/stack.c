@@ -5,6 +5,15 @@
  * @date 2021
  */
 
+/** Makro potrzebne do korzystania z GNU C Library. */
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "alloc.h"
+#include "serial.h"
 #include "stack.h"
 
 /** Mnożnik rozmiaru tablicy do realokacji.*/
@@ -13,22 +22,35 @@
 /** Początkowy rozmiar alokowanej tablicy */
 #define INIT_SIZE 4
 
-/** To jest struktura reprezentująca stos */
+/** Rozmiar bloku, którym kopiowany jest plik z odłożonymi wielomianami. */
+#define SPILL_COPY_SIZE (1 << 20)
+
+/**
+ * To jest struktura reprezentująca stos.
+ * Wielomiany o indeksach mniejszych niż @p spilled są odłożone na dysk:
+ * ich miejsca w @p arr są puste, a zapis wielomianu o indeksie @p i
+ * zaczyna się w pliku od bajtu `offs[i]` i kończy tam, gdzie zaczyna się
+ * zapis następnego (dla ostatniego – na końcu zapisanych danych).
+ */
 struct Stack {
     size_t size; ///< aktualny rozmiar stosu
     size_t top; ///< liczba wielomianów na stosie
     /** To jest tablica przechowująca aktualną zawartość stosu. */
     Poly *arr;
+    size_t keep; ///< liczba wierzchnich wielomianów trzymanych w pamięci lub 0
+    size_t spilled; ///< liczba wielomianów odłożonych na dysk
+    size_t *offs; ///< początki zapisów odłożonych wielomianów, o rozmiarze @p size
+    Writer spill; ///< zapis do pliku z odłożonymi wielomianami; `spill.total` to jego długość
+    bool spill_open; ///< czy plik z odłożonymi wielomianami został utworzony
 };
 
 void StackInit(Stack *s) {
     assert(s != NULL);
-    *s = malloc(sizeof(struct Stack));
-    CHECK_PTR(s);
-    (*s)->arr = malloc(INIT_SIZE * sizeof(Poly));
+    *s = PolyMalloc(sizeof(struct Stack));
+    CHECK_PTR(*s);
+    **s = (struct Stack) {.size = INIT_SIZE};
+    (*s)->arr = PolyMalloc(INIT_SIZE * sizeof(Poly));
     CHECK_PTR((*s)->arr);
-    (*s)->size = INIT_SIZE;
-    (*s)->top = 0;
 }
 /**
  * Sprawdza, czy stos @p s jest pusty.
@@ -57,11 +79,144 @@ static bool StackIsFull(Stack s) {
 static void StackExpand(Stack s) {
     assert(s != NULL);
     size_t new_size = MULTIPLIER * s->size;
-    s->arr = realloc(s->arr, new_size * sizeof(Poly));
+    s->arr = PolyRealloc(s->arr, new_size * sizeof(Poly));
     CHECK_PTR(s->arr);
+    if (s->keep > 0) {
+        s->offs = PolyRealloc(s->offs, new_size * sizeof(size_t));
+        CHECK_PTR(s->offs);
+    }
     s->size = new_size;
 }
 
+void StackSetSpill(Stack s, size_t keep) {
+    assert(s != NULL && keep > 0 && s->keep == 0);
+    s->keep = keep;
+    s->offs = PolyMalloc(s->size * sizeof(size_t));
+    CHECK_PTR(s->offs);
+}
+
+/**
+ * Kończy program, jeśli zapis lub odczyt odłożonych wielomianów się nie
+ * powiódł. Utraconych wielomianów nie da się odtworzyć, więc traktujemy
+ * to jak brak pamięci.
+ * @param[in] ok : czy operacja się powiodła
+ */
+static void StackSpillCheck(bool ok) {
+    if (!ok) {
+        exit(1);
+    }
+}
+
+/**
+ * Tworzy usunięty już z katalogu plik tymczasowy na odłożone wielomiany.
+ * @param[in,out] s : wskaźnik na stos
+ */
+static void StackSpillOpen(Stack s) {
+    const char *dir = getenv("TMPDIR");
+    if (dir == NULL || *dir == '\0') {
+        dir = "/tmp";
+    }
+    size_t len = strlen(dir) + sizeof("/poly-spill-XXXXXX");
+    char *path = PolyMalloc(len);
+    CHECK_PTR(path);
+    snprintf(path, len, "%s/poly-spill-XXXXXX", dir);
+    int fd = mkostemp(path, O_CLOEXEC);
+    StackSpillCheck(fd >= 0);
+    unlink(path);
+    PolyFree(path);
+    WriterInitFd(&s->spill, fd);
+    s->spill_open = true;
+}
+
+/**
+ * Odkłada na dysk najgłębsze wielomiany pozostające w pamięci,
+ * jeśli jest ich więcej niż `2 * keep`, tak by zostało ich `keep`.
+ * @param[in,out] s : wskaźnik na stos
+ */
+static void StackSpill(Stack s) {
+    if (s->keep == 0 || s->top - s->spilled <= MULTIPLIER * s->keep) {
+        return;
+    }
+    // Wielomiany są już na stosie, więc odkładania nie można przerwać.
+    AllocGuard *g = AllocGuardSuspend();
+    if (!s->spill_open) {
+        StackSpillOpen(s);
+    }
+    for (; s->spilled < s->top - s->keep; ++s->spilled) {
+        s->offs[s->spilled] = s->spill.total;
+        PolySerialize(&s->arr[s->spilled], &s->spill);
+        PolyDestroy(&s->arr[s->spilled]);
+    }
+    AllocGuardResume(g);
+}
+
+/**
+ * Odczytuje z dysku odłożone wielomiany tak, by w pamięci było
+ * co najmniej @p need wierzchnich wielomianów. Odczytuje od razu
+ * dodatkowe `keep` wielomianów, bo kolejne operacje zapewne po nie sięgną.
+ * @param[in,out] s : wskaźnik na stos
+ * @param[in] need : liczba potrzebnych wierzchnich wielomianów,
+ * większa od liczby wielomianów w pamięci
+ */
+static void StackFetchSpilled(Stack s, size_t need) {
+    // Odczytane wielomiany należą do stosu, więc ich przydziały nie mogą
+    // zostać zwolnione przy przerwaniu operacji, która po nie sięgnęła.
+    // Odczyt wykonujemy więc pod osobnym strażnikiem: gdy przekroczy limit,
+    // strażnik zwolni odczytane dotąd wielomiany, stos i plik pozostaną
+    // bez zmian, a przerwana zostanie cała operacja.
+    AllocGuard *g = AllocGuardSuspend();
+    AllocGuard fetch;
+    if (g != NULL) {
+        int jumped = setjmp(fetch.env);
+        if (jumped != 0) {
+            AllocGuardResume(g);
+            AllocGuardAbort((AllocAbort) jumped);
+        }
+        AllocGuardBegin(&fetch);
+    }
+    size_t want = need + s->keep;
+    size_t lo = s->top > want ? s->top - want : 0;
+    size_t begin = s->offs[lo];
+    size_t end = s->spill.total;
+    WriterFlush(&s->spill);
+    StackSpillCheck(!s->spill.err);
+    unsigned char *buf = PolyMalloc(end - begin);
+    CHECK_PTR(buf);
+    size_t done = 0;
+    while (done < end - begin) {
+        ssize_t n = pread(s->spill.fd, buf + done, end - begin - done, (off_t) (begin + done));
+        StackSpillCheck(n > 0);
+        done += (size_t) n;
+    }
+    const unsigned char *data = buf;
+    for (size_t i = lo; i < s->spilled; ++i) {
+        StackSpillCheck(PolyDeserializeUnchecked(&data, buf + end - begin, &s->arr[i]));
+    }
+    PolyFree(buf);
+    if (g != NULL) {
+        AllocGuardEnd(&fetch);
+    }
+    // Odczytane wielomiany usuwamy z końca pliku.
+    s->spilled = lo;
+    StackSpillCheck(lseek(s->spill.fd, (off_t) begin, SEEK_SET) >= 0);
+    s->spill.total = begin;
+    AllocGuardResume(g);
+}
+
+/**
+ * Zapewnia, że w pamięci jest co najmniej @p need wierzchnich wielomianów.
+ * Odczyt z dysku, wymagający strażnika, wydzielony jest do osobnej funkcji,
+ * by wywoływana przy każdym sięgnięciu na stos funkcja pozostała krótka.
+ * @param[in,out] s : wskaźnik na stos
+ * @param[in] need : liczba potrzebnych wierzchnich wielomianów
+ */
+static inline void StackFetch(Stack s, size_t need) {
+    assert(need <= s->top);
+    if (s->top - s->spilled < need) {
+        StackFetchSpilled(s, need);
+    }
+}
+
 void StackPush(Stack s, const Poly *p) {
     assert(s != NULL && p != NULL);
     if (StackIsFull(s)) {
@@ -69,11 +224,13 @@ void StackPush(Stack s, const Poly *p) {
     }
     s->arr[s->top] = *p;
     ++(s->top);
+    StackSpill(s);
 }
 
 Poly StackTop(Stack s, bool *err) {
     assert(s != NULL && err != NULL);
     if (!StackIsEmpty(s)) {
+        StackFetch(s, 1);
         Poly p = s->arr[s->top - 1];
         return p;
     } else {
@@ -82,10 +239,22 @@ Poly StackTop(Stack s, bool *err) {
     }
 }
 
+const Poly *StackPeek(Stack s, size_t depth) {
+    assert(s != NULL && depth < s->top);
+    StackFetch(s, depth + 1);
+    return &s->arr[s->top - 1 - depth];
+}
+
+const Poly *StackPeekResident(Stack s, size_t depth) {
+    assert(s != NULL && depth < s->top);
+    return s->top - s->spilled > depth ? &s->arr[s->top - 1 - depth] : NULL;
+}
+
 Poly StackPop(Stack s, bool *err) {
     assert(s != NULL && err != NULL);
     Poly res;
     if (!StackIsEmpty(s)) {
+        StackFetch(s, 1);
         res = s->arr[s->top - 1];
         --(s->top);
     } else {
@@ -95,15 +264,50 @@ Poly StackPop(Stack s, bool *err) {
     return res;
 }
 
+bool StackSave(Stack s, const char *path) {
+    assert(s != NULL);
+    SerialFile f;
+    if (!SerialCreate(&f, path)) {
+        return false;
+    }
+    SerialWriteHeader(&f.w, SERIAL_KIND_ARRAY);
+    SerialWriteSize(&f.w, s->top);
+    if (s->spilled > 0) {
+        // Odłożone wielomiany są już zapisane w formacie binarnym.
+        WriterFlush(&s->spill);
+        StackSpillCheck(!s->spill.err);
+        char *buf = PolyMalloc(SPILL_COPY_SIZE);
+        CHECK_PTR(buf);
+        for (size_t off = 0; off < s->spill.total;) {
+            size_t len = s->spill.total - off < SPILL_COPY_SIZE ? s->spill.total - off : SPILL_COPY_SIZE;
+            ssize_t n = pread(s->spill.fd, buf, len, (off_t) off);
+            StackSpillCheck(n > 0);
+            WriterWrite(&f.w, buf, (size_t) n);
+            off += (size_t) n;
+        }
+        PolyFree(buf);
+    }
+    for (size_t i = s->spilled; i < s->top; ++i) {
+        PolySerialize(&s->arr[i], &f.w);
+    }
+    return SerialCommit(&f, path);
+}
+
 void StackDestroy(Stack s) {
     assert(s != NULL);
-    bool err = false;
-    while (!StackIsEmpty(s)) {
-        Poly p = StackPop(s, &err);
-        PolyDestroy(&p);
+    // Odłożonych wielomianów nie trzeba odczytywać, by je usunąć.
+    for (size_t i = s->spilled; i < s->top; ++i) {
+        PolyDestroy(&s->arr[i]);
+    }
+    if (s->spill_open) {
+        int fd = s->spill.fd;
+        s->spill.len = 0;
+        WriterDestroy(&s->spill);
+        close(fd);
     }
-    free(s->arr);
-    free(s);
+    PolyFree(s->offs);
+    PolyFree(s->arr);
+    PolyFree(s);
 }
 
 size_t StackPolyCount(Stack s) {
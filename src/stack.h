@@ -1,6 +1,12 @@
 /** @file
  * Interfejs stosu.
  *
+ * Stos może odkładać rzadko używane wielomiany na dysk: po wywołaniu
+ * StackSetSpill() wielomiany leżące głębiej niż kilka wierzchnich
+ * są zapisywane w formacie binarnym (patrz serial.h) do pliku
+ * tymczasowego i zwalniane, a gdy operacja na stosie do nich dociera,
+ * są odczytywane z powrotem. Jest to niewidoczne dla użytkownika stosu.
+ *
  * @author Mateusz Sulimowicz <ms429603@students.mimuw.edu.pl>
  * @date 2021
  */
@@ -46,6 +52,45 @@ void StackPush(Stack s, const Poly *p);
  */
 Poly StackTop(Stack s, bool *err);
 
+/**
+ * Zwraca wskaźnik na wielomian leżący @p depth miejsc pod wierzchołkiem
+ * stosu, nie zdejmując go. Stos musi mieć więcej niż @p depth wielomianów.
+ * @param[in] s : wskaźnik na stos
+ * @param[in] depth : głębokość (0 oznacza wierzchołek)
+ * @return wskaźnik na wielomian, ważny do kolejnej zmiany stosu
+ */
+const Poly *StackPeek(Stack s, size_t depth);
+
+/**
+ * Zwraca wskaźnik na wielomian leżący @p depth miejsc pod wierzchołkiem
+ * stosu tak jak StackPeek(), ale nie odczytuje go z dysku. Pozwala zajrzeć
+ * do stosu bez skutków ubocznych, np. przy zapisie przebiegu obliczeń.
+ * @param[in] s : wskaźnik na stos
+ * @param[in] depth : głębokość (0 oznacza wierzchołek)
+ * @return wskaźnik na wielomian lub NULL, jeśli wielomian odłożono na dysk
+ */
+const Poly *StackPeekResident(Stack s, size_t depth);
+
+/**
+ * Włącza odkładanie wielomianów na dysk. W pamięci pozostaje od @p keep
+ * do @p 2·keep wierzchnich wielomianów; głębsze są zapisywane do pliku
+ * tymczasowego w katalogu `$TMPDIR` (domyślnie `/tmp`), porcjami, by
+ * koszt zapisu i odczytu rozłożył się na wiele operacji.
+ * @param[in,out] s : wskaźnik na stos
+ * @param[in] keep : dodatnia liczba wierzchnich wielomianów trzymanych w pamięci
+ */
+void StackSetSpill(Stack s, size_t keep);
+
+/**
+ * Zapisuje całą zawartość stosu, od dna do wierzchołka, do pliku
+ * w formacie ciągu wielomianów (patrz PolyArraySave()). Wielomiany
+ * odłożone na dysk są kopiowane bez odczytywania ich do pamięci.
+ * @param[in] s : wskaźnik na stos
+ * @param[in] path : ścieżka do pliku
+ * @return Czy zapis się powiódł?
+ */
+bool StackSave(Stack s, const char *path);
+
 /**
  * Usuwa stos @p s z pamięci.
  * @param[in] s : wskaźnik na stos
@@ -0,0 +1,135 @@
+/** @file
+ * Implementacja zapisu przebiegu obliczeń.
+ *
+ * @author Mateusz Sulimowicz <ms429603@students.mimuw.edu.pl>
+ * @date 2021
+ */
+
+/** Makro potrzebne do korzystania z GNU C Library. */
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include "trace.h"
+#include "writer.h"
+
+bool trace_on;
+
+/** Zapis do pliku przebiegu. */
+static Writer trace_out;
+
+/** Blokada chroniąca zapis do pliku przebiegu. */
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Czy dopisano już jakieś zdarzenie. */
+static bool trace_first = true;
+
+/** Identyfikator procesu podawany w zdarzeniach. */
+static long trace_pid;
+
+/** Identyfikator bieżącego wątku lub 0, jeśli jeszcze go nie odczytano. */
+static _Thread_local long trace_tid;
+
+bool TraceOpen(const char *path) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    WriterInitFd(&trace_out, fd);
+    WriterChar(&trace_out, '[');
+    trace_pid = (long) getpid();
+    trace_on = true;
+    return true;
+}
+
+void TraceClose(void) {
+    if (trace_on) {
+        trace_on = false;
+        WriterWrite(&trace_out, "\n]\n", strlen("\n]\n"));
+        WriterDestroy(&trace_out);
+        close(trace_out.fd);
+    }
+}
+
+uint64_t TraceNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+/**
+ * Wypisuje czas w mikrosekundach z trzema cyframi po przecinku.
+ * @param[in,out] w : zapis
+ * @param[in] ns : czas w nanosekundach
+ */
+static void TraceWriteMicros(Writer *w, uint64_t ns) {
+    WriterLong(w, (long) (ns / 1000));
+    WriterChar(w, '.');
+    unsigned frac = (unsigned) (ns % 1000);
+    WriterChar(w, (char) ('0' + frac / 100));
+    WriterChar(w, (char) ('0' + frac / 10 % 10));
+    WriterChar(w, (char) ('0' + frac % 10));
+}
+
+/**
+ * Wypisuje napis w cudzysłowie, zamieniając znaki specjalne JSON.
+ * @param[in,out] w : zapis
+ * @param[in] s : napis
+ * @param[in] len : długość napisu
+ */
+static void TraceWriteString(Writer *w, const char *s, size_t len) {
+    WriterChar(w, '"');
+    for (size_t i = 0; i < len; ++i) {
+        unsigned char c = (unsigned char) s[i];
+        if (c == '"' || c == '\\') {
+            WriterChar(w, '\\');
+            WriterChar(w, (char) c);
+        } else if (c < 0x20) {
+            WriterChar(w, '?');
+        } else {
+            WriterChar(w, (char) c);
+        }
+    }
+    WriterChar(w, '"');
+}
+
+void TraceSpan(const char *cat, const char *name, size_t name_len, uint64_t start,
+               size_t argc, const TraceArg args[]) {
+    uint64_t end = TraceNow();
+    if (trace_tid == 0) {
+        trace_tid = syscall(SYS_gettid);
+    }
+    pthread_mutex_lock(&trace_lock);
+    if (trace_on) {
+        Writer *w = &trace_out;
+        WriterWrite(w, trace_first ? "\n" : ",\n", trace_first ? 1 : 2);
+        trace_first = false;
+        WriterWrite(w, "{\"ph\":\"X\",\"cat\":", strlen("{\"ph\":\"X\",\"cat\":"));
+        TraceWriteString(w, cat, strlen(cat));
+        WriterWrite(w, ",\"name\":", strlen(",\"name\":"));
+        TraceWriteString(w, name, name_len);
+        WriterWrite(w, ",\"pid\":", strlen(",\"pid\":"));
+        WriterLong(w, trace_pid);
+        WriterWrite(w, ",\"tid\":", strlen(",\"tid\":"));
+        WriterLong(w, trace_tid);
+        WriterWrite(w, ",\"ts\":", strlen(",\"ts\":"));
+        TraceWriteMicros(w, start);
+        WriterWrite(w, ",\"dur\":", strlen(",\"dur\":"));
+        TraceWriteMicros(w, end - start);
+        WriterWrite(w, ",\"args\":{", strlen(",\"args\":{"));
+        for (size_t i = 0; i < argc; ++i) {
+            if (i > 0) {
+                WriterChar(w, ',');
+            }
+            TraceWriteString(w, args[i].key, strlen(args[i].key));
+            WriterChar(w, ':');
+            WriterLong(w, args[i].value);
+        }
+        WriterWrite(w, "}}", 2);
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
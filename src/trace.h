@@ -0,0 +1,91 @@
+/** @file
+ * Zapis przebiegu obliczeń w formacie Chrome Trace Event.
+ *
+ * Po włączeniu zapisu funkcja TraceSpan() dopisuje do pliku zdarzenia
+ * typu "X" (odcinek czasu z początkiem i długością), które można obejrzeć
+ * w `chrome://tracing` lub w Perfetto. Odcinki tego samego wątku
+ * zagnieżdżają się według czasu. Plik ma format tablicy JSON, której
+ * zamykający nawias jest opcjonalny, więc nadaje się do obejrzenia także
+ * po przerwaniu programu.
+ *
+ * Gdy zapis jest wyłączony, miejsca pomiarów sprawdzają tylko jedną flagę.
+ *
+ * @author Mateusz Sulimowicz <ms429603@students.mimuw.edu.pl>
+ * @date 2021
+ */
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Odcinki wewnętrznych etapów obliczeń krótsze niż tyle nanosekund
+ * są pomijane, by zapis nie rósł o tysiące odcinków na każdy wiersz.
+ */
+#define TRACE_MIN_NS 1000
+
+/** To jest struktura opisująca liczbowy argument zdarzenia. */
+typedef struct TraceArg {
+    const char *key; ///< nazwa argumentu
+    long value; ///< wartość argumentu
+} TraceArg;
+
+/** Czy zapis przebiegu jest włączony. */
+extern bool trace_on;
+
+/**
+ * Włącza zapis przebiegu do pliku.
+ * @param[in] path : ścieżka do pliku
+ * @return Czy udało się otworzyć plik?
+ */
+bool TraceOpen(const char *path);
+
+/** Kończy zapis przebiegu i zamyka plik. */
+void TraceClose(void);
+
+/**
+ * Zwraca bieżący czas monotoniczny.
+ * @return czas w nanosekundach
+ */
+uint64_t TraceNow(void);
+
+/**
+ * Zwraca czas początku odcinka, jeśli zapis jest włączony.
+ * @return czas w nanosekundach lub 0
+ */
+static inline uint64_t TraceStart(void) {
+    return trace_on ? TraceNow() : 0;
+}
+
+/**
+ * Dopisuje odcinek, który zaczął się w chwili @p start i kończy teraz.
+ * Można ją wywoływać z wielu wątków.
+ * @param[in] cat : kategoria odcinka
+ * @param[in] name : nazwa odcinka; znaki specjalne JSON są zamieniane
+ * @param[in] name_len : długość nazwy
+ * @param[in] start : czas początku zwrócony przez TraceStart()
+ * @param[in] argc : liczba argumentów
+ * @param[in] args : argumenty
+ */
+void TraceSpan(const char *cat, const char *name, size_t name_len, uint64_t start,
+               size_t argc, const TraceArg args[]);
+
+/**
+ * Dopisuje odcinek wewnętrznego etapu obliczeń, jeśli zapis jest włączony,
+ * a odcinek nie jest krótszy niż #TRACE_MIN_NS.
+ * @param[in] name : nazwa odcinka
+ * @param[in] start : czas początku zwrócony przez TraceStart()
+ * @param[in] argc : liczba argumentów
+ * @param[in] args : argumenty
+ */
+static inline void TracePhase(const char *name, uint64_t start, size_t argc, const TraceArg args[]) {
+    if (trace_on && TraceNow() - start >= TRACE_MIN_NS) {
+        TraceSpan("phase", name, strlen(name), start, argc, args);
+    }
+}
+
+#endif //__TRACE_H__
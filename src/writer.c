@@ -0,0 +1,104 @@
+/** @file
+ * Implementacja buforowanego zapisu tekstu.
+ *
+ * @author Mateusz Sulimowicz <ms429603@students.mimuw.edu.pl>
+ * @date 2021
+ */
+
+/** Makro potrzebne do korzystania z GNU C Library. */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "number.h"
+#include "poly.h"
+#include "writer.h"
+
+void WriterInitFd(Writer *w, int fd) {
+    *w = (Writer) {.cap = WRITER_BUFFER_SIZE, .fd = fd, .own = true, .line_flush = isatty(fd)};
+    w->buf = malloc(w->cap);
+    CHECK_PTR(w->buf);
+}
+
+void WriterInitFile(Writer *w, FILE *file, char *buf, size_t cap) {
+    *w = (Writer) {.buf = buf, .cap = cap, .fd = -1, .file = file};
+}
+
+void WriterInitMem(Writer *w, char *buf, size_t cap) {
+    *w = (Writer) {.buf = buf, .cap = cap, .fd = -1};
+}
+
+/**
+ * Zapisuje do deskryptora cały tekst, ponawiając częściowe zapisy.
+ * @param[in,out] w : zapis
+ * @param[in] s : tekst
+ * @param[in] n : długość tekstu
+ */
+static void WriterWriteFd(Writer *w, const char *s, size_t n) {
+    while (n > 0 && !w->err) {
+        ssize_t k = write(w->fd, s, n);
+        if (k > 0) {
+            s += k;
+            n -= (size_t) k;
+        } else if (k < 0 && errno != EINTR) {
+            w->err = true;
+        }
+    }
+}
+
+void WriterFlush(Writer *w) {
+    if (w->len > 0) {
+        if (w->fd >= 0) {
+            WriterWriteFd(w, w->buf, w->len);
+            w->len = 0;
+        } else if (w->file != NULL) {
+            w->err |= fwrite(w->buf, sizeof(char), w->len, w->file) != w->len;
+            w->len = 0;
+        }
+    }
+}
+
+void WriterWriteSlow(Writer *w, const char *s, size_t n) {
+    if (w->fd < 0 && w->file == NULL) {
+        // Zapis do pamięci: zapisujemy tyle, ile się zmieści.
+        size_t k = w->cap - w->len;
+        if (k > 0) {
+            memcpy(w->buf + w->len, s, k);
+            w->len += k;
+        }
+        w->total += n;
+        return;
+    }
+    WriterFlush(w);
+    if (n <= w->cap) {
+        memcpy(w->buf, s, n);
+        w->len = n;
+    } else if (w->fd >= 0) {
+        // Długi tekst zapisujemy z pominięciem bufora.
+        WriterWriteFd(w, s, n);
+    } else {
+        w->err |= fwrite(s, sizeof(char), n, w->file) != n;
+    }
+    w->total += n;
+}
+
+void WriterDestroy(Writer *w) {
+    WriterFlush(w);
+    if (w->own) {
+        free(w->buf);
+    }
+}
+
+void WriterLong(Writer *w, long x) {
+    char buf[NUMBER_MAX_LENGTH];
+    char *end = NumberFormatLong(x, buf);
+    WriterWrite(w, buf, (size_t) (end - buf));
+}
+
+void WriterEndLine(Writer *w) {
+    WriterChar(w, '\n');
+    if (w->line_flush) {
+        WriterFlush(w);
+    }
+}
@@ -0,0 +1,126 @@
+/** @file
+ * Interfejs buforowanego zapisu tekstu.
+ *
+ * Bufor może być opróżniany do deskryptora pliku (funkcją `write`),
+ * do strumienia `FILE` lub może być tablicą w pamięci, do której zapisujemy
+ * tylko tyle, ile się zmieści, licząc przy tym długość całego tekstu.
+ * Funkcje nie korzystają ze stanu globalnego, więc różne wątki mogą
+ * jednocześnie zapisywać do różnych buforów.
+ *
+ * @author Mateusz Sulimowicz <ms429603@students.mimuw.edu.pl>
+ * @date 2021
+ */
+
+#ifndef __WRITER_H__
+#define __WRITER_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+/** Rozmiar bufora zapisu do deskryptora pliku. */
+#define WRITER_BUFFER_SIZE (1 << 20)
+
+/** To jest struktura reprezentująca buforowany zapis tekstu. */
+typedef struct Writer {
+    char *buf; ///< bufor
+    size_t cap; ///< rozmiar bufora
+    size_t len; ///< liczba zajętych bajtów bufora
+    size_t total; ///< liczba wszystkich zapisanych bajtów
+    int fd; ///< deskryptor, do którego opróżniany jest bufor, lub -1
+    FILE *file; ///< strumień, do którego opróżniany jest bufor, lub NULL
+    bool own; ///< czy bufor został zaalokowany przez zapis
+    bool line_flush; ///< czy opróżniać bufor po każdym wierszu
+    bool err; ///< czy wystąpił błąd zapisu
+} Writer;
+
+/**
+ * Inicjuje zapis do deskryptora pliku z własnym buforem
+ * o rozmiarze #WRITER_BUFFER_SIZE. Jeśli deskryptor jest terminalem,
+ * bufor jest opróżniany po każdym wierszu.
+ * @param[out] w : zapis
+ * @param[in] fd : deskryptor pliku
+ */
+void WriterInitFd(Writer *w, int fd);
+
+/**
+ * Inicjuje zapis do strumienia z użyciem bufora @p buf.
+ * @param[out] w : zapis
+ * @param[in] file : strumień
+ * @param[in] buf : bufor
+ * @param[in] cap : rozmiar bufora
+ */
+void WriterInitFile(Writer *w, FILE *file, char *buf, size_t cap);
+
+/**
+ * Inicjuje zapis do tablicy w pamięci. Tekst, który nie mieści się
+ * w tablicy, jest pomijany, ale wliczany do długości @p total.
+ * @param[out] w : zapis
+ * @param[in] buf : tablica
+ * @param[in] cap : rozmiar tablicy
+ */
+void WriterInitMem(Writer *w, char *buf, size_t cap);
+
+/**
+ * Opróżnia bufor zapisu do deskryptora lub strumienia.
+ * Dla zapisu do pamięci nic nie robi.
+ * @param[in,out] w : zapis
+ */
+void WriterFlush(Writer *w);
+
+/**
+ * Opróżnia bufor i zwalnia zasoby zapisu.
+ * Nie zamyka deskryptora ani strumienia.
+ * @param[in,out] w : zapis
+ */
+void WriterDestroy(Writer *w);
+
+/**
+ * Zapisuje tekst, który nie mieści się w wolnej części bufora.
+ * @param[in,out] w : zapis
+ * @param[in] s : tekst
+ * @param[in] n : długość tekstu
+ */
+void WriterWriteSlow(Writer *w, const char *s, size_t n);
+
+/**
+ * Zapisuje tekst o długości @p n.
+ * @param[in,out] w : zapis
+ * @param[in] s : tekst
+ * @param[in] n : długość tekstu
+ */
+static inline void WriterWrite(Writer *w, const char *s, size_t n) {
+    if (n <= w->cap - w->len) {
+        memcpy(w->buf + w->len, s, n);
+        w->len += n;
+        w->total += n;
+    } else {
+        WriterWriteSlow(w, s, n);
+    }
+}
+
+/**
+ * Zapisuje znak.
+ * @param[in,out] w : zapis
+ * @param[in] c : znak
+ */
+static inline void WriterChar(Writer *w, char c) {
+    WriterWrite(w, &c, 1);
+}
+
+/**
+ * Zapisuje liczbę całkowitą w systemie dziesiętnym.
+ * @param[in,out] w : zapis
+ * @param[in] x : liczba
+ */
+void WriterLong(Writer *w, long x);
+
+/**
+ * Kończy wiersz: zapisuje znak `\n`, a jeśli zapis opróżniany jest po
+ * każdym wierszu, opróżnia bufor.
+ * @param[in,out] w : zapis
+ */
+void WriterEndLine(Writer *w);
+
+#endif //__WRITER_H__